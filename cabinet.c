@@ -0,0 +1,101 @@
+/*
+    cabinet.c
+
+    sample "cabinet" language used by the rum application and benchmark
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <rump.h>
+#include "cabinet.h"
+
+/* attribute handles, resolved once when the language is defined */
+static int shelf_id_attr, bottle_type_attr, bottle_aged_attr, bottle_vintage_attr, glass_type_attr;
+
+static void
+display_cabinet(const rum_element_t *cabinet)
+{
+    if (rum_element_get_first_child(cabinet)) {
+        printf("The cabinet has the following:\n");
+    } else {
+        printf("The cabinet is empty.\n");
+    }
+}
+
+static void
+display_shelf(const rum_element_t *shelf)
+{
+    const char *id = rum_element_get_value_by_handle(shelf, shelf_id_attr);
+
+    printf("   The");
+    if (id && *id) {
+        printf(" %s", id);
+    }
+    if (rum_element_get_first_child(shelf)) {
+        printf(" shelf contains:\n");
+    } else {
+        printf(" shelf is empty.\n");
+    }
+}
+
+static void
+display_bottle(const rum_element_t *bottle)
+{
+    const char *bottle_type = rum_element_get_value_by_handle(bottle, bottle_type_attr);
+    const char *maker = rum_element_get_content(bottle);
+    long aged, vintage;
+
+    printf("      A");
+    if (rum_element_get_integer(bottle, bottle_vintage_attr, &vintage) > 0) {
+        printf(" %ld", vintage);
+    }
+    if (rum_element_get_integer(bottle, bottle_aged_attr, &aged) > 0) {
+        printf(" %ld-year-old", aged);
+    }
+    printf(" bottle");
+    if ((maker && *maker) || (bottle_type && *bottle_type)) {
+        printf(" of");
+    }
+    if (maker && *maker) {
+        printf(" %s", maker);
+    }
+    if (bottle_type && *bottle_type) {
+        printf(" %s", bottle_type);
+    }
+    printf("\n");
+}
+
+static void
+display_glass(const rum_element_t *glass)
+{
+    const char *glass_type = rum_element_get_value_by_handle(glass, glass_type_attr);
+    printf("      A %s\n", (glass_type && *glass_type)? glass_type : "glass");
+}
+
+rum_tag_t *
+define_language()
+{
+    rum_tag_t *cabinet, *shelf, *bottle, *glass;
+    rum_attr_t shelf_attrs[] = { { "id", 0 } };
+    rum_attr_t bottle_attrs[] = { { "type", 1 }, { "aged", 0, RUM_ATTR_INTEGER }, { "vintage", 0, RUM_ATTR_INTEGER } };
+    rum_attr_t glass_attrs[] = { { "type", 1 } };
+    int shelf_nattrs = sizeof(shelf_attrs) / sizeof(rum_attr_t);
+    int bottle_nattrs = sizeof(bottle_attrs) / sizeof(rum_attr_t);
+    int glass_nattrs = sizeof(glass_attrs) / sizeof(rum_attr_t);
+
+    if (((cabinet = rum_tag_new(NULL, "cabinet", 0, 0, NULL, &display_cabinet)) == NULL)
+    || ((shelf = rum_tag_new(cabinet, "shelf", 0, shelf_nattrs, shelf_attrs, &display_shelf)) == NULL)
+    || ((bottle = rum_tag_new(shelf, "bottle", 0, bottle_nattrs, bottle_attrs, &display_bottle)) == NULL)
+    || ((glass = rum_tag_new(shelf, "glass", 1, glass_nattrs, glass_attrs, &display_glass)) == NULL)) {
+        return NULL;
+    }
+    if (((shelf_id_attr = rum_tag_attr_handle(shelf, "id")) < 0)
+    || ((bottle_type_attr = rum_tag_attr_handle(bottle, "type")) < 0)
+    || ((bottle_aged_attr = rum_tag_attr_handle(bottle, "aged")) < 0)
+    || ((bottle_vintage_attr = rum_tag_attr_handle(bottle, "vintage")) < 0)
+    || ((glass_type_attr = rum_tag_attr_handle(glass, "type")) < 0)) {
+        return NULL;
+    }
+    return(cabinet);
+}
@@ -0,0 +1,19 @@
+/*
+    cabinet.h
+
+    declarations for the sample "cabinet" language used by the rum application and benchmark
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef CABINET__H
+#define CABINET__H
+
+#include <rum_types.h>
+
+/* define the sample language (a cabinet of shelves holding bottles and glasses),
+ * whose display methods describe each element in English on standard output
+ */
+rum_tag_t *define_language();
+
+#endif /* CABINET__H */
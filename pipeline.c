@@ -0,0 +1,172 @@
+/*
+    pipeline.c
+
+    pipelined display for the rum application: displaying subtrees while the rest is parsed
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <rump.h>
+#include "pipeline.h"
+
+/* single-producer, single-consumer queue of subtrees
+ *
+ * each index is only changed by one side, which publishes it with a release store after using
+ * the slot, and the other side reads it with an acquire load before using the slot, so neither
+ * side takes a lock while the queue is neither empty nor full; only then does a side sleep, on a
+ * condition that the other side signals if it sees the waiting flag after moving its index
+ * (the flag and the indexes are sequentially consistent, so that one side always sees the other)
+ */
+struct queue_s {
+    rum_element_t *slots[PIPELINE_QUEUE_SIZE];
+    unsigned long head;     /* next slot to fill (changed by the producer only) */
+    unsigned long tail;     /* next slot to take (changed by the consumer only) */
+
+    /* only used when the queue is empty or full */
+    int waiting;
+    pthread_mutex_t lock;
+    pthread_cond_t moved;
+};
+
+/* sleep until the other side's index is no longer at value */
+static void
+queue_wait(struct queue_s *queue, unsigned long *index, unsigned long value)
+{
+    pthread_mutex_lock(&(queue->lock));
+    __atomic_store_n(&(queue->waiting), 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(index, __ATOMIC_SEQ_CST) == value) {
+        pthread_cond_wait(&(queue->moved), &(queue->lock));
+    }
+    __atomic_store_n(&(queue->waiting), 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&(queue->lock));
+}
+
+/* wake the other side, if it is waiting for this side's index to move */
+static void
+queue_wake(struct queue_s *queue)
+{
+    if (__atomic_load_n(&(queue->waiting), __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&(queue->lock));
+        pthread_cond_signal(&(queue->moved));
+        pthread_mutex_unlock(&(queue->lock));
+    }
+}
+
+/* what the parsing thread keeps track of */
+struct pipeline_s {
+    struct queue_s queue;
+
+    /* whether the root element has been displayed (boolean) */
+    int root_displayed;
+};
+
+static void
+queue_put(struct queue_s *queue, rum_element_t *element)
+{
+    unsigned long head = queue->head, tail;
+
+    if (head - (tail = __atomic_load_n(&(queue->tail), __ATOMIC_ACQUIRE)) == PIPELINE_QUEUE_SIZE) {
+        queue_wait(queue, &(queue->tail), tail);
+    }
+    queue->slots[head & (PIPELINE_QUEUE_SIZE - 1)] = element;
+    __atomic_store_n(&(queue->head), head + 1, __ATOMIC_SEQ_CST);
+    queue_wake(queue);
+}
+
+static rum_element_t *
+queue_take(struct queue_s *queue)
+{
+    unsigned long tail = queue->tail;
+    rum_element_t *element;
+
+    if (__atomic_load_n(&(queue->head), __ATOMIC_ACQUIRE) == tail) {
+        queue_wait(queue, &(queue->head), tail);
+    }
+    element = queue->slots[tail & (PIPELINE_QUEUE_SIZE - 1)];
+    __atomic_store_n(&(queue->tail), tail + 1, __ATOMIC_SEQ_CST);
+    queue_wake(queue);
+    return element;
+}
+
+/* display thread: display and free subtrees until a NULL one marks the end */
+static void *
+display_subtrees(void *data)
+{
+    struct queue_s *queue = data;
+    rum_element_t *element;
+
+    while ((element = queue_take(queue)) != NULL) {
+        rum_element_display(element);
+        rum_element_free(element);
+    }
+    return NULL;
+}
+
+/* element-complete callback: hand each child of the root to the display thread */
+static int
+publish(rum_element_t *element, void *data)
+{
+    struct pipeline_s *pipeline = data;
+    rum_element_t *root = rum_element_get_parent(element);
+
+    if (rum_element_get_parent(root)) {
+        return RUM_ELEMENT_KEEP;
+    }
+
+    /* the display thread has displayed nothing yet, so the root can be displayed here, while its
+     * first child is still attached
+     */
+    if (!(pipeline->root_displayed)) {
+        rum_tag_display_element(root->tag, root);
+        pipeline->root_displayed = 1;
+    }
+    rum_element_detach(element);
+    queue_put(&(pipeline->queue), element);
+    return RUM_ELEMENT_TAKE;
+}
+
+int
+display_pipelined(FILE *infile, const rum_tag_t *language)
+{
+    struct pipeline_s pipeline;
+    rum_parse_options_t options;
+    rum_element_t *root;
+    pthread_t display_thread;
+    char *errmsg;
+
+    memset(&pipeline, 0, sizeof(pipeline));
+    pthread_mutex_init(&(pipeline.queue.lock), NULL);
+    pthread_cond_init(&(pipeline.queue.moved), NULL);
+    if (pthread_create(&display_thread, NULL, display_subtrees, &(pipeline.queue)) != 0) {
+        pthread_mutex_destroy(&(pipeline.queue.lock));
+        pthread_cond_destroy(&(pipeline.queue.moved));
+        fprintf(stderr, "*** ERROR: Unable to start display thread\n");
+        return 1;
+    }
+
+    memset(&options, 0, sizeof(options));
+    options.on_complete = publish;
+    options.complete_data = &pipeline;
+    root = rum_parse_file_with_options(infile, language, &options, 1);
+
+    /* save error message because later calls will wipe it */
+    errmsg = rum_last_error();
+    queue_put(&(pipeline.queue), NULL);
+    pthread_join(display_thread, NULL);
+    pthread_mutex_destroy(&(pipeline.queue.lock));
+    pthread_cond_destroy(&(pipeline.queue.moved));
+    if (errmsg) {
+        fprintf(stderr, "*** ERROR: %s\n", errmsg);
+        return 1;
+    }
+
+    /* a root without children has not been displayed yet */
+    if (!(pipeline.root_displayed)) {
+        rum_element_display(root);
+    }
+    rum_element_free(root);
+    return 0;
+}
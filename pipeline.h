@@ -0,0 +1,33 @@
+/*
+    pipeline.h
+
+    declarations for the rum application's pipelined display
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef PIPELINE__H
+#define PIPELINE__H
+
+#include <stdio.h>
+#include <rum_types.h>
+
+/*
+ * In pipelined mode, the application displays each child of the root element as soon as it has
+ * been parsed, rather than waiting for the whole document. The parsing thread takes each completed
+ * child out of the tree (see RUM_ELEMENT_TAKE) and passes it through a single-producer,
+ * single-consumer queue to a display thread, which displays and frees it while parsing continues.
+ *
+ * The root element itself is displayed when its first child is complete (or at the end, if it has
+ * none), so its display method sees its attributes and whether it has children, but not its later
+ * children. If the input turns out to be invalid, what was displayed before the error stays
+ * displayed.
+ */
+
+/* number of completed subtrees that can wait for display (a power of 2) */
+#define PIPELINE_QUEUE_SIZE (1024)
+
+/* display a document from an open file stream as it is parsed, returning 0 on success or 1 on error */
+int display_pipelined(FILE *infile, const rum_tag_t *language);
+
+#endif /* PIPELINE__H */
@@ -7,89 +7,524 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
 #include <rump.h>
+#include "rum_private.h"
+#include "cabinet.h"
+#include "serve.h"
+#include "pipeline.h"
 
-#define DEBUG 0
+#define MAX_KEYS (16)
+
+/* memory budget of the parse cache used by --cache (only one document is parsed, so it is generous) */
+#define CACHE_BUDGET (64 * 1024 * 1024)
+
+/* size of each read of the input for --cache */
+#define READ_SIZE (64 * 1024)
 
 static void
-display_cabinet(const rum_element_t *cabinet)
+usage(const char *cmd)
+{
+    fprintf(stderr, "Usage: %s [--stats] [--profile] [--trace] [<file>]\n", cmd);
+    fprintf(stderr, "       %s --build-index=<index> [--key=<tag>@<attr> ...] <file>\n", cmd);
+    fprintf(stderr, "       %s --index=<index> (--child=<n> | --find=<tag>@<attr>=<value>) <file>\n", cmd);
+    fprintf(stderr, "       %s (--count=<tag> | --group-by=<tag>@<attr> | --sum=<tag>@<attr>\n", cmd);
+    fprintf(stderr, "           | --min=<tag>@<attr> | --max=<tag>@<attr>) ... [<file>]\n");
+    fprintf(stderr, "       %s --records [<file>]\n", cmd);
+    fprintf(stderr, "       %s --pipeline [<file>]\n", cmd);
+    fprintf(stderr, "       %s --cache=<dir> [<file>]\n", cmd);
+    fprintf(stderr, "       %s --serve=<socket> [--workers=<n>]\n", cmd);
+}
+
+/* split "tag@attr" (or "tag@attr=value" if value is not NULL) in place, returning 0 on success or -1 if malformed */
+static int
+split_key(char *spec, char **tag_name, char **attr_name, char **value)
+{
+    char *at, *equals = NULL;
+
+    if (((at = strchr(spec, '@')) == NULL) || (value && ((equals = strchr(at, '=')) == NULL))) {
+        return -1;
+    }
+    *at = 0;
+    *tag_name = spec;
+    *attr_name = at + 1;
+    if (value) {
+        *equals = 0;
+        *value = equals + 1;
+    }
+    return (**tag_name && **attr_name)? 0 : -1;
+}
+
+/* scan a file and save a sidecar index for it */
+static int
+build_index(FILE *infile, const rum_tag_t *language, const char *index_path,
+    const char **tag_names, const char **attr_names, int nkeys)
 {
-    if (rum_element_get_first_child(cabinet)) {
-        printf("The cabinet has the following:\n");
+    rum_sidecar_t *sidecar;
+
+    if ((sidecar = rum_sidecar_build(infile, language, tag_names, attr_names, nkeys)) == NULL) {
+        return -1;
+    }
+    if (rum_sidecar_save(sidecar, index_path) < 0) {
+        fprintf(stderr, "*** ERROR: %s\n", rum_last_error());
+        rum_sidecar_free(sidecar);
+        return 1;
+    }
+    printf("Indexed %llu top-level elements\n", (unsigned long long) rum_sidecar_get_nchildren(sidecar));
+    rum_sidecar_free(sidecar);
+    return 0;
+}
+
+/* display one element of a file, found using its sidecar index by position or key */
+static int
+display_indexed(FILE *infile, const rum_tag_t *language, const char *index_path, const char *child,
+    const char *tag_name, const char *attr_name, const char *value)
+{
+    rum_sidecar_t *sidecar;
+    const rum_sidecar_range_t *range;
+    rum_element_t *element;
+    char *end;
+    unsigned long long n;
+
+    if ((sidecar = rum_sidecar_load(index_path, language)) == NULL) {
+        return -1;
+    }
+    if (child) {
+        n = strtoull(child, &end, 10);
+        range = (*child && !*end)? rum_sidecar_find_child(sidecar, n) : NULL;
     } else {
-        printf("The cabinet is empty.\n");
+        range = rum_sidecar_find_key(sidecar, tag_name, attr_name, value);
     }
+    if (range == NULL) {
+        rum_sidecar_free(sidecar);
+        fprintf(stderr, "*** No such element in index\n");
+        return 1;
+    }
+    if ((element = rum_parse_indexed(infile, sidecar, range, 1)) == NULL) {
+        fprintf(stderr, "*** ERROR: %s\n", rum_last_error());
+        rum_sidecar_free(sidecar);
+        return 1;
+    }
+    rum_element_display(element);
+    rum_element_free(element);
+    rum_sidecar_free(sidecar);
+    return 0;
+}
+
+/* kinds of streaming aggregate */
+typedef enum {
+    AGGREGATE_COUNT,
+    AGGREGATE_GROUP_BY,
+    AGGREGATE_SUM,
+    AGGREGATE_MIN,
+    AGGREGATE_MAX
+} aggregate_type_t;
+
+static const char *aggregate_names[] = { "count", "group-by", "sum", "min", "max" };
+
+#define MAX_AGGREGATES (16)
+
+/* number of elements with one value of a group-by attribute */
+struct group_s {
+    char *value;
+    long count;
+};
+
+/* one aggregate requested on the command line */
+struct aggregate_s {
+    aggregate_type_t type;
+    char *tag_name;
+    char *attr_name;    /* NULL for count */
+
+    /* handles[id] is the attribute's handle for the tag with that id, or -1 if that tag is not aggregated
+     * (for count, 0 for any tag with the right name)
+     */
+    int *handles;
+
+    /* number of elements counted (or with a value, for sum, min and max), and running result */
+    long count;
+    double result;
+
+    /* group-by values, in an open-addressed hash table */
+    struct group_s *groups;
+    size_t nslots;
+    size_t ngroups;
+};
+
+/* return the slot for a group-by value, whether in use or empty */
+static struct group_s *
+find_group(struct group_s *groups, size_t nslots, const char *value)
+{
+    size_t slot = rum_hash_bytes(RUM_HASH_INIT, value, strlen(value)) & (nslots - 1);
+
+    while (groups[slot].value && strcmp(groups[slot].value, value)) {
+        slot = (slot + 1) & (nslots - 1);
+    }
+    return &(groups[slot]);
 }
 
+/* count one more element with a group-by value, returning 0 on success or -1 if out of memory */
+static int
+add_to_group(struct aggregate_s *aggregate, const char *value)
+{
+    struct group_s *group, *groups;
+    size_t i, nslots;
+
+    /* keep the table no more than 3/4 full */
+    if ((aggregate->ngroups + 1) * 4 > aggregate->nslots * 3) {
+        nslots = aggregate->nslots? (aggregate->nslots * 2) : 64;
+        if ((groups = calloc(nslots, sizeof(struct group_s))) == NULL) {
+            return -1;
+        }
+        for (i = 0; i < aggregate->nslots; ++i) {
+            if (aggregate->groups[i].value) {
+                *find_group(groups, nslots, aggregate->groups[i].value) = aggregate->groups[i];
+            }
+        }
+        free(aggregate->groups);
+        aggregate->groups = groups;
+        aggregate->nslots = nslots;
+    }
+
+    group = find_group(aggregate->groups, aggregate->nslots, value);
+    if (group->value == NULL) {
+        if ((group->value = strdup(value)) == NULL) {
+            return -1;
+        }
+        ++(aggregate->ngroups);
+    }
+    ++(group->count);
+    return 0;
+}
+
+/* add a finished element to an aggregate, returning 0 on success or -1 (with a message printed) on error */
+static int
+aggregate_element(struct aggregate_s *aggregate, const rum_element_t *element)
+{
+    int handle = aggregate->handles[rum_tag_get_id(element->tag)];
+    const char *value;
+    char *end;
+    double number;
+
+    if (handle < 0) {
+        return 0;
+    }
+    if (aggregate->type == AGGREGATE_COUNT) {
+        ++(aggregate->count);
+        return 0;
+    }
+
+    /* elements without a value for the attribute are ignored */
+    if (((value = rum_element_get_value_by_handle(element, handle)) == NULL) || (*value == 0)) {
+        return 0;
+    }
+    if (aggregate->type == AGGREGATE_GROUP_BY) {
+        if (add_to_group(aggregate, value) < 0) {
+            fprintf(stderr, "*** ERROR: Unable to allocate memory for group\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    number = strtod(value, &end);
+    if (*end) {
+        fprintf(stderr, "*** ERROR: Value of %s@%s is not a number: %s\n", aggregate->tag_name, aggregate->attr_name, value);
+        return -1;
+    }
+    if ((aggregate->count == 0)
+        || (aggregate->type == AGGREGATE_SUM)
+        || ((aggregate->type == AGGREGATE_MIN) && (number < aggregate->result))
+        || ((aggregate->type == AGGREGATE_MAX) && (number > aggregate->result))) {
+        aggregate->result = (aggregate->type == AGGREGATE_SUM)? (aggregate->result + number) : number;
+    }
+    ++(aggregate->count);
+    return 0;
+}
+
+static int
+compare_groups(const void *a, const void *b)
+{
+    return strcmp(((const struct group_s *) a)->value, ((const struct group_s *) b)->value);
+}
+
+/* print an aggregate's result; group-by values are sorted, for stable output */
 static void
-display_shelf(const rum_element_t *shelf)
+print_aggregate(struct aggregate_s *aggregate)
 {
-    const char *id = rum_element_get_value(shelf, "id");
+    size_t i, n;
 
-    printf("   The");
-    if (id && *id) {
-        printf(" %s", id);
+    printf("%s %s", aggregate_names[aggregate->type], aggregate->tag_name);
+    if (aggregate->attr_name) {
+        printf("@%s", aggregate->attr_name);
     }
-    if (rum_element_get_first_child(shelf)) {
-        printf(" shelf contains:\n");
-    } else {
-        printf(" shelf is empty.\n");
+    switch (aggregate->type) {
+        case AGGREGATE_COUNT:
+            printf(" = %ld\n", aggregate->count);
+            break;
+        case AGGREGATE_GROUP_BY:
+            printf(":\n");
+            for (i = n = 0; i < aggregate->nslots; ++i) {
+                if (aggregate->groups[i].value) {
+                    aggregate->groups[n++] = aggregate->groups[i];
+                }
+            }
+            aggregate->nslots = n;
+            if (n) {
+                qsort(aggregate->groups, n, sizeof(struct group_s), compare_groups);
+            }
+            for (i = 0; i < n; ++i) {
+                printf("   %s = %ld\n", aggregate->groups[i].value, aggregate->groups[i].count);
+            }
+            break;
+        default:
+            if (aggregate->count || (aggregate->type == AGGREGATE_SUM)) {
+                printf(" = %.15g\n", aggregate->result);
+            } else {
+                printf(" has no values\n");
+            }
+            break;
     }
 }
 
 static void
-display_bottle(const rum_element_t *bottle)
+free_aggregates(struct aggregate_s *aggregates, int naggregates)
+{
+    size_t i;
+
+    while (naggregates-- > 0) {
+        for (i = 0; i < aggregates[naggregates].nslots; ++i) {
+            free(aggregates[naggregates].groups[i].value);
+        }
+        free(aggregates[naggregates].groups);
+        free(aggregates[naggregates].handles);
+    }
+}
+
+/* resolve an aggregate's tag and attribute against the language's tags, marking the aggregated tags in kept;
+ * returns 0 on success or -1 (with a message printed) on error
+ */
+static int
+resolve_aggregate(struct aggregate_s *aggregate, const rum_tag_t **tags, int ntags, unsigned char *kept)
+{
+    int id, found = 0;
+
+    if ((aggregate->handles = malloc(ntags * sizeof(int))) == NULL) {
+        fprintf(stderr, "*** ERROR: Unable to allocate memory for aggregate\n");
+        return -1;
+    }
+    for (id = 0; id < ntags; ++id) {
+        aggregate->handles[id] = -1;
+        if (strcmp(rum_tag_get_name(tags[id]), aggregate->tag_name) == 0) {
+            aggregate->handles[id] = aggregate->attr_name? rum_tag_attr_handle(tags[id], aggregate->attr_name) : 0;
+        }
+        if (aggregate->handles[id] >= 0) {
+            kept[id] = found = 1;
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "*** ERROR: %s%s%s not found in language\n", aggregate->tag_name,
+                (aggregate->attr_name? "@" : ""), (aggregate->attr_name? aggregate->attr_name : ""));
+        return -1;
+    }
+    return 0;
+}
+
+/* resolve all aggregates, and return a projection that keeps only the aggregated tags
+ * (and their ancestors and descendants), or NULL (with a message printed) on error
+ */
+static rum_projection_t *
+resolve_aggregates(const rum_tag_t *language, struct aggregate_s *aggregates, int naggregates)
+{
+    rum_projection_t *projection = NULL;
+    const rum_tag_t **tags;
+    unsigned char *kept;
+    int i, ntags, nkept = 0;
+
+    ntags = rum_language_get_ntags(language);
+    tags = malloc(ntags * sizeof(rum_tag_t *));
+    kept = calloc(ntags, 1);
+    if ((tags == NULL) || (kept == NULL)) {
+        fprintf(stderr, "*** ERROR: Unable to allocate memory for aggregates\n");
+        free(tags);
+        free(kept);
+        return NULL;
+    }
+    rum_language_get_tags(language, tags);
+
+    for (i = 0; i < naggregates; ++i) {
+        if (resolve_aggregate(&(aggregates[i]), tags, ntags, kept) < 0) {
+            break;
+        }
+    }
+    if (i == naggregates) {
+        /* gather the kept tags at the front of the tag list */
+        for (i = 0; i < ntags; ++i) {
+            if (kept[i]) {
+                tags[nkept++] = tags[i];
+            }
+        }
+        if ((projection = rum_projection_new(language, tags, nkept)) == NULL) {
+            fprintf(stderr, "*** ERROR: %s\n", rum_last_error());
+        }
+    }
+    free(tags);
+    free(kept);
+    return projection;
+}
+
+/* aggregates being computed during a parse */
+struct aggregating_s {
+    struct aggregate_s *aggregates;
+    int naggregates;
+    int rc;             /* 1 once an aggregate has failed (with a message printed) */
+};
+
+/* element-complete callback: add a finished element to the aggregates, then free it */
+static int
+aggregate_complete(rum_element_t *element, void *data)
 {
-    const char *bottle_type = rum_element_get_value(bottle, "type");
-    const char *aged = rum_element_get_value(bottle, "aged");
-    const char *vintage = rum_element_get_value(bottle, "vintage");
-    const char *maker = rum_element_get_content(bottle);
+    struct aggregating_s *aggregating = data;
+    int i;
 
-    printf("      A");
-    if (vintage && *vintage) {
-        printf(" %s", vintage);
+    for (i = 0; (aggregating->rc == 0) && (i < aggregating->naggregates); ++i) {
+        aggregating->rc = aggregate_element(&(aggregating->aggregates[i]), element)? 1 : 0;
     }
-    if (aged && *aged) {
-        printf(" %s-year-old", aged);
+    return RUM_ELEMENT_RELEASE;
+}
+
+/* compute aggregates over a file in one pass, freeing each element as soon as it is finished,
+ * so that memory use depends on the number of distinct groups rather than the size of the file
+ */
+static int
+aggregate_file(FILE *infile, const rum_tag_t *language, struct aggregate_s *aggregates, int naggregates)
+{
+    rum_projection_t *projection;
+    rum_parse_options_t options;
+    struct aggregating_s aggregating;
+    rum_element_t *root;
+    int i;
+
+    if ((projection = resolve_aggregates(language, aggregates, naggregates)) == NULL) {
+        return 1;
     }
-    printf(" bottle");
-    if ((maker && *maker) || (bottle_type && *bottle_type)) {
-        printf(" of");
+    aggregating.aggregates = aggregates;
+    aggregating.naggregates = naggregates;
+    aggregating.rc = 0;
+    memset(&options, 0, sizeof(options));
+    options.projection = projection;
+    options.on_complete = aggregate_complete;
+    options.complete_data = &aggregating;
+
+    /* the root is not handed to the callback, so it is aggregated once the parse is done */
+    root = rum_parse_file_with_options(infile, language, &options, 0);
+    if ((root == NULL) && (aggregating.rc == 0)) {
+        fprintf(stderr, "*** ERROR: %s\n", rum_last_error());
+        aggregating.rc = 1;
     }
-    if (maker && *maker) {
-        printf(" %s", maker);
+    if (root) {
+        aggregate_complete(root, &aggregating);
+        rum_element_free(root);
     }
-    if (bottle_type && *bottle_type) {
-        printf(" %s", bottle_type);
+    if (aggregating.rc == 0) {
+        for (i = 0; i < naggregates; ++i) {
+            print_aggregate(&(aggregates[i]));
+        }
     }
-    printf("\n");
+    rum_projection_free(projection);
+    return aggregating.rc;
 }
 
+/* print what a parse cost, as JSON on standard error */
 static void
-display_glass(const rum_element_t *glass)
+print_stats(const rum_parse_stats_t *stats)
 {
-    const char *glass_type = rum_element_get_value(glass, "type");
-    printf("      A %s\n", (glass_type && *glass_type)? glass_type : "glass");
+    fprintf(stderr, "{ \"bytes\": %lu, \"elements\": %lu, \"attributes\": %lu, \"max_depth\": %d, "
+            "\"entities\": %lu, \"bytes_allocated\": %lu, \"peak_allocated\": %lu, "
+            "\"buffer_growths\": %lu, \"seconds\": %.6f }\n",
+            (unsigned long) stats->bytes, stats->elements, stats->attributes, stats->max_depth,
+            stats->entities, (unsigned long) stats->bytes_allocated, (unsigned long) stats->peak_allocated,
+            stats->buffer_growths, stats->seconds);
 }
 
-static rum_tag_t *
-define_language()
+/* display each of a stream of back-to-back records */
+static int
+display_records(FILE *infile, const rum_tag_t *language)
 {
-    rum_tag_t *cabinet, *shelf, *bottle, *glass;
-    rum_attr_t shelf_attrs[] = { { "id", 0 } };
-    rum_attr_t bottle_attrs[] = { { "type", 1 }, { "aged", 0 }, { "vintage", 0 } };
-    rum_attr_t glass_attrs[] = { { "type", 1 } };
-    int shelf_nattrs = sizeof(shelf_attrs) / sizeof(rum_attr_t);
-    int bottle_nattrs = sizeof(bottle_attrs) / sizeof(rum_attr_t);
-    int glass_nattrs = sizeof(glass_attrs) / sizeof(rum_attr_t);
+    rum_stream_t *stream;
+    rum_element_t *record;
+    int rc = 0;
 
-    if (((cabinet = rum_tag_new(NULL, "cabinet", 0, 0, NULL, &display_cabinet)) == NULL)
-    || ((shelf = rum_tag_new(cabinet, "shelf", 0, shelf_nattrs, shelf_attrs, &display_shelf)) == NULL)
-    || ((bottle = rum_tag_new(shelf, "bottle", 0, bottle_nattrs, bottle_attrs, &display_bottle)) == NULL)
-    || ((glass = rum_tag_new(shelf, "glass", 1, glass_nattrs, glass_attrs, &display_glass)) == NULL)) {
+    if ((stream = rum_stream_new(infile, language, NULL)) == NULL) {
+        fprintf(stderr, "*** ERROR: %s\n", rum_last_error());
+        return 1;
+    }
+    while ((record = rum_stream_next(stream)) != NULL) {
+        printf("--- record %lu\n", rum_stream_get_nrecords(stream));
+        rum_element_display(record);
+    }
+    if (rum_last_error()) {
+        fprintf(stderr, "*** ERROR: %s\n", rum_last_error());
+        rc = 1;
+    }
+    rum_stream_free(stream);
+    return rc;
+}
+
+/* read all of a file stream into memory, returning the text (to be freed with free()) or NULL on error */
+static char *
+read_all(FILE *infile, size_t *sizep)
+{
+    char *text = NULL, *new_text;
+    size_t size = 0, nread;
+
+    do {
+        if ((new_text = realloc(text, size + READ_SIZE)) == NULL) {
+            free(text);
+            return NULL;
+        }
+        text = new_text;
+        size += (nread = fread(text + size, 1, READ_SIZE, infile));
+    } while (nread == READ_SIZE);
+    if (ferror(infile)) {
+        free(text);
         return NULL;
     }
-    return(cabinet);
+    *sizep = size;
+    return text;
+}
+
+/* display a document, reusing the snapshot kept in a cache directory if the same input was seen before */
+static int
+display_cached(FILE *infile, const rum_tag_t *language, const char *cache_dir)
+{
+    rum_parse_cache_t *cache;
+    rum_document_t *document;
+    char *text;
+    size_t size;
+
+    if ((text = read_all(infile, &size)) == NULL) {
+        fprintf(stderr, "*** ERROR: Unable to read input\n");
+        return 1;
+    }
+    if ((cache = rum_parse_cache_new(CACHE_BUDGET, cache_dir)) == NULL) {
+        fprintf(stderr, "*** ERROR: %s\n", rum_last_error());
+        free(text);
+        return 1;
+    }
+    document = rum_parse_cached(cache, text, size, language);
+    free(text);
+    if (document == NULL) {
+        fprintf(stderr, "*** ERROR: %s\n", rum_last_error());
+        rum_parse_cache_free(cache);
+        return 1;
+    }
+    rum_element_display(rum_document_get_root(document));
+    rum_document_free(document);
+    rum_parse_cache_free(cache);
+    return 0;
 }
 
 int
@@ -98,15 +533,138 @@ main(int argc, char **argv)
     rum_tag_t *language;
     rum_element_t *document;
     FILE *infile;
+    char *build_index_path = NULL, *index_path = NULL, *child = NULL, *cache_dir = NULL;
+    char *socket_path = NULL;
+    const char *tag_names[MAX_KEYS], *attr_names[MAX_KEYS];
+    char *tag_name, *attr_name, *find_tag_name = NULL, *find_attr_name = NULL, *find_value = NULL, *errmsg;
+    struct aggregate_s aggregates[MAX_AGGREGATES];
+    rum_parse_options_t parse_options;
+    rum_parse_stats_t stats;
+    rum_trace_t *trace = NULL;
+    int opt, nkeys = 0, naggregates = 0, records = 0, pipelined = 0, show_stats = 0, profile = 0, tracing = 0, rc = 0;
+    long nworkers = 0;
+    struct option options[] = {
+        { "build-index", required_argument, NULL, 'b' },
+        { "key",         required_argument, NULL, 'k' },
+        { "index",       required_argument, NULL, 'i' },
+        { "child",       required_argument, NULL, 'c' },
+        { "find",        required_argument, NULL, 'f' },
+        { "count",       required_argument, NULL, 'C' },
+        { "group-by",    required_argument, NULL, 'G' },
+        { "sum",         required_argument, NULL, 'S' },
+        { "min",         required_argument, NULL, 'm' },
+        { "max",         required_argument, NULL, 'M' },
+        { "records",     no_argument,       NULL, 'r' },
+        { "pipeline",    no_argument,       NULL, 'P' },
+        { "stats",       no_argument,       NULL, 's' },
+        { "profile",     no_argument,       NULL, 'p' },
+        { "trace",       no_argument,       NULL, 't' },
+        { "cache",       required_argument, NULL, 'd' },
+        { "serve",       required_argument, NULL, 'D' },
+        { "workers",     required_argument, NULL, 'w' },
+        { NULL, 0, NULL, 0 }
+    };
 
-    /* trivial command line parsing -- read from standard input or filename */
-    if (argc > 2) {
-        fprintf(stderr, "Usage: %s [<file>]\n", argv[0]);
+    memset(aggregates, 0, sizeof(aggregates));
+
+    /* command line parsing -- read from standard input or filename */
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+            case 'b':
+                build_index_path = optarg;
+                break;
+            case 'k':
+                if ((nkeys == MAX_KEYS) || (split_key(optarg, &tag_name, &attr_name, NULL) < 0)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                tag_names[nkeys] = tag_name;
+                attr_names[nkeys++] = attr_name;
+                break;
+            case 'i':
+                index_path = optarg;
+                break;
+            case 'c':
+                child = optarg;
+                break;
+            case 'f':
+                if (split_key(optarg, &find_tag_name, &find_attr_name, &find_value) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'C':
+            case 'G':
+            case 'S':
+            case 'm':
+            case 'M':
+                if (naggregates == MAX_AGGREGATES) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                aggregates[naggregates].type = (opt == 'C')? AGGREGATE_COUNT
+                                               : (opt == 'G')? AGGREGATE_GROUP_BY
+                                               : (opt == 'S')? AGGREGATE_SUM
+                                               : (opt == 'm')? AGGREGATE_MIN : AGGREGATE_MAX;
+                if (opt == 'C') {
+                    aggregates[naggregates].tag_name = optarg;
+                } else if (split_key(optarg, &(aggregates[naggregates].tag_name),
+                                     &(aggregates[naggregates].attr_name), NULL) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                ++naggregates;
+                break;
+            case 'r':
+                records = 1;
+                break;
+            case 'P':
+                pipelined = 1;
+                break;
+            case 's':
+                show_stats = 1;
+                break;
+            case 'p':
+                profile = 1;
+                break;
+            case 't':
+                tracing = 1;
+                break;
+            case 'd':
+                cache_dir = optarg;
+                break;
+            case 'D':
+                socket_path = optarg;
+                break;
+            case 'w':
+                if ((nworkers = atol(optarg)) <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if ((argc - optind > 1) || (build_index_path && index_path) || (nkeys && !build_index_path)
+        || ((build_index_path || index_path) && (argc - optind != 1))
+        || (index_path && !child == !find_value) || (!index_path && (child || find_value))
+        || (naggregates && (build_index_path || index_path))
+        || (records && (build_index_path || index_path || naggregates))
+        || ((show_stats || profile || tracing) && (build_index_path || index_path || naggregates || records))
+        || (cache_dir && (build_index_path || index_path || naggregates || records || show_stats || profile || tracing))
+        || (socket_path && ((argc - optind) || build_index_path || index_path || naggregates || records
+                            || show_stats || profile || tracing || cache_dir))
+        || (nworkers && !socket_path)
+        || (pipelined && (build_index_path || index_path || naggregates || records || show_stats || profile
+                          || tracing || cache_dir || socket_path))) {
+        usage(argv[0]);
         return 1;
     }
-    if (argc == 2) {
-        if ((infile = fopen(argv[1], "r")) == NULL) {
-            fprintf(stderr, "Could not open %s\n", argv[1]);
+    if (argc - optind == 1) {
+        if ((infile = fopen(argv[optind], "r")) == NULL) {
+            fprintf(stderr, "Could not open %s\n", argv[optind]);
             return 1;
         }
     } else {
@@ -121,22 +679,118 @@ main(int argc, char **argv)
         }
         return 1;
     }
-    if (DEBUG) {
-        rum_display_language(language);
+
+    /* serve documents until interrupted, with one worker per processor by default */
+    if (socket_path) {
+        if ((nworkers == 0) && ((nworkers = sysconf(_SC_NPROCESSORS_ONLN)) <= 0)) {
+            nworkers = 1;
+        }
+        return serve(socket_path, language, nworkers);
     }
 
-    /* parse file */
-    document = rum_parse_file(infile, language, 1);
-    if (rum_last_error()) {
+    /* random access using a sidecar index */
+    if (build_index_path || index_path) {
+        if (build_index_path) {
+            rc = build_index(infile, language, build_index_path, tag_names, attr_names, nkeys);
+        } else {
+            rc = display_indexed(infile, language, index_path, child, find_tag_name, find_attr_name, find_value);
+        }
+        if (rc < 0) {
+            fprintf(stderr, "*** ERROR: %s\n", rum_last_error());
+        }
+        fclose(infile);
+        return rc? 1 : 0;
+    }
+
+    /* one-pass aggregation without keeping the document */
+    if (naggregates) {
+        rc = aggregate_file(infile, language, aggregates, naggregates);
+        free_aggregates(aggregates, naggregates);
+        if (infile != stdin) {
+            fclose(infile);
+        }
+        return rc;
+    }
+
+    /* display each record of a stream */
+    if (records) {
+        rc = display_records(infile, language);
+        if (infile != stdin) {
+            fclose(infile);
+        }
+        return rc;
+    }
+
+    /* parse through a cache kept on disk */
+    if (cache_dir) {
+        rc = display_cached(infile, language, cache_dir);
+        if (infile != stdin) {
+            fclose(infile);
+        }
+        return rc;
+    }
+
+    /* display each child of the root in another thread as soon as it is parsed */
+    if (pipelined) {
+        rc = display_pipelined(infile, language);
+        if (infile != stdin) {
+            fclose(infile);
+        }
+        return rc;
+    }
+
+    /* profile the phases of parsing and display (in a profiling build) */
+    if (profile) {
+        if ((rc = rum_profile_start()) < 0) {
+            fprintf(stderr, "*** ERROR: %s\n", rum_last_error());
+            if (infile != stdin) {
+                fclose(infile);
+            }
+            return 1;
+        }
+        if (rc == 0) {
+            fprintf(stderr, "Hardware counters are unavailable, so only times will be reported\n");
+        }
+    }
+
+    /* parse file (the input size is needed for profiling too) */
+    memset(&parse_options, 0, sizeof(parse_options));
+    if (show_stats || profile) {
+        parse_options.stats = &stats;
+    }
+    if (tracing && ((parse_options.trace = trace = rum_trace_new()) == NULL)) {
         fprintf(stderr, "*** ERROR: %s\n", rum_last_error());
         if (infile != stdin) {
             fclose(infile);
         }
         return 1;
     }
+    document = rum_parse_file_with_options(infile, language, &parse_options, 1);
+
+    /* save error message because freeing the trace will wipe it */
+    errmsg = rum_last_error();
+    rum_trace_free(trace);
+    if (show_stats) {
+        print_stats(&stats);
+    }
+    if (errmsg) {
+        fprintf(stderr, "*** ERROR: %s\n", errmsg);
+        if (infile != stdin) {
+            fclose(infile);
+        }
+        return 1;
+    }
 
     /* display the document in all its exalted glory */
+    RUM_PROFILE_ENTER(RUM_PHASE_DISPLAY);
     rum_element_display(document);
+    RUM_PROFILE_LEAVE(RUM_PHASE_DISPLAY);
+
+    if (profile) {
+        fflush(stdout);
+        rum_profile_stop();
+        rum_profile_report(stderr, stats.bytes);
+    }
 
     /* wrap it up */
     if (infile != stdin) {
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <rum_buffer.h>
+#include <rum_profile.h>
 #include "rum_private.h"
 
 rum_buffer_t *
@@ -18,19 +19,24 @@ rum_buffer_new()
     rum_buffer_t *buffer;
 
     rum_set_error(NULL);
-    if ((buffer = malloc(sizeof(rum_buffer_t))) == NULL) {
+    if ((buffer = rum_malloc(sizeof(rum_buffer_t))) == NULL) {
         rum_set_error("Unable to allocate memory for buffer");
         return NULL;
     }
-    if ((buffer->buf = malloc(CHUNKSIZE)) == NULL) {
+    if ((buffer->buf = rum_malloc(CHUNKSIZE)) == NULL) {
         rum_set_error("Unable to allocate memory for buffer");
-        free(buffer);
+        rum_free(buffer, sizeof(rum_buffer_t));
         return NULL;
     }
-    buffer->nchunks = 1;
+    buffer->size = CHUNKSIZE;
     buffer->pos = 0;
     buffer->substr_start = 0;
     buffer->substr_end = 0;
+    buffer->base = 0;
+    buffer->scratch = NULL;
+    buffer->scratch_size = 0;
+    buffer->ngrowths = 0;
+    memset(&(buffer->decoder), 0, sizeof(buffer->decoder));
     return buffer;
 }
 
@@ -40,9 +46,10 @@ rum_buffer_free(rum_buffer_t *buffer)
     rum_set_error(NULL);
     if (buffer) {
         if (buffer->buf) {
-            free(buffer->buf);
+            rum_free(buffer->buf, buffer->size);
         }
-        free(buffer);
+        rum_free(buffer->scratch, buffer->scratch_size);
+        rum_free(buffer, sizeof(rum_buffer_t));
     }
 }
 
@@ -101,7 +108,7 @@ rum_buffer_clone_substr(rum_buffer_t *buffer)
     } else {
         len = buffer->substr_end - buffer->substr_start + 1;
     }
-    if ((str = malloc(len + 1)) == NULL) {
+    if ((str = rum_malloc(len + 1)) == NULL) {
         rum_set_error("Programmer error: Unable to clone nonexistent buffer");
         return NULL;
     }
@@ -112,8 +119,42 @@ rum_buffer_clone_substr(rum_buffer_t *buffer)
     return(str);
 }
 
-int
-rum_buffer_add_char(rum_buffer_t *buffer, int c)
+const char *
+rum_buffer_get_substr(rum_buffer_t *buffer)
+{
+    char *scratch;
+    size_t len, size;
+
+    rum_set_error(NULL);
+    if ((buffer == NULL) || (buffer->buf == NULL)) {
+        rum_set_error("Programmer error: Unable to copy from nonexistent buffer");
+        return NULL;
+    }
+
+    /* special case: start and stop = 0 means empty string */
+    if ((buffer->substr_start == 0) && (buffer->substr_end == 0)) {
+        len = 0;
+    } else {
+        len = buffer->substr_end - buffer->substr_start + 1;
+    }
+    if (len + 1 > buffer->scratch_size) {
+        for (size = buffer->scratch_size? buffer->scratch_size : 64; len + 1 > size; size *= 2);
+        if ((scratch = rum_realloc(buffer->scratch, buffer->scratch_size, size)) == NULL) {
+            rum_set_error("Unable to allocate memory for buffer");
+            return NULL;
+        }
+        buffer->scratch = scratch;
+        buffer->scratch_size = size;
+    }
+    if (len) {
+        memcpy(buffer->scratch, buffer->buf + buffer->substr_start, len);
+    }
+    buffer->scratch[len] = 0;
+    return buffer->scratch;
+}
+
+static int
+add_char(rum_buffer_t *buffer, int c)
 {
     char *newbuf;
 
@@ -126,14 +167,113 @@ rum_buffer_add_char(rum_buffer_t *buffer, int c)
     buffer->buf[(buffer->pos)++] = c;
 
     /* grow the buffer if needed (leaving room for a null byte) */
-    if (buffer->pos == ((buffer->nchunks * CHUNKSIZE) - 1)) {
-        ++(buffer->nchunks);
-        if ((newbuf = realloc(buffer->buf, buffer->nchunks * CHUNKSIZE)) == NULL) {
+    if (buffer->pos == buffer->size - 1) {
+        if ((newbuf = rum_realloc(buffer->buf, buffer->size, buffer->size + CHUNKSIZE)) == NULL) {
             rum_set_error("Unable to allocate memory to extend buffer");
             return -1;
         }
+        buffer->size += CHUNKSIZE;
+        ++(buffer->ngrowths);
+        buffer->buf = newbuf;
+    }
+    return 0;
+}
+
+/* add the bytes of a character beyond ASCII */
+static int
+add_multibyte_char(rum_buffer_t *buffer, int c)
+{
+    char bytes[4];
+    size_t first = buffer->pos;
+    int i, len;
+
+    len = rum_utf8_encode(c, bytes);
+    for (i = 0; i < len; ++i) {
+        if (add_char(buffer, (unsigned char) bytes[i]) < 0) {
+            return -1;
+        }
+    }
+    if (buffer->substr_start && (buffer->substr_end == first)) {
+        buffer->substr_end = buffer->pos - 1;
+    }
+    return 0;
+}
+
+int
+rum_buffer_add_char(rum_buffer_t *buffer, int c)
+{
+    int rc;
+
+    RUM_PROFILE_ENTER(RUM_PHASE_BUFFER);
+    rc = ((c < 0x80) || (buffer == NULL))? add_char(buffer, c) : add_multibyte_char(buffer, c);
+    RUM_PROFILE_LEAVE(RUM_PHASE_BUFFER);
+    return rc;
+}
+
+void
+rum_buffer_compact(rum_buffer_t *buffer)
+{
+    size_t shift;
+
+    rum_set_error(NULL);
+    if ((buffer == NULL) || (buffer->buf == NULL)) {
+        return;
+    }
+
+    /* keep one character before anything retained, because a substring start of 0 means none */
+    shift = buffer->substr_start? buffer->substr_start : buffer->pos;
+    if (shift <= 1) {
+        return;
+    }
+    --shift;
+    memmove(buffer->buf, buffer->buf + shift, buffer->pos - shift);
+    buffer->pos -= shift;
+    buffer->base += shift;
+    if (buffer->substr_start) {
+        buffer->substr_start -= shift;
+        buffer->substr_end -= shift;
+    }
+}
+
+void
+rum_buffer_reset(rum_buffer_t *buffer)
+{
+    rum_set_error(NULL);
+    if (buffer) {
+        buffer->pos = 0;
+        buffer->substr_start = 0;
+        buffer->substr_end = 0;
+        buffer->base = 0;
+        buffer->ngrowths = 0;
+        memset(&(buffer->decoder), 0, sizeof(buffer->decoder));
+    }
+}
+
+int
+rum_buffer_shrink(rum_buffer_t *buffer)
+{
+    char *newbuf;
+    size_t size;
+
+    rum_set_error(NULL);
+    if ((buffer == NULL) || (buffer->buf == NULL)) {
+        rum_set_error("Programmer error: Unable to shrink nonexistent buffer");
+        return -1;
+    }
+    rum_buffer_compact(buffer);
+
+    /* leave room for the next character and a null byte */
+    if ((size = buffer->pos + 2) < buffer->size) {
+        if ((newbuf = rum_realloc(buffer->buf, buffer->size, size)) == NULL) {
+            rum_set_error("Unable to allocate memory to shrink buffer");
+            return -1;
+        }
         buffer->buf = newbuf;
+        buffer->size = size;
     }
+    rum_free(buffer->scratch, buffer->scratch_size);
+    buffer->scratch = NULL;
+    buffer->scratch_size = 0;
     return 0;
 }
 
@@ -11,19 +11,41 @@
 
 #include <stddef.h>
 #include <rum_types.h>
+#include <rum_utf8.h>
 
-/* buffers will be allocated in chunks of this many bytes */
+/* buffers will be grown in chunks of this many bytes */
 #define CHUNKSIZE (1024)
 
 /* dynamically sized character buffer, with a current position and a current substring */
 struct rum_buffer_s {
     char *buf;
-    int nchunks;
+    size_t size;
     size_t pos;
     size_t substr_start;
     size_t substr_end;
+
+    /* offset within the whole input of buf[0] (input discarded by compaction is counted here) */
+    size_t base;
+
+    /* space for a null-terminated copy of the current substring (see rum_buffer_get_substr()),
+     * kept between uses so that it rarely needs to grow
+     */
+    char *scratch;
+    size_t scratch_size;
+
+    /* number of times buf has been grown */
+    unsigned long ngrowths;
+
+    /* the character whose bytes are being parsed (see rum_parser_parse_byte()) */
+    rum_utf8_decoder_t decoder;
 };
 
+/* offset within the whole input of the next character to be added to a buffer */
+#define RUM_BUFFER_OFFSET(buffer) ((buffer)->base + (buffer)->pos)
+
+/* true if the input so far ends partway through a character */
+#define RUM_BUFFER_IN_CHAR(buffer) ((buffer)->decoder.need != 0)
+
 /* constructor */
 rum_buffer_t *rum_buffer_new();
 
@@ -39,12 +61,41 @@ void rum_buffer_reset_substr(rum_buffer_t *buffer);
 /* strncmp against a substring of a buffer */
 int rum_buffer_substrncmp(rum_buffer_t *buffer, const char *str, size_t n);
 
-/* return a newly allocated buffer with a copy of the current substring */
+/* return a newly allocated buffer with a copy of the current substring
+ * (allocated with the library's allocator, with size strlen() + 1)
+ */
 char *rum_buffer_clone_substr(rum_buffer_t * buffer);
 
-/* add character to input buffer */
+/* return a null-terminated copy of the current substring, in scratch space owned by the buffer
+ * that is reused by the next call (so nothing is allocated once the space is big enough)
+ */
+const char *rum_buffer_get_substr(rum_buffer_t *buffer);
+
+/* add character (a code point, stored as UTF-8) to input buffer; if the current substring
+ * was just extended to the character, it is extended to all of its bytes
+ */
 int rum_buffer_add_char(rum_buffer_t *buffer, int c);
 
+/* discard input that is no longer needed (everything before the current substring, or
+ * before the last character if there is no substring), to bound memory when parsing large input
+ *
+ * positions within the buffer change, and only the retained input is printed afterward
+ */
+void rum_buffer_compact(rum_buffer_t *buffer);
+
+/* empty a buffer for new input, keeping its memory, so that parsing one document after another
+ * with the same buffer allocates nothing once it is big enough for the largest
+ */
+void rum_buffer_reset(rum_buffer_t *buffer);
+
+/* release the memory a buffer holds beyond what it needs to continue: the input is compacted
+ * (see rum_buffer_compact()) and shrunk to fit, and the scratch space is freed, so a buffer kept
+ * while waiting for more input takes little more than its token in progress
+ *
+ * the buffer grows again when more input is added
+ */
+int rum_buffer_shrink(rum_buffer_t *buffer);
+
 /* print raw input parsed so far */
 void rum_buffer_print(rum_buffer_t *buffer, FILE *fp);
 
@@ -0,0 +1,327 @@
+/*
+    rum_cache.c
+
+    parse cache functions for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <rump.h>
+#include "rum_private.h"
+
+/* initial number of hash table buckets (a power of 2) */
+#define INITIAL_BUCKETS (64)
+
+/* longest snapshot file name within the directory: two 16-digit hex numbers, a dash and ".snap",
+ * plus room for a temporary suffix while saving
+ */
+#define SNAPSHOT_NAME_SIZE (64)
+
+/* hash text a word at a time (FNV-1a a byte at a time would be several times slower on large input) */
+static uint64_t
+hash_text(uint64_t hash, const char *text, size_t size)
+{
+    uint64_t word;
+
+    for (; size >= sizeof(word); text += sizeof(word), size -= sizeof(word)) {
+        memcpy(&word, text, sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+    for (; size; ++text, --size) {
+        hash = (hash ^ (unsigned char) *text) * 1099511628211ULL;
+    }
+    return hash ^ (hash >> 32);
+}
+
+rum_parse_cache_t *
+rum_parse_cache_new(size_t budget, const char *dir)
+{
+    rum_parse_cache_t *cache;
+
+    rum_set_error(NULL);
+    if ((cache = rum_malloc(sizeof(rum_parse_cache_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for parse cache");
+        return NULL;
+    }
+    memset(cache, 0, sizeof(rum_parse_cache_t));
+    cache->budget = budget;
+    cache->nbuckets = INITIAL_BUCKETS;
+    if ((cache->buckets = rum_malloc(cache->nbuckets * sizeof(*(cache->buckets)))) == NULL) {
+        rum_free(cache, sizeof(rum_parse_cache_t));
+        rum_set_error("Unable to allocate memory for parse cache");
+        return NULL;
+    }
+    memset(cache->buckets, 0, cache->nbuckets * sizeof(*(cache->buckets)));
+    if (dir && ((cache->dir = rum_malloc(strlen(dir) + 1)) == NULL)) {
+        rum_parse_cache_free(cache);
+        rum_set_error("Unable to allocate memory for parse cache");
+        return NULL;
+    }
+    if (dir) {
+        strcpy(cache->dir, dir);
+    }
+    return cache;
+}
+
+/* remove an entry from the cache and free it, letting go of its document */
+static void
+remove_entry(rum_parse_cache_t *cache, struct rum_parse_cache_entry_s *entry)
+{
+    struct rum_parse_cache_entry_s **link = &(cache->buckets[entry->key & (cache->nbuckets - 1)]);
+
+    while (*link != entry) {
+        link = &((*link)->chain);
+    }
+    *link = entry->chain;
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->first = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->last = entry->prev;
+    }
+    --(cache->nentries);
+    cache->used -= entry->cost;
+    rum_document_free(entry->document);
+    rum_free(entry, sizeof(struct rum_parse_cache_entry_s));
+}
+
+void
+rum_parse_cache_free(rum_parse_cache_t *cache)
+{
+    rum_set_error(NULL);
+    if (cache) {
+        while (cache->first) {
+            remove_entry(cache, cache->first);
+        }
+        rum_free(cache->buckets, cache->nbuckets * sizeof(*(cache->buckets)));
+        if (cache->dir) {
+            rum_free(cache->dir, strlen(cache->dir) + 1);
+        }
+        rum_free(cache, sizeof(rum_parse_cache_t));
+    }
+}
+
+/* make an entry the most recently used */
+static void
+touch_entry(rum_parse_cache_t *cache, struct rum_parse_cache_entry_s *entry)
+{
+    if (entry == cache->first) {
+        return;
+    }
+    entry->prev->next = entry->next;
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->last = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = cache->first;
+    cache->first->prev = entry;
+    cache->first = entry;
+}
+
+/* return the cached entry for text with the given key, or NULL if there is none */
+static struct rum_parse_cache_entry_s *
+find_entry(const rum_parse_cache_t *cache, uint64_t key, const char *text, size_t size)
+{
+    struct rum_parse_cache_entry_s *entry;
+    const rum_document_t *document;
+
+    for (entry = cache->buckets[key & (cache->nbuckets - 1)]; entry; entry = entry->chain) {
+        document = entry->document;
+        if ((entry->key == key) && (entry->size == size)
+            && ((document->source == NULL) || (memcmp(document->source, text, size) == 0))) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* double the number of hash table buckets (if memory allows; the table works either way) */
+static void
+grow_buckets(rum_parse_cache_t *cache)
+{
+    struct rum_parse_cache_entry_s **buckets, *entry, *chain;
+    size_t nbuckets = cache->nbuckets * 2, i;
+
+    if ((buckets = rum_malloc(nbuckets * sizeof(*buckets))) == NULL) {
+        return;
+    }
+    memset(buckets, 0, nbuckets * sizeof(*buckets));
+    for (i = 0; i < cache->nbuckets; ++i) {
+        for (entry = cache->buckets[i]; entry; entry = chain) {
+            chain = entry->chain;
+            entry->chain = buckets[entry->key & (nbuckets - 1)];
+            buckets[entry->key & (nbuckets - 1)] = entry;
+        }
+    }
+    rum_free(cache->buckets, cache->nbuckets * sizeof(*(cache->buckets)));
+    cache->buckets = buckets;
+    cache->nbuckets = nbuckets;
+}
+
+/* add a document to the cache as the most recently used, evicting others to stay within the budget;
+ * return 0 on success or -1 if the document could not be added (in which case it is not shared)
+ */
+static int
+add_entry(rum_parse_cache_t *cache, uint64_t key, size_t size, rum_document_t *document, size_t cost)
+{
+    struct rum_parse_cache_entry_s *entry, **bucket;
+
+    if (cost > cache->budget) {
+        return -1;
+    }
+    while (cache->used + cost > cache->budget) {
+        remove_entry(cache, cache->last);
+        ++(cache->evictions);
+    }
+    if ((entry = rum_malloc(sizeof(struct rum_parse_cache_entry_s))) == NULL) {
+        return -1;
+    }
+    if (cache->nentries >= cache->nbuckets) {
+        grow_buckets(cache);
+    }
+    entry->key = key;
+    entry->size = size;
+    entry->document = rum_document_ref(document);
+    entry->cost = cost;
+    rum_document_share(document);
+
+    bucket = &(cache->buckets[key & (cache->nbuckets - 1)]);
+    entry->chain = *bucket;
+    *bucket = entry;
+    entry->prev = NULL;
+    entry->next = cache->first;
+    if (cache->first) {
+        cache->first->prev = entry;
+    } else {
+        cache->last = entry;
+    }
+    cache->first = entry;
+    ++(cache->nentries);
+    cache->used += cost;
+    return 0;
+}
+
+/* store the path of the snapshot for a key and size in path (of at least strlen(dir) + SNAPSHOT_NAME_SIZE bytes) */
+static void
+snapshot_path(const rum_parse_cache_t *cache, uint64_t key, size_t size, char *path)
+{
+    sprintf(path, "%s/%016llx-%llx.snap", cache->dir, (unsigned long long) key, (unsigned long long) size);
+}
+
+/* load a document from the on-disk tier, returning NULL if it is not there (or cannot be loaded),
+ * and storing the bytes it allocated (and mapped) in costp
+ */
+static rum_document_t *
+load_snapshot(const rum_parse_cache_t *cache, uint64_t key, size_t size, const rum_tag_t *language, size_t *costp)
+{
+    size_t path_size = strlen(cache->dir) + SNAPSHOT_NAME_SIZE, before = rum_allocated_bytes();
+    rum_document_t *document = NULL;
+    char *path;
+
+    if ((path = rum_malloc(path_size)) == NULL) {
+        return NULL;
+    }
+    snapshot_path(cache, key, size, path);
+    if (access(path, R_OK) == 0) {
+        document = rum_document_load(path, language);
+    }
+    rum_free(path, path_size);
+    if (document) {
+        *costp = rum_allocated_bytes() - before + document->map_size;
+    }
+    return document;
+}
+
+/* save a document to the on-disk tier, ignoring failure (the cache only loses an entry)
+ *
+ * the snapshot is written under a temporary name and then renamed, so that other processes
+ * sharing the directory never see a partly written one
+ */
+static void
+save_snapshot(const rum_parse_cache_t *cache, uint64_t key, size_t size, const rum_document_t *document,
+    const rum_tag_t *language)
+{
+    size_t path_size = strlen(cache->dir) + SNAPSHOT_NAME_SIZE;
+    char *path, *temp_path;
+
+    if ((path = rum_malloc(2 * path_size)) == NULL) {
+        return;
+    }
+    temp_path = path + path_size;
+    snapshot_path(cache, key, size, path);
+    snapshot_path(cache, key, size, temp_path);
+    sprintf(temp_path + strlen(temp_path), ".%ld", (long) getpid());
+    if (rum_document_save(document, language, temp_path) == 0) {
+        if (rename(temp_path, path) < 0) {
+            unlink(temp_path);
+        }
+    } else {
+        unlink(temp_path);
+    }
+    rum_free(path, 2 * path_size);
+}
+
+rum_document_t *
+rum_parse_cached(rum_parse_cache_t *cache, const char *text, size_t size, const rum_tag_t *language)
+{
+    struct rum_parse_cache_entry_s *entry;
+    rum_document_t *document;
+    size_t before, cost;
+    uint64_t key;
+
+    rum_set_error(NULL);
+    if (cache == NULL) {
+        return rum_document_parse(text, size, language);
+    }
+    if ((text == NULL) || (language == NULL)) {
+        rum_set_error("Programmer error: Unable to parse nonexistent text");
+        return NULL;
+    }
+
+    /* the fingerprint walks the whole language, so remember it for the language last used */
+    if (language != cache->language) {
+        cache->fingerprint = rum_language_fingerprint(language);
+        cache->language = language;
+    }
+    key = hash_text(cache->fingerprint, text, size);
+
+    /* look in memory */
+    if ((entry = find_entry(cache, key, text, size)) != NULL) {
+        ++(cache->hits);
+        touch_entry(cache, entry);
+        return rum_document_ref(entry->document);
+    }
+
+    /* look on disk */
+    if (cache->dir && ((document = load_snapshot(cache, key, size, language, &cost)) != NULL)) {
+        ++(cache->disk_hits);
+        add_entry(cache, key, size, document, cost);
+        rum_set_error(NULL);
+        return document;
+    }
+
+    /* parse it */
+    ++(cache->misses);
+    before = rum_allocated_bytes();
+    if ((document = rum_document_parse(text, size, language)) == NULL) {
+        return NULL;
+    }
+    cost = rum_allocated_bytes() - before;
+    if (cache->dir) {
+        save_snapshot(cache, key, size, document, language);
+    }
+    add_entry(cache, key, size, document, cost);
+    rum_set_error(NULL);
+    return document;
+}
@@ -0,0 +1,98 @@
+/*
+    rum_cache.h
+
+    declarations for caching parsed documents in RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_CACHE__H
+#define RUM_CACHE__H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <rum_types.h>
+
+/*
+ * A parse cache remembers documents parsed from text, keyed by a hash of the text and of the
+ * language's fingerprint, so that parsing byte-identical text again returns the same document
+ * rather than a new one. Cached documents are shared (see rum_document_share()): each caller
+ * gets its own reference, which it lets go of with rum_document_free(), and none may change it.
+ *
+ * The cache keeps documents in memory up to a budget of bytes (counting everything a document
+ * allocated, including its copy of the text), evicting the least recently used beyond that.
+ * Evicted documents live on as long as someone still holds them. Optionally, each parsed
+ * document is also saved as a snapshot (see rum_snapshot.h) in a directory, and looked for there
+ * when it is not in memory, so the cache can outlive the process and be shared with others.
+ *
+ * A document found in memory is only returned if its text matches exactly; one found on disk is
+ * trusted on the strength of its key (a 64-bit hash, plus the size of the text).
+ *
+ * A cache takes no lock, so it must be used by one thread at a time. The documents it returns
+ * may be handed to other threads, which can let go of them at any time, since documents count
+ * their holders atomically, and can read them at the same time: the calls that cache what they
+ * compute in a document (rum_document_index() and rum_element_get_hash()) publish it atomically.
+ */
+
+/* one cached document */
+struct rum_parse_cache_entry_s {
+    uint64_t key;
+    size_t size;                /* size of the text */
+    rum_document_t *document;
+    size_t cost;                /* bytes counted against the budget */
+
+    /* place in the list of entries, from most to least recently used */
+    struct rum_parse_cache_entry_s *prev;
+    struct rum_parse_cache_entry_s *next;
+
+    /* next entry in the same hash table bucket */
+    struct rum_parse_cache_entry_s *chain;
+};
+
+struct rum_parse_cache_s {
+    /* most bytes of documents to keep in memory, and bytes kept now */
+    size_t budget;
+    size_t used;
+
+    /* directory for snapshots, or NULL if there is no on-disk tier */
+    char *dir;
+
+    /* hash table of entries (nbuckets is a power of 2) */
+    struct rum_parse_cache_entry_s **buckets;
+    size_t nbuckets;
+    size_t nentries;
+
+    /* most and least recently used entries */
+    struct rum_parse_cache_entry_s *first;
+    struct rum_parse_cache_entry_s *last;
+
+    /* language whose fingerprint was computed most recently, and that fingerprint */
+    const rum_tag_t *language;
+    uint64_t fingerprint;
+
+    /* counts of lookups found in memory, found on disk and not found, and of evictions */
+    unsigned long hits;
+    unsigned long disk_hits;
+    unsigned long misses;
+    unsigned long evictions;
+};
+
+/* constructor: keep up to budget bytes of documents in memory, and if dir is not NULL, keep
+ * snapshots of them in that (existing) directory
+ */
+rum_parse_cache_t *rum_parse_cache_new(size_t budget, const char *dir);
+
+/* destructor (documents still held by callers remain valid) */
+void rum_parse_cache_free(rum_parse_cache_t *cache);
+
+/* return a document parsed from size bytes of text according to a language, as with
+ * rum_document_parse(), reusing a cached document if the same text was parsed before
+ * (cache may be NULL, to parse without caching)
+ *
+ * the caller must let go of the document with rum_document_free(); it is shared and read-only,
+ * unless it was too large for the budget (in which case it was not cached, and is the caller's own)
+ */
+rum_document_t *rum_parse_cached(rum_parse_cache_t *cache, const char *text, size_t size,
+        const rum_tag_t *language);
+
+#endif /* RUM_CACHE__H */
@@ -0,0 +1,278 @@
+/*
+    rum_diff.c
+
+    structural comparison of documents for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <rump.h>
+#include "rum_private.h"
+
+/* what a comparison reports to, and how much it has reported */
+struct diff_state_s {
+    rum_diff_callback_t callback;
+    void *data;
+    long ndiffs;
+};
+
+/* number of children still to be aligned that have a given subtree hash */
+struct hash_count_s {
+    uint64_t hash;  /* 0 if this slot is empty (subtree hashes are never 0) */
+    size_t count;
+};
+
+/* multiset of subtree hashes, in an open-addressed hash table */
+struct hash_counts_s {
+    struct hash_count_s *slots;
+    size_t nslots;
+};
+
+static void
+report(struct diff_state_s *state, rum_diff_type_t type, const rum_element_t *old_element,
+    const rum_element_t *new_element, int handle)
+{
+    rum_diff_t diff;
+
+    diff.type = type;
+    diff.old_element = old_element;
+    diff.new_element = new_element;
+    diff.handle = handle;
+    if (state->callback) {
+        state->callback(&diff, state->data);
+    }
+    ++(state->ndiffs);
+}
+
+/* return the slot for a hash, whether in use or empty */
+static struct hash_count_s *
+find_count(const struct hash_counts_s *counts, uint64_t hash)
+{
+    size_t slot = hash & (counts->nslots - 1);
+
+    while (counts->slots[slot].hash && (counts->slots[slot].hash != hash)) {
+        slot = (slot + 1) & (counts->nslots - 1);
+    }
+    return &(counts->slots[slot]);
+}
+
+/* count the subtree hashes of n elements, returning 0 on success or -1 on error */
+static int
+count_hashes(struct hash_counts_s *counts, const rum_element_t **elements, size_t n)
+{
+    struct hash_count_s *slot;
+    size_t i;
+
+    for (counts->nslots = 16; counts->nslots < 2 * n; counts->nslots *= 2);
+    if ((counts->slots = rum_malloc(counts->nslots * sizeof(struct hash_count_s))) == NULL) {
+        rum_set_error("Unable to allocate memory for document comparison");
+        return -1;
+    }
+    memset(counts->slots, 0, counts->nslots * sizeof(struct hash_count_s));
+    for (i = 0; i < n; ++i) {
+        slot = find_count(counts, rum_element_get_hash(elements[i]));
+        slot->hash = rum_element_get_hash(elements[i]);
+        ++(slot->count);
+    }
+    return 0;
+}
+
+/* return the number of remaining elements with a hash */
+static size_t
+get_count(const struct hash_counts_s *counts, uint64_t hash)
+{
+    return find_count(counts, hash)->count;
+}
+
+/* note that an element with a hash has been aligned */
+static void
+uncount(struct hash_counts_s *counts, uint64_t hash)
+{
+    struct hash_count_s *slot = find_count(counts, hash);
+
+    if (slot->count) {
+        --(slot->count);
+    }
+}
+
+/* return a newly allocated array of an element's children (storing their number in np) */
+static const rum_element_t **
+get_children(const rum_element_t *element, size_t *np)
+{
+    const rum_element_t **children, *child;
+    size_t n = 0;
+
+    for (child = element->first_child; child; child = child->next_sibling) {
+        ++n;
+    }
+    *np = n;
+    if ((children = rum_malloc((n? n : 1) * sizeof(rum_element_t *))) == NULL) {
+        rum_set_error("Unable to allocate memory for document comparison");
+        return NULL;
+    }
+    for (n = 0, child = element->first_child; child; child = child->next_sibling) {
+        children[n++] = child;
+    }
+    return children;
+}
+
+static int diff_elements(struct diff_state_s *state, const rum_element_t *old_element,
+        const rum_element_t *new_element);
+
+/* align the children between old_children[start..old_end) and new_children[start..new_end),
+ * where neither the first nor the last of each side match, returning 0 on success or -1 on error
+ */
+static int
+diff_middle(struct diff_state_s *state, const rum_element_t **old_children, size_t old_end,
+    const rum_element_t **new_children, size_t new_end, size_t start)
+{
+    struct hash_counts_s old_counts, new_counts;
+    size_t i = start, j = start;
+    uint64_t old_hash, new_hash;
+    int old_ahead, new_ahead, rc = 0;
+
+    /* hashes of the children not yet aligned on each side */
+    old_counts.slots = new_counts.slots = NULL;
+    if ((count_hashes(&old_counts, old_children + start, old_end - start) < 0)
+        || (count_hashes(&new_counts, new_children + start, new_end - start) < 0)) {
+        rum_free(old_counts.slots, old_counts.nslots * sizeof(struct hash_count_s));
+        return -1;
+    }
+
+    while ((rc == 0) && (i < old_end) && (j < new_end)) {
+        old_hash = rum_element_get_hash(old_children[i]);
+        new_hash = rum_element_get_hash(new_children[j]);
+        old_ahead = (get_count(&new_counts, old_hash) > 0);
+        new_ahead = (get_count(&old_counts, new_hash) > 0);
+
+        /* a child that matches one further along on the other side is kept,
+         * and whatever comes before that match on the other side was inserted or deleted
+         */
+        if (old_hash == new_hash) {
+            uncount(&old_counts, old_hash);
+            uncount(&new_counts, new_hash);
+            ++i;
+            ++j;
+        } else if (old_ahead && !new_ahead) {
+            report(state, RUM_DIFF_INSERT, NULL, new_children[j], -1);
+            uncount(&new_counts, new_hash);
+            ++j;
+        } else if (new_ahead && !old_ahead) {
+            report(state, RUM_DIFF_DELETE, old_children[i], NULL, -1);
+            uncount(&old_counts, old_hash);
+            ++i;
+
+        /* otherwise, the two children are paired up if they can be */
+        } else {
+            if (old_children[i]->tag == new_children[j]->tag) {
+                rc = diff_elements(state, old_children[i], new_children[j]);
+            } else {
+                report(state, RUM_DIFF_DELETE, old_children[i], NULL, -1);
+                report(state, RUM_DIFF_INSERT, NULL, new_children[j], -1);
+            }
+            uncount(&old_counts, old_hash);
+            uncount(&new_counts, new_hash);
+            ++i;
+            ++j;
+        }
+    }
+    for (; (rc == 0) && (i < old_end); ++i) {
+        report(state, RUM_DIFF_DELETE, old_children[i], NULL, -1);
+    }
+    for (; (rc == 0) && (j < new_end); ++j) {
+        report(state, RUM_DIFF_INSERT, NULL, new_children[j], -1);
+    }
+
+    rum_free(old_counts.slots, old_counts.nslots * sizeof(struct hash_count_s));
+    rum_free(new_counts.slots, new_counts.nslots * sizeof(struct hash_count_s));
+    return rc;
+}
+
+/* compare the children of two elements, returning 0 on success or -1 on error */
+static int
+diff_children(struct diff_state_s *state, const rum_element_t *old_element, const rum_element_t *new_element)
+{
+    const rum_element_t **old_children, **new_children;
+    size_t old_n, new_n, prefix = 0, suffix = 0;
+    int rc;
+
+    if ((old_children = get_children(old_element, &old_n)) == NULL) {
+        return -1;
+    }
+    if ((new_children = get_children(new_element, &new_n)) == NULL) {
+        rum_free(old_children, (old_n? old_n : 1) * sizeof(rum_element_t *));
+        return -1;
+    }
+
+    /* skip identical children at the start and end */
+    while ((prefix < old_n) && (prefix < new_n)
+           && (rum_element_get_hash(old_children[prefix]) == rum_element_get_hash(new_children[prefix]))) {
+        ++prefix;
+    }
+    while ((suffix < old_n - prefix) && (suffix < new_n - prefix)
+           && (rum_element_get_hash(old_children[old_n - 1 - suffix])
+               == rum_element_get_hash(new_children[new_n - 1 - suffix]))) {
+        ++suffix;
+    }
+
+    rc = diff_middle(state, old_children, old_n - suffix, new_children, new_n - suffix, prefix);
+
+    rum_free(old_children, (old_n? old_n : 1) * sizeof(rum_element_t *));
+    rum_free(new_children, (new_n? new_n : 1) * sizeof(rum_element_t *));
+    return rc;
+}
+
+/* returns nonzero if two (possibly unset) strings differ */
+static int
+strs_differ(const rum_str_t *a, const rum_str_t *b)
+{
+    const char *a_text = rum_str_get(a), *b_text = rum_str_get(b);
+
+    return (a_text && b_text)? strcmp(a_text, b_text) : (a_text != b_text);
+}
+
+/* compare two elements of the same tag, returning 0 on success or -1 on error */
+static int
+diff_elements(struct diff_state_s *state, const rum_element_t *old_element, const rum_element_t *new_element)
+{
+    int i;
+
+    if (rum_element_get_hash(old_element) == rum_element_get_hash(new_element)) {
+        return 0;
+    }
+    for (i = 0; i < old_element->tag->nattrs; ++i) {
+        if (strs_differ(&(old_element->values[i]), &(new_element->values[i]))) {
+            report(state, RUM_DIFF_ATTR, old_element, new_element, i);
+        }
+    }
+    if (strs_differ(&(old_element->content), &(new_element->content))) {
+        report(state, RUM_DIFF_CONTENT, old_element, new_element, -1);
+    }
+    return diff_children(state, old_element, new_element);
+}
+
+long
+rum_document_diff(rum_document_t *old_document, rum_document_t *new_document,
+    rum_diff_callback_t callback, void *data)
+{
+    struct diff_state_s state;
+
+    rum_set_error(NULL);
+    if ((old_document == NULL) || (new_document == NULL)) {
+        rum_set_error("Programmer error: Unable to compare nonexistent documents");
+        return -1;
+    }
+    if (old_document->root->tag != new_document->root->tag) {
+        rum_set_error("Programmer error: Unable to compare documents of different languages");
+        return -1;
+    }
+    state.callback = callback;
+    state.data = data;
+    state.ndiffs = 0;
+    if (diff_elements(&state, old_document->root, new_document->root) < 0) {
+        return -1;
+    }
+    return state.ndiffs;
+}
@@ -0,0 +1,60 @@
+/*
+    rum_diff.h
+
+    declarations for structural comparison of documents in RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_DIFF__H
+#define RUM_DIFF__H
+
+#include <rum_types.h>
+
+/*
+ * Two documents parsed with the same language are compared as trees. Each element's subtree
+ * hash (see rum_element_get_hash()) is compared first, so identical subtrees are skipped
+ * without looking inside them. Where the hashes differ, the elements' own attribute values
+ * and content are compared, and their children are aligned: a common prefix and suffix are
+ * skipped, and in between, a child that matches one further along in the other document
+ * is kept, while the others are paired up (if of the same tag) and compared in turn, or
+ * reported as deleted or inserted.
+ *
+ * The work done is proportional to the number of children of the elements that differ,
+ * not to the size of the documents (once their hashes have been computed).
+ *
+ * Subtrees with equal hashes are taken to be identical without being compared, so in the
+ * (very unlikely, with 64-bit hashes) event of a collision, a difference would go unreported.
+ */
+
+/* kinds of difference */
+typedef enum {
+    RUM_DIFF_DELETE,    /* old_element (with its subtree) is not in the new document */
+    RUM_DIFF_INSERT,    /* new_element (with its subtree) is not in the old document */
+    RUM_DIFF_ATTR,      /* the attribute with the given handle has different values */
+    RUM_DIFF_CONTENT    /* the elements have different content */
+} rum_diff_type_t;
+
+/* one element-level difference, as passed to a rum_diff_callback_t */
+struct rum_diff_s {
+    rum_diff_type_t type;
+
+    /* the element in each document (old_element is NULL for an insertion,
+     * and new_element is NULL for a deletion)
+     */
+    const rum_element_t *old_element;
+    const rum_element_t *new_element;
+
+    /* for RUM_DIFF_ATTR, the attribute's handle (see rum_tag_attr_handle()); otherwise -1 */
+    int handle;
+};
+
+/* compare two documents, calling callback (with data) for each difference in document order,
+ * and returning the number of differences (or -1 on error)
+ *
+ * the documents are not otherwise changed, but their elements' subtree hashes are computed and cached
+ */
+long rum_document_diff(rum_document_t *old_document, rum_document_t *new_document,
+        rum_diff_callback_t callback, void *data);
+
+#endif /* RUM_DIFF__H */
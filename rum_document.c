@@ -9,11 +9,71 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <rump.h>
 #include "rum_private.h"
 
+const char *
+rum_str_get(const rum_str_t *str)
+{
+    const char *ptr;
+
+    switch (str->kind) {
+        case RUM_STR_INLINE:
+            return str->data;
+        case RUM_STR_HEAP:
+        case RUM_STR_SHARED:
+            memcpy(&ptr, str->data, sizeof(ptr));
+            return ptr;
+    }
+    return NULL;
+}
+
+void
+rum_str_set_ptr(rum_str_t *str, int kind, const char *ptr)
+{
+    str->kind = kind;
+    memcpy(str->data, &ptr, sizeof(ptr));
+}
+
+rum_binary_t *
+rum_element_binary(const rum_element_t *element)
+{
+    return (rum_binary_t *) (element->values + element->tag->nattrs);
+}
+
+/* free any text owned by a compact string, and mark it unset */
+static void
+rum_str_clear(rum_str_t *str)
+{
+    const char *text;
+
+    if (str->kind == RUM_STR_HEAP) {
+        text = rum_str_get(str);
+        rum_free((char *) text, strlen(text) + 1);
+    }
+    str->kind = RUM_STR_UNSET;
+}
+
+size_t
+rum_element_size(const rum_tag_t *tag)
+{
+    size_t size = sizeof(rum_element_t) + sizeof(rum_str_t) * tag->nattrs;
+
+    if (tag->has_typed_attrs) {
+        size += sizeof(rum_binary_t) * tag->nattrs;
+    }
+    return size;
+}
+
 rum_element_t *
 rum_element_new(rum_element_t *parent, const rum_tag_t *language, const char *tag_name)
+{
+    return rum_element_new_cached(NULL, parent, language, tag_name);
+}
+
+static rum_element_t *
+element_new(rum_element_cache_t *cache, rum_element_t *parent, const rum_tag_t *language, const char *tag_name)
 {
     const rum_tag_t *tag;
     rum_element_t *element, *sibling;
@@ -39,32 +99,28 @@ rum_element_new(rum_element_t *parent, const rum_tag_t *language, const char *ta
         return NULL;
     }
 
-    /* allocate and initialize new element */
-    if ((element = malloc(sizeof(rum_element_t))) == NULL) {
+    /* allocate (or reuse) and initialize new element, with an (unset) value for each of the tag's attributes */
+    if (cache && (tag->id < cache->ntags) && cache->free[tag->id]) {
+        element = cache->free[tag->id];
+        cache->free[tag->id] = element->next_sibling;
+    } else if ((element = rum_malloc(rum_element_size(tag))) == NULL) {
         rum_set_error("Unable to allocate memory for new document element");
         return NULL;
     }
     element->tag = tag;
-    element->content = NULL;
-
-    /* allocate a (NULL) value for each of the tag's attributes */
-    if (rum_tag_get_nattrs(tag)) {
-        if ((element->values = malloc(sizeof(char*) * rum_tag_get_nattrs(tag))) == NULL) {
-            free(element);
-            rum_set_error("Unable to allocate memory for new document element");
-            return NULL;
-        }
-        for (i = 0; i < rum_tag_get_nattrs(tag); ++i) {
-            element->values[i] = NULL;
-        }
-    } else {
-        element->values = NULL;
+    element->content.kind = RUM_STR_UNSET;
+    for (i = 0; i < rum_tag_get_nattrs(tag); ++i) {
+        element->values[i].kind = RUM_STR_UNSET;
     }
 
     /* insert the element into the tree structure */
     element->parent = parent;
     element->next_sibling = NULL;
     element->first_child = NULL;
+    element->offset = 0;
+    element->length = 0;
+    element->hash = 0;
+    rum_element_clear_hash(parent);
     if (parent) {
         if (parent->first_child == NULL) {
             parent->first_child = element;
@@ -76,6 +132,220 @@ rum_element_new(rum_element_t *parent, const rum_tag_t *language, const char *ta
     return element;
 }
 
+rum_element_t *
+rum_element_new_cached(rum_element_cache_t *cache, rum_element_t *parent, const rum_tag_t *language,
+    const char *tag_name)
+{
+    rum_element_t *element;
+
+    RUM_PROFILE_ENTER(RUM_PHASE_ELEMENT);
+    element = element_new(cache, parent, language, tag_name);
+    RUM_PROFILE_LEAVE(RUM_PHASE_ELEMENT);
+    return element;
+}
+
+/* free an element and all its children (or keep them in cache), without unlinking it from the tree */
+static void
+rum_element_free_subtree(rum_element_cache_t *cache, rum_element_t *element)
+{
+    rum_element_t *child, *next;
+    int i;
+
+    for (child = element->first_child; child; child = next) {
+        next = child->next_sibling;
+        rum_element_free_subtree(cache, child);
+    }
+    for (i = 0; i < element->tag->nattrs; ++i) {
+        rum_str_clear(&(element->values[i]));
+    }
+    rum_str_clear(&(element->content));
+    if (cache && (element->tag->id < cache->ntags)) {
+        element->next_sibling = cache->free[element->tag->id];
+        cache->free[element->tag->id] = element;
+    } else {
+        rum_free(element, rum_element_size(element->tag));
+    }
+}
+
+void
+rum_element_free(rum_element_t *element)
+{
+    rum_element_release(NULL, element);
+}
+
+/* unlink an element from its parent */
+static void
+unlink_element(rum_element_t *element)
+{
+    rum_element_t *sibling;
+
+    rum_element_clear_hash(element->parent);
+    if (element->parent) {
+        if (element->parent->first_child == element) {
+            element->parent->first_child = element->next_sibling;
+        } else {
+            for (sibling = element->parent->first_child; sibling->next_sibling != element;
+                 sibling = sibling->next_sibling);
+            sibling->next_sibling = element->next_sibling;
+        }
+    }
+}
+
+void
+rum_element_release(rum_element_cache_t *cache, rum_element_t *element)
+{
+    rum_set_error(NULL);
+    if (element == NULL) {
+        return;
+    }
+    unlink_element(element);
+    rum_element_free_subtree(cache, element);
+}
+
+void
+rum_element_detach(rum_element_t *element)
+{
+    rum_set_error(NULL);
+    if (element == NULL) {
+        rum_set_error("Programmer error: Unable to detach nonexistent document element");
+        return;
+    }
+    unlink_element(element);
+    element->parent = NULL;
+    element->next_sibling = NULL;
+}
+
+rum_element_cache_t *
+rum_element_cache_new(const rum_tag_t *language)
+{
+    rum_element_cache_t *cache;
+    int ntags;
+
+    rum_set_error(NULL);
+    if (language == NULL) {
+        rum_set_error("Programmer error: Unable to create element cache for nonexistent language");
+        return NULL;
+    }
+    ntags = rum_language_get_ntags(language);
+    if ((cache = rum_malloc(sizeof(rum_element_cache_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for element cache");
+        return NULL;
+    }
+    if ((cache->free = rum_malloc(ntags * sizeof(rum_element_t *))) == NULL) {
+        rum_free(cache, sizeof(rum_element_cache_t));
+        rum_set_error("Unable to allocate memory for element cache");
+        return NULL;
+    }
+    memset(cache->free, 0, ntags * sizeof(rum_element_t *));
+    cache->ntags = ntags;
+    return cache;
+}
+
+void
+rum_element_cache_free(rum_element_cache_t *cache)
+{
+    rum_element_t *element;
+    int id;
+
+    rum_set_error(NULL);
+    if (cache) {
+        for (id = 0; id < cache->ntags; ++id) {
+            while ((element = cache->free[id]) != NULL) {
+                cache->free[id] = element->next_sibling;
+                rum_free(element, rum_element_size(element->tag));
+            }
+        }
+        rum_free(cache->free, cache->ntags * sizeof(rum_element_t *));
+        rum_free(cache, sizeof(rum_element_cache_t));
+    }
+}
+
+rum_document_t *
+rum_document_new(rum_element_t *root)
+{
+    rum_document_t *document;
+
+    rum_set_error(NULL);
+    if (root == NULL) {
+        rum_set_error("Programmer error: Unable to create document from nonexistent element");
+        return NULL;
+    }
+    if ((document = rum_malloc(sizeof(rum_document_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for document");
+        return NULL;
+    }
+    document->root = root;
+    document->map = NULL;
+    document->map_size = 0;
+    document->elements = NULL;
+    document->elements_size = 0;
+    document->indexes = NULL;
+    document->source = NULL;
+    document->source_size = 0;
+    document->source_capacity = 0;
+    document->refcount = 1;
+    document->is_shared = 0;
+    return document;
+}
+
+void
+rum_document_free(rum_document_t *document)
+{
+    rum_set_error(NULL);
+    /* the last holder to let go must see everything the others did, so the count is released
+     * and acquired as it drops
+     */
+    if (document && (__atomic_sub_fetch(&(document->refcount), 1, __ATOMIC_ACQ_REL) == 0)) {
+        rum_document_free_indexes(document);
+        rum_free(document->source, document->source_capacity);
+        if (document->map) {
+            rum_snapshot_release(document);
+        } else {
+            rum_element_free(document->root);
+        }
+        rum_free(document, sizeof(rum_document_t));
+    }
+}
+
+rum_document_t *
+rum_document_ref(rum_document_t *document)
+{
+    rum_set_error(NULL);
+    if (document == NULL) {
+        rum_set_error("Programmer error: Unable to reference nonexistent document");
+        return NULL;
+    }
+    __atomic_add_fetch(&(document->refcount), 1, __ATOMIC_RELAXED);
+    return document;
+}
+
+void
+rum_document_share(rum_document_t *document)
+{
+    rum_set_error(NULL);
+    if (document) {
+        document->is_shared = 1;
+    }
+}
+
+int
+rum_document_is_shared(const rum_document_t *document)
+{
+    rum_set_error(NULL);
+    return (document && document->is_shared)? 1 : 0;
+}
+
+rum_element_t *
+rum_document_get_root(const rum_document_t *document)
+{
+    rum_set_error(NULL);
+    if (document == NULL) {
+        rum_set_error("Programmer error: Unable to get root of nonexistent document");
+        return NULL;
+    }
+    return document->root;
+}
+
 const char *
 rum_element_get_name(const rum_element_t *element)
 {
@@ -106,31 +376,103 @@ rum_element_get_content(const rum_element_t *element)
         rum_set_error("Programmer error: Unable to get content of nonexistent document element");
         return NULL;
     }
-    return element->content;
+    return rum_str_get(&(element->content));
 }
 
 const char *
 rum_element_get_value(const rum_element_t *element, const char *attr_name)
 {
-    int i;
-    const rum_tag_t *tag;
-    const char *attr_name2;
+    int handle;
 
     rum_set_error(NULL);
     if ((element == NULL) || (attr_name == NULL)) {
         rum_set_error("Programmer error: Unable to get value of nonexistent attribute");
         return NULL;
     }
-    tag = element->tag;
-    for (i = 0; i < rum_tag_get_nattrs(tag); ++i) {
-        if ((attr_name2 = rum_tag_get_attr_name(tag, i)) != NULL) {
-            if (!strcmp(attr_name, attr_name2)) {
-                return element->values[i];
-            }
-        }
+    if ((handle = rum_tag_attr_handle(element->tag, attr_name)) < 0) {
+        rum_set_error("Programmer error: Unable to get value of unsupported attribute");
+        return NULL;
     }
-    rum_set_error("Programmer error: Unable to get value of unsupported attribute");
-    return NULL;
+    return rum_str_get(&(element->values[handle]));
+}
+
+const char *
+rum_element_get_value_by_handle(const rum_element_t *element, int handle)
+{
+    rum_set_error(NULL);
+    if ((element == NULL) || (handle < 0) || (handle >= element->tag->nattrs)) {
+        rum_set_error("Programmer error: Unable to get value of nonexistent attribute");
+        return NULL;
+    }
+    return rum_str_get(&(element->values[handle]));
+}
+
+/* common code for typed accessors */
+static int
+rum_element_get_binary(const rum_element_t *element, int handle, rum_attr_type_t type, rum_binary_t *value)
+{
+    rum_set_error(NULL);
+    if ((element == NULL) || (handle < 0) || (handle >= element->tag->nattrs) || (value == NULL)) {
+        rum_set_error("Programmer error: Unable to get value of nonexistent attribute");
+        return -1;
+    }
+    if (element->tag->attrs[handle].type != type) {
+        rum_set_error("Programmer error: Unable to get value of attribute as a different type");
+        return -1;
+    }
+    if (element->values[handle].kind == RUM_STR_UNSET) {
+        return 0;
+    }
+    *value = rum_element_binary(element)[handle];
+    return 1;
+}
+
+int
+rum_element_get_integer(const rum_element_t *element, int handle, long *value)
+{
+    rum_binary_t binary;
+    int rc = rum_element_get_binary(element, handle, RUM_ATTR_INTEGER, &binary);
+
+    if (rc > 0) {
+        *value = binary.integer;
+    }
+    return rc;
+}
+
+int
+rum_element_get_decimal(const rum_element_t *element, int handle, double *value)
+{
+    rum_binary_t binary;
+    int rc = rum_element_get_binary(element, handle, RUM_ATTR_DECIMAL, &binary);
+
+    if (rc > 0) {
+        *value = binary.decimal;
+    }
+    return rc;
+}
+
+int
+rum_element_get_boolean(const rum_element_t *element, int handle, int *value)
+{
+    rum_binary_t binary;
+    int rc = rum_element_get_binary(element, handle, RUM_ATTR_BOOLEAN, &binary);
+
+    if (rc > 0) {
+        *value = (int) binary.integer;
+    }
+    return rc;
+}
+
+int
+rum_element_get_enum(const rum_element_t *element, int handle, int *value)
+{
+    rum_binary_t binary;
+    int rc = rum_element_get_binary(element, handle, RUM_ATTR_ENUM, &binary);
+
+    if (rc > 0) {
+        *value = (int) binary.integer;
+    }
+    return rc;
 }
 
 rum_element_t *
@@ -166,28 +508,113 @@ rum_element_get_first_child(const rum_element_t *element)
     return element->first_child;
 }
 
-/* clone XML content, replacing entity references and verifying well-formedness */
-static char *
-xmlcontent2plaintext(const char *content)
+int
+rum_element_get_span(const rum_element_t *element, size_t *start, size_t *end)
 {
-    const char *lookahead, *amp;
-    char c, *translated, *cur;
+    const rum_element_t *ancestor;
+    size_t offset;
 
     rum_set_error(NULL);
+    if ((element == NULL) || (start == NULL) || (end == NULL)) {
+        rum_set_error("Programmer error: Unable to get span of nonexistent document element");
+        return -1;
+    }
+    if (element->length == 0) {
+        return 0;
+    }
+    offset = element->offset;
+    for (ancestor = element->parent; ancestor; ancestor = ancestor->parent) {
+        offset += ancestor->offset;
+    }
+    *start = offset;
+    *end = offset + element->length;
+    return 1;
+}
 
-    /* if no content, return empty string */
-    if (content == NULL) {
-        return "";
+/* continue a hash with a compact string, distinguishing unset from empty */
+static uint64_t
+hash_str(uint64_t hash, const rum_str_t *str)
+{
+    const char *text = rum_str_get(str);
+
+    return text? rum_hash_bytes(hash, text, strlen(text) + 1) : rum_hash_bytes(hash, "\1", 1);
+}
+
+uint64_t
+rum_element_get_hash(const rum_element_t *element)
+{
+    const rum_element_t *child;
+    uint64_t hash, child_hash;
+    int i;
+
+    rum_set_error(NULL);
+    if (element == NULL) {
+        rum_set_error("Programmer error: Unable to get hash of nonexistent document element");
+        return 0;
+    }
+    if ((hash = __atomic_load_n(&(element->hash), __ATOMIC_RELAXED)) != 0) {
+        return hash;
     }
 
-    /* allocate space for the value
-     *
-     * if there are entity replacements, this will end up wasting some space
+    hash = rum_hash_bytes(RUM_HASH_INIT, &(element->tag->id), sizeof(element->tag->id));
+    for (i = 0; i < element->tag->nattrs; ++i) {
+        hash = hash_str(hash, &(element->values[i]));
+    }
+    hash = hash_str(hash, &(element->content));
+    for (child = element->first_child; child; child = child->next_sibling) {
+        child_hash = rum_element_get_hash(child);
+        hash = rum_hash_bytes(hash, &child_hash, sizeof(child_hash));
+    }
+
+    /* the hash is only a cache, so it can be stored even in an otherwise read-only element; threads
+     * sharing the document may compute it at the same time, but they all store the same value
      */
-    if ((translated = malloc(strlen(content) + 1)) == NULL) {
-        rum_set_error("Unable to allocate memory for parsed text");
-        return NULL;
+    hash = hash? hash : 1;
+    __atomic_store_n(&(((rum_element_t *) element)->hash), hash, __ATOMIC_RELAXED);
+    return hash;
+}
+
+/* a computed hash implies computed hashes for the whole subtree, so an element with no hash
+ * has no ancestor with one either, and clearing can stop there
+ */
+void
+rum_element_clear_hash(rum_element_t *element)
+{
+    for (; element && element->hash; element = element->parent) {
+        element->hash = 0;
     }
+}
+
+/* decoded strings up to this length are interned from a stack buffer rather than a temporary allocation */
+#define RUM_INTERN_SCRATCH (256)
+
+int
+rum_entity_char(const char *ref, size_t len)
+{
+    /* RuM diverges from XML spec by not allowing numeric entity references */
+    if (!strncmp(ref, "&lt;", len)) {
+        return '<';
+    } else if (!strncmp(ref, "&gt;", len)) {
+        return '>';
+    } else if (!strncmp(ref, "&amp;", len)) {
+        return '&';
+    } else if (!strncmp(ref, "&apos;", len)) {
+        return '\'';
+    } else if (!strncmp(ref, "&quot;", len)) {
+        return '\"';
+    }
+    return -1;
+}
+
+/* copy XML content into translated (which must have room for strlen(content) + 1 bytes),
+ * replacing entity references and verifying well-formedness; return 0 on success, -1 on error
+ */
+static int
+decode_text(const char *content, char *translated)
+{
+    const char *lookahead, *amp;
+    char c, *cur;
+    int entity;
 
     /* copy the value, replacing entities and ensuring well-formedness */
     lookahead = content;
@@ -198,16 +625,14 @@ xmlcontent2plaintext(const char *content)
         switch (c) {
             /* per XML spec, < is not allowed */
             case '<':
-                free(translated);
                 rum_set_error("'<' not allowed here");
-                return NULL;
+                return -1;
 
             /* per XML spec, & is only allowed as part of entity reference */
             case '&':
                 if (amp) {
-                    free(translated);
                     rum_set_error("'&' not allowed here");
-                    return NULL;
+                    return -1;
                 }
                 amp = lookahead;
                 break;
@@ -215,22 +640,11 @@ xmlcontent2plaintext(const char *content)
             /* if we have an entity in the source string, replace it */
             case ';':
                 if (amp) {
-                    /* RuM diverges from XML spec by not allowing numeric entity references */
-                    if (!strncmp(amp, "&lt;", (lookahead - amp))) {
-                        c = '<';
-                    } else if (!strncmp(amp, "&gt;", (lookahead - amp))) {
-                        c = '>';
-                    } else if (!strncmp(amp, "&amp;", (lookahead - amp))) {
-                        c = '&';
-                    } else if (!strncmp(amp, "&apos;", (lookahead - amp))) {
-                        c = '\'';
-                    } else if (!strncmp(amp, "&quot;", (lookahead - amp))) {
-                        c = '\"';
-                    } else {
-                        free(translated);
+                    if ((entity = rum_entity_char(amp, lookahead - amp)) < 0) {
                         rum_set_error("Unknown entity");
-                        return NULL;
+                        return -1;
                     }
+                    c = entity;
                     amp = NULL;
                 }
                 break;
@@ -244,62 +658,244 @@ xmlcontent2plaintext(const char *content)
 
     /* per XML spec, & is only allowed as part of entity reference */
     if (amp) {
-        free(translated);
         rum_set_error("'&' not allowed here");
-        return NULL;
+        return -1;
     }
+    return 0;
+}
+
+/* decode_text(), profiled as a phase of its own */
+static int
+xmlcontent_decode(const char *content, char *translated)
+{
+    int rc;
 
-    return translated;
+    RUM_PROFILE_ENTER(RUM_PHASE_DECODE);
+    rc = decode_text(content, translated);
+    RUM_PROFILE_LEAVE(RUM_PHASE_DECODE);
+    return rc;
+}
+
+/* store XML content in a compact string, replacing entity references and verifying well-formedness;
+ * if pool is not NULL, the text is interned there, otherwise short text is stored inline
+ */
+static int
+xmlcontent2str(rum_str_t *str, const char *content, rum_strpool_t *pool)
+{
+    char scratch[RUM_INTERN_SCRATCH], *translated, *shrunk;
+    const char *interned;
+    size_t len, decoded_len;
+
+    rum_set_error(NULL);
+
+    /* if no content, store empty string */
+    if (content == NULL) {
+        content = "";
+    }
+    len = strlen(content);
+
+    /* the decoded text is never longer than the source, so short text can be decoded in place */
+    if ((pool == NULL) && (len < RUM_STR_INLINE_SIZE)) {
+        if (xmlcontent_decode(content, str->data) < 0) {
+            return -1;
+        }
+        str->kind = RUM_STR_INLINE;
+        return 0;
+    }
+
+    /* allocate space for the value
+     *
+     * if there are entity replacements, the allocation is shrunk to fit afterward
+     */
+    if (pool && (len < RUM_INTERN_SCRATCH)) {
+        translated = scratch;
+    } else if ((translated = rum_malloc(len + 1)) == NULL) {
+        rum_set_error("Unable to allocate memory for parsed text");
+        return -1;
+    }
+
+    if (xmlcontent_decode(content, translated) < 0) {
+        if (translated != scratch) {
+            rum_free(translated, len + 1);
+        }
+        return -1;
+    }
+
+    /* pooled strings are shared, so they are never modified through the element */
+    if (pool) {
+        interned = rum_strpool_intern(pool, translated);
+        if (translated != scratch) {
+            rum_free(translated, len + 1);
+        }
+        if (interned == NULL) {
+            return -1;
+        }
+        rum_str_set_ptr(str, RUM_STR_SHARED, interned);
+
+    /* entity replacement may have made the text short enough to store inline */
+    } else if ((decoded_len = strlen(translated)) < RUM_STR_INLINE_SIZE) {
+        strcpy(str->data, translated);
+        str->kind = RUM_STR_INLINE;
+        rum_free(translated, len + 1);
+
+    } else {
+        /* heap text is always allocated at its exact size, so it can be freed by length */
+        if (decoded_len < len) {
+            if ((shrunk = rum_realloc(translated, len + 1, decoded_len + 1)) == NULL) {
+                rum_free(translated, len + 1);
+                rum_set_error("Unable to allocate memory for parsed text");
+                return -1;
+            }
+            translated = shrunk;
+        }
+        rum_str_set_ptr(str, RUM_STR_HEAP, translated);
+    }
+    return 0;
+}
+
+/* return true if text is an optionally signed decimal number, with optional fraction and exponent */
+static int
+is_decimal_text(const char *text)
+{
+    int ndigits = 0;
+
+    if ((*text == '+') || (*text == '-')) {
+        ++text;
+    }
+    for (; (*text >= '0') && (*text <= '9'); ++text, ++ndigits);
+    if (*text == '.') {
+        for (++text; (*text >= '0') && (*text <= '9'); ++text, ++ndigits);
+    }
+    if (ndigits && ((*text == 'e') || (*text == 'E'))) {
+        ++text;
+        if ((*text == '+') || (*text == '-')) {
+            ++text;
+        }
+        if ((*text < '0') || (*text > '9')) {
+            return 0;
+        }
+        for (; (*text >= '0') && (*text <= '9'); ++text);
+    }
+    return ndigits && (*text == 0);
+}
+
+/* validate the decoded text of a typed attribute value and convert it to binary form */
+static int
+convert_typed_value(const rum_attr_t *attr, rum_str_t *str, rum_binary_t *binary)
+{
+    const char *text = rum_str_get(str);
+    char *end;
+    int i;
+
+    switch (attr->type) {
+        case RUM_ATTR_STRING:
+            break;
+
+        case RUM_ATTR_INTEGER:
+            if ((*text == '+') || (*text == '-')) {
+                ++text;
+            }
+            if ((*text < '0') || (*text > '9')) {
+                rum_set_error("Attribute value is not a valid integer");
+                return -1;
+            }
+            errno = 0;
+            binary->integer = strtol(rum_str_get(str), &end, 10);
+            if (*end || (errno == ERANGE)) {
+                rum_set_error("Attribute value is not a valid integer");
+                return -1;
+            }
+            break;
+
+        case RUM_ATTR_DECIMAL:
+            if (!is_decimal_text(text)) {
+                rum_set_error("Attribute value is not a valid decimal number");
+                return -1;
+            }
+            errno = 0;
+            binary->decimal = strtod(text, NULL);
+            if (errno == ERANGE) {
+                rum_set_error("Attribute value is out of range");
+                return -1;
+            }
+            break;
+
+        case RUM_ATTR_BOOLEAN:
+            if (!strcmp(text, "true") || !strcmp(text, "1") || (*text == 0)) {
+                binary->integer = 1;
+            } else if (!strcmp(text, "false") || !strcmp(text, "0")) {
+                binary->integer = 0;
+            } else {
+                rum_set_error("Attribute value is not a valid boolean");
+                return -1;
+            }
+            break;
+
+        case RUM_ATTR_ENUM:
+            for (i = 0; attr->enum_values[i]; ++i) {
+                if (!strcmp(text, attr->enum_values[i])) {
+                    break;
+                }
+            }
+            if (attr->enum_values[i] == NULL) {
+                rum_set_error("Attribute value is not one of the allowed values");
+                return -1;
+            }
+            binary->integer = i;
+
+            /* keep only the index, sharing the text with the tag specification */
+            rum_str_clear(str);
+            rum_str_set_ptr(str, RUM_STR_SHARED, attr->enum_values[i]);
+            break;
+    }
+    return 0;
 }
 
 /* set an attribute value for an element, verifying its well-formedness
  *
  * the current implementation has inefficient memory usage; rum_parse_file() clones the buffer substring
- * and passes that clone here, which clones it again to put in the element;
+ * and passes that clone here, which decodes it again to put in the element (though short values
+ * are decoded straight into the element's inline storage);
  * a "strn" approach would be better, passing the buffer substring start and length directly
  */
 int
 rum_element_set_value(rum_element_t *element, const char *attr_name, const char *attr_value)
 {
     int i;
-    const char *attr_name2;
 
     rum_set_error(NULL);
 
     /* assert(element has been constructed) */
-    if (element && element->tag && element->values && attr_name) {
-
-        /* loop through the tag's attributes */
-        for (i = 0; i < rum_tag_get_nattrs(element->tag); ++i) {
-
-            /* assert(this index has a matching attribute) */
-            if ((attr_name2 = rum_tag_get_attr_name(element->tag, i)) == NULL) {
-                return -1;
-            }
-
-            /* if this is the attribute we're looking for ... */
-            if (!strcmp(attr_name, attr_name2)) {
+    if ((element == NULL) || (element->tag == NULL) || (attr_name == NULL)) {
+        rum_set_error("Attribute not supported for this tag");
+        return -1;
+    }
 
-                /* per XML spec, error if a value has already been set for this attribute in this tag */
-                if (element->values[i] != NULL) {
-                    rum_set_error("Attribute may not be specified twice in same element");
-                    return -1;
-                }
+    /* error if attribute name is not valid for this tag */
+    if ((i = rum_tag_attr_handle(element->tag, attr_name)) < 0) {
+        return -1;
+    }
 
-                /* clone the value as plain text */
-                if ((element->values[i] = xmlcontent2plaintext(attr_value)) == NULL) {
-                    return -1;
-                }
+    /* per XML spec, error if a value has already been set for this attribute in this tag */
+    if (element->values[i].kind != RUM_STR_UNSET) {
+        rum_set_error("Attribute may not be specified twice in same element");
+        return -1;
+    }
 
-                /* we have a winner */
-                return(0);
-            }
-        }
+    /* clone the value as plain text */
+    rum_element_clear_hash(element);
+    if (xmlcontent2str(&(element->values[i]), attr_value, element->tag->strpool) < 0) {
+        return -1;
     }
 
-    /* error if attribute name is not valid for this tag */
-    rum_set_error("Attribute not supported for this tag");
-    return -1;
+    /* validate and convert typed values */
+    if (element->tag->has_typed_attrs
+        && (convert_typed_value(&(element->tag->attrs[i]), &(element->values[i]),
+                                &(rum_element_binary(element)[i])) < 0)) {
+        rum_str_clear(&(element->values[i]));
+        return -1;
+    }
+    return 0;
 }
 
 int
@@ -313,7 +909,8 @@ rum_element_set_content(rum_element_t *element, const char *content)
     if (!content) {
         return 0;
     }
-    if ((element->content = xmlcontent2plaintext(content)) == NULL) {
+    rum_element_clear_hash(element);
+    if (xmlcontent2str(&(element->content), content, element->tag->strpool) < 0) {
         return -1;
     }
     return 0;
@@ -9,48 +9,217 @@
 #ifndef RUM_DOCUMENT__H
 #define RUM_DOCUMENT__H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <rum_types.h>
 
+/* number of bytes a compact string can hold inline (including the terminating null byte) */
+#define RUM_STR_INLINE_SIZE (23)
+
+/* ways a compact string can store its text */
+enum {
+    RUM_STR_UNSET,  /* no string (NULL) */
+    RUM_STR_INLINE, /* text is stored in data itself */
+    RUM_STR_HEAP,   /* data holds a pointer to text allocated for this string */
+    RUM_STR_SHARED  /* data holds a pointer to text owned by something else (e.g. a string pool) */
+};
+
+/* compact string: short strings are stored inline, so they need no allocation of their own;
+ * longer strings are stored out of line, with the pointer kept (unaligned) in data
+ */
+struct rum_str_s {
+    unsigned char kind;
+    char data[RUM_STR_INLINE_SIZE];
+};
+
+/* binary form of a typed attribute value */
+union rum_binary_u {
+    long integer;   /* RUM_ATTR_INTEGER, RUM_ATTR_BOOLEAN (0 or 1) and RUM_ATTR_ENUM (index of value) */
+    double decimal; /* RUM_ATTR_DECIMAL */
+};
+
 /* XML element: a tag instance and its associated attribute values and content */
 struct rum_element_s {
     /* tag that this element is an instance of */
     const rum_tag_t *tag;
 
-    /* list of attribute values, one per attribute supported by the tag
+    /* this element's content (unset for empty tags) */
+    rum_str_t content;
+
+    /* this tag's place in the document's tag tree */
+    rum_element_t *parent;
+    rum_element_t *next_sibling;
+    rum_element_t *first_child;
+
+    /* where this element came from in the parsed input: the offset of its '<' relative to its
+     * parent's (or to the start of the input, for an element without a parent), and its length
+     * up to and including its final '>'; the length is 0 if the span is unknown, as for elements
+     * created directly or loaded from a snapshot
+     *
+     * offsets are relative so that an edit only shifts the elements after it at each level of its
+     * ancestry, rather than every element after it in the document
+     */
+    size_t offset;
+    size_t length;
+
+    /* hash of this element's subtree (see rum_element_get_hash()), or 0 if not yet computed;
+     * changing an element clears the hashes of it and its ancestors
+     */
+    uint64_t hash;
+
+    /* list of attribute values, one per attribute supported by the tag,
+     * allocated along with the element itself
      *
      * this assumes that the tag spec is immutable by the time this element is created
      * (adding or removing attributes in the tag spec would break this)
      *
-     * NULL indicates the attribute was not specified;
+     * unset indicates the attribute was not specified;
      * empty string indicates the attribute was specified with no value
      * (allows enforcement of requirement that an XML attribute can only be specified once per tag)
+     *
+     * if the tag has a string pool, all values and content are shared with the pool
+     *
+     * if the tag has typed attributes, the values are followed by an array of rum_binary_t,
+     * one per attribute, holding the converted form of each typed value; the text of an
+     * enumerated value is shared with the tag specification
      */
-    char **values;
+    rum_str_t values[];
+};
 
-    /* this element's content (NULL for empty tags) */
-    char *content;
+/* memory of freed elements, kept for reuse by new elements of the same tag, so that a series of
+ * similar documents (such as the records of a stream) can be parsed without allocating elements
+ */
+struct rum_element_cache_s {
+    int ntags;
 
-    /* this tag's place in the document's tag tree */
-    rum_element_t *parent;
-    rum_element_t *next_sibling;
-    rum_element_t *first_child;
+    /* free[id] is a list of elements of the tag with that id, linked through next_sibling */
+    rum_element_t **free;
 };
 
-/* a document is simply a pointer to the root element */
+/* a document is the root element along with whatever owns the memory of its elements */
+struct rum_document_s {
+    /* the root element */
+    rum_element_t *root;
+
+    /* for a document loaded from a snapshot, the mapped snapshot file and the single block
+     * holding all of the elements (whose text points into the mapping); both are NULL for a
+     * document built by parsing, whose elements are allocated individually
+     */
+    void *map;
+    size_t map_size;
+    void *elements;
+    size_t elements_size;
+
+    /* attribute value indexes built so far (see rum_index.h) */
+    rum_index_t *indexes;
+
+    /* for a document parsed with rum_document_parse(), a copy of the input it was parsed from,
+     * kept up to date by rum_document_reparse() (see rum_reparse.h); NULL otherwise
+     */
+    char *source;
+    size_t source_size;
+    size_t source_capacity;
+
+    /* number of holders of the document (see rum_document_ref()); it is freed when the last lets go,
+     * and it is changed atomically, so holders in different threads can let go at the same time
+     */
+    unsigned int refcount;
+
+    /* whether the document is shared by several holders (as by a parse cache), in which case it
+     * must be treated as read-only (boolean)
+     */
+    int is_shared;
+};
 
 /* constructor: create a new element instance and insert into document model */
 rum_element_t *rum_element_new(rum_element_t *parent, const rum_tag_t *language, const char *tag_name);
 
+/* same as rum_element_new(), reusing the memory of an element released to cache if there is one
+ * (cache may be NULL)
+ */
+rum_element_t *rum_element_new_cached(rum_element_cache_t *cache, rum_element_t *parent, const rum_tag_t *language,
+        const char *tag_name);
+
+/* destructor: remove an element from the document model, and free it and all its children
+ *
+ * this must only be used for individually allocated elements, not those of a loaded snapshot
+ */
+void rum_element_free(rum_element_t *element);
+
+/* same as rum_element_free(), but keeping the memory of the element and its children in cache
+ * for reuse (or freeing it, if cache is NULL)
+ */
+void rum_element_release(rum_element_cache_t *cache, rum_element_t *element);
+
+/* remove an element (with its subtree) from its parent, leaving it without a parent or siblings;
+ * it must then be freed separately with rum_element_free()
+ *
+ * its span offset (see rum_element_get_span()) remains relative to its former parent
+ */
+void rum_element_detach(rum_element_t *element);
+
+/* create a cache for elements of a language's tags */
+rum_element_cache_t *rum_element_cache_new(const rum_tag_t *language);
+
+/* destructor (frees all of the cached elements) */
+void rum_element_cache_free(rum_element_cache_t *cache);
+
+/* document constructor: take ownership of a parsed element tree */
+rum_document_t *rum_document_new(rum_element_t *root);
+
+/* document destructor: let go of a document, freeing it (and all of its elements) if no other
+ * holder remains
+ */
+void rum_document_free(rum_document_t *document);
+
+/* add a holder of a document, returning the document; each holder must call rum_document_free()
+ * (which may be done in any thread)
+ */
+rum_document_t *rum_document_ref(rum_document_t *document);
+
+/* mark a document as shared, so that it will no longer be changed (by rum_document_reparse())
+ *
+ * the elements of a shared document must not be changed either, since other holders may be using them
+ */
+void rum_document_share(rum_document_t *document);
+
+/* return 1 if a document is shared (and so read-only), or 0 if not */
+int rum_document_is_shared(const rum_document_t *document);
+
+/* document accessor */
+rum_element_t *rum_document_get_root(const rum_document_t *document);
+
 /* accessors */
 const char *rum_element_get_name(const rum_element_t *element);
 int rum_element_get_is_empty(const rum_element_t *element);
 const char *rum_element_get_content(const rum_element_t *element);
 const char *rum_element_get_value(const rum_element_t *element, const char *attr_name);
+const char *rum_element_get_value_by_handle(const rum_element_t *element, int handle);
+
+/* typed accessors: if the attribute with the given handle was specified, store its converted value
+ * and return 1; return 0 if it was not specified, and -1 if it is not of the requested type
+ */
+int rum_element_get_integer(const rum_element_t *element, int handle, long *value);
+int rum_element_get_decimal(const rum_element_t *element, int handle, double *value);
+int rum_element_get_boolean(const rum_element_t *element, int handle, int *value);
+int rum_element_get_enum(const rum_element_t *element, int handle, int *value);
 rum_element_t *rum_element_get_parent(const rum_element_t *element);
 rum_element_t *rum_element_get_next_sibling(const rum_element_t *element);
 rum_element_t *rum_element_get_first_child(const rum_element_t *element);
 
-/* add a value to an attribute of the element */
+/* if the element's span in the parsed input is known, store the offsets of its '<' and of the byte
+ * after its final '>' and return 1; return 0 if it is not known
+ */
+int rum_element_get_span(const rum_element_t *element, size_t *start, size_t *end);
+
+/* return a hash of the element's subtree (its tag, attribute values and content, and those of all
+ * its descendants, in order), computed bottom-up the first time it is needed and cached afterward,
+ * so that identical subtrees can be recognized without comparing them (threads sharing an
+ * unchanging document may ask for hashes at the same time)
+ */
+uint64_t rum_element_get_hash(const rum_element_t *element);
+
+/* add a value to an attribute of the element (validating and converting it if the attribute is typed) */
 int rum_element_set_value(rum_element_t *element, const char *attr_name, const char *attr_value);
 
 /* add content to the element */
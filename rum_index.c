@@ -0,0 +1,204 @@
+/*
+    rum_index.c
+
+    attribute value index functions for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rump.h>
+#include "rum_private.h"
+
+/* hash of a string */
+static size_t
+hash_str(const char *str)
+{
+    return rum_hash_bytes(RUM_HASH_INIT, str, strlen(str));
+}
+
+/* return the next element after element in document order, or NULL when the tree is done */
+static const rum_element_t *
+next_in_document(const rum_element_t *element)
+{
+    if (element->first_child) {
+        return element->first_child;
+    }
+    for (; element; element = element->parent) {
+        if (element->next_sibling) {
+            return element->next_sibling;
+        }
+    }
+    return NULL;
+}
+
+/* free an index */
+static void
+free_index(rum_index_t *index)
+{
+    rum_free(index->slots, index->nslots * sizeof(size_t));
+    rum_free(index->entries, index->nentries * sizeof(struct rum_index_entry_s));
+    rum_free(index, sizeof(rum_index_t));
+}
+
+/* collect the entries of an index and hash them, returning 0 on success or -1 on error */
+static int
+build_index(rum_index_t *index, const rum_element_t *root)
+{
+    const rum_element_t *element;
+    const char *value;
+    size_t i, j, n = 0;
+
+    /* count the elements to index, then collect them in document order */
+    for (element = root; element; element = next_in_document(element)) {
+        if ((element->tag == index->tag) && rum_str_get(&(element->values[index->handle]))) {
+            ++n;
+        }
+    }
+    if ((index->entries = rum_malloc((n + 1) * sizeof(struct rum_index_entry_s))) == NULL) {
+        rum_set_error("Unable to allocate memory for index");
+        return -1;
+    }
+    index->nentries = n + 1;
+    for (i = 0, element = root; element; element = next_in_document(element)) {
+        if ((element->tag == index->tag) && ((value = rum_str_get(&(element->values[index->handle]))) != NULL)) {
+            index->entries[i].element = element;
+            index->entries[i].value = value;
+            index->entries[i].hash = hash_str(value);
+            ++i;
+        }
+    }
+
+    /* size the table so it is at most half full */
+    for (index->nslots = 16; index->nslots < (n * 2); index->nslots *= 2);
+    if ((index->slots = rum_malloc(index->nslots * sizeof(size_t))) == NULL) {
+        index->nslots = 0;
+        rum_set_error("Unable to allocate memory for index");
+        return -1;
+    }
+    memset(index->slots, 0, index->nslots * sizeof(size_t));
+
+    /* insert in reverse, so each value's chain of entries ends up in document order */
+    for (i = n; i-- > 0; ) {
+        for (j = index->entries[i].hash & (index->nslots - 1); index->slots[j];
+             j = (j + 1) & (index->nslots - 1)) {
+            if ((index->entries[index->slots[j] - 1].hash == index->entries[i].hash)
+                && !strcmp(index->entries[index->slots[j] - 1].value, index->entries[i].value)) {
+                break;
+            }
+        }
+        index->entries[i].next = index->slots[j];
+        index->slots[j] = i + 1;
+    }
+    return 0;
+}
+
+/* return the index of a tag and attribute among a document's indexes from list up to (not
+ * including) end, or NULL if it is not there
+ */
+static rum_index_t *
+find_index(rum_index_t *list, const rum_index_t *end, const rum_tag_t *tag, int handle)
+{
+    for (; list != end; list = list->next) {
+        if ((list->tag == tag) && (list->handle == handle)) {
+            return list;
+        }
+    }
+    return NULL;
+}
+
+rum_index_t *
+rum_document_index(rum_document_t *document, const rum_tag_t *tag, const char *attr_name)
+{
+    rum_index_t *index, *other, *searched;
+    int handle;
+
+    rum_set_error(NULL);
+    if ((document == NULL) || (document->root == NULL) || (tag == NULL) || (attr_name == NULL)) {
+        rum_set_error("Programmer error: Unable to index nonexistent document");
+        return NULL;
+    }
+    if ((handle = rum_tag_attr_handle(tag, attr_name)) < 0) {
+        rum_set_error("Attribute not supported by tag");
+        return NULL;
+    }
+
+    /* reuse the index if it was already built */
+    searched = __atomic_load_n(&(document->indexes), __ATOMIC_ACQUIRE);
+    if ((index = find_index(searched, NULL, tag, handle)) != NULL) {
+        return index;
+    }
+
+    if ((index = rum_malloc(sizeof(rum_index_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for index");
+        return NULL;
+    }
+    index->tag = tag;
+    index->handle = handle;
+    index->slots = NULL;
+    index->nslots = 0;
+    index->entries = NULL;
+    index->nentries = 0;
+    if (build_index(index, document->root) < 0) {
+        free_index(index);
+        return NULL;
+    }
+
+    /* threads sharing the document may index it at the same time, so the index is published
+     * without a lock, by swapping in a new list head; if other indexes were added meanwhile,
+     * one of them may be this same index, in which case it is used and this one freed
+     */
+    index->next = searched;
+    while (!__atomic_compare_exchange_n(&(document->indexes), &(index->next), index, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        if ((other = find_index(index->next, searched, tag, handle)) != NULL) {
+            free_index(index);
+            return other;
+        }
+        searched = index->next;
+    }
+    return index;
+}
+
+int
+rum_index_lookup(const rum_index_t *index, const char *value, const rum_element_t **matches, int max_matches)
+{
+    const struct rum_index_entry_s *entry;
+    size_t i, hash;
+    int nmatches = 0;
+
+    rum_set_error(NULL);
+    if ((index == NULL) || (value == NULL) || ((matches == NULL) && (max_matches > 0))) {
+        rum_set_error("Programmer error: Unable to search nonexistent index");
+        return -1;
+    }
+
+    hash = hash_str(value);
+    for (i = hash & (index->nslots - 1); index->slots[i]; i = (i + 1) & (index->nslots - 1)) {
+        entry = &(index->entries[index->slots[i] - 1]);
+        if ((entry->hash == hash) && !strcmp(entry->value, value)) {
+            for (; entry; entry = entry->next? &(index->entries[entry->next - 1]) : NULL) {
+                if (nmatches < max_matches) {
+                    matches[nmatches] = entry->element;
+                }
+                ++nmatches;
+            }
+            break;
+        }
+    }
+    return nmatches;
+}
+
+void
+rum_document_free_indexes(rum_document_t *document)
+{
+    rum_index_t *next;
+
+    while (document->indexes) {
+        next = document->indexes->next;
+        free_index(document->indexes);
+        document->indexes = next;
+    }
+}
@@ -0,0 +1,59 @@
+/*
+    rum_index.h
+
+    declarations for attribute value indexes of documents in RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_INDEX__H
+#define RUM_INDEX__H
+
+#include <stddef.h>
+#include <rum_types.h>
+
+/* one indexed element */
+struct rum_index_entry_s {
+    const rum_element_t *element;
+    const char *value;
+    size_t hash;
+
+    /* index plus one of the next entry (in document order) with the same value, or zero if none */
+    size_t next;
+};
+
+/* hash index of the elements of one tag by the value of one attribute */
+struct rum_index_s {
+    const rum_tag_t *tag;
+    int handle;
+
+    /* open-addressed hash table of the index plus one of the first entry with each distinct value
+     * (zero meaning empty)
+     */
+    size_t *slots;
+    size_t nslots;
+
+    /* one entry per element with a value for the attribute, in document order */
+    struct rum_index_entry_s *entries;
+    size_t nentries;
+
+    /* the document's other indexes */
+    rum_index_t *next;
+};
+
+/* return the index of a document's elements of a tag by the value of one of its attributes,
+ * building it when first requested; the index belongs to the document and is freed with it
+ *
+ * the index reflects the document when it was built, so it must not be used after the document changes;
+ * threads sharing an unchanging document may ask for its indexes at the same time
+ */
+rum_index_t *rum_document_index(rum_document_t *document, const rum_tag_t *tag, const char *attr_name);
+
+/* find the indexed elements whose attribute has the given value
+ *
+ * up to max_matches elements are stored in matches in document order;
+ * the total number of matches is returned (or -1 on error)
+ */
+int rum_index_lookup(const rum_index_t *index, const char *value, const rum_element_t **matches, int max_matches);
+
+#endif /* RUM_INDEX__H */
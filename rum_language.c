@@ -16,7 +16,8 @@ rum_tag_t *
 rum_tag_new(rum_tag_t *parent, const char *name, int is_empty, int nattrs, rum_attr_t *attrs,
     rum_tag_display_method_t display_method)
 {
-    rum_tag_t *tag;
+    rum_tag_t *tag, *root;
+    int i;
 
     rum_set_error(NULL);
 
@@ -27,7 +28,7 @@ rum_tag_new(rum_tag_t *parent, const char *name, int is_empty, int nattrs, rum_a
     }
 
     /* create a tag instance */
-    if ((tag = malloc(sizeof(rum_tag_t))) == NULL) {
+    if ((tag = rum_malloc(sizeof(rum_tag_t))) == NULL) {
         rum_set_error("Unable to allocate memory for new tag specification");
         return NULL;
     }
@@ -36,11 +37,30 @@ rum_tag_new(rum_tag_t *parent, const char *name, int is_empty, int nattrs, rum_a
     tag->is_empty = is_empty;
     tag->nattrs = nattrs;
     tag->display = display_method;
+    tag->strpool = parent? parent->strpool : NULL;
+
+    /* number the tag within its language */
+    for (root = parent; root && root->parent; root = root->parent);
+    tag->id = root? root->ntags++ : 0;
+    tag->ntags = 1;
+    tag->next_sibling = NULL;
+    tag->first_child = NULL;
 
     /* copy the attribute information */
+    tag->has_typed_attrs = 0;
     if (nattrs && attrs) {
-        if ((tag->attrs = malloc(sizeof(rum_attr_t) * nattrs)) == NULL) {
-            free(tag);
+        for (i = 0; i < nattrs; ++i) {
+            if ((attrs[i].type == RUM_ATTR_ENUM) && (attrs[i].enum_values == NULL)) {
+                rum_free(tag, sizeof(rum_tag_t));
+                rum_set_error("Programmer error: Enumerated attribute must have a list of values");
+                return NULL;
+            }
+            if (attrs[i].type != RUM_ATTR_STRING) {
+                tag->has_typed_attrs = 1;
+            }
+        }
+        if ((tag->attrs = rum_malloc(sizeof(rum_attr_t) * nattrs)) == NULL) {
+            rum_free(tag, sizeof(rum_tag_t));
             rum_set_error("Unable to allocate memory for new tag specification");
             return NULL;
         }
@@ -63,6 +83,42 @@ rum_tag_new(rum_tag_t *parent, const char *name, int is_empty, int nattrs, rum_a
     return tag;
 }
 
+int
+rum_tag_get_id(const rum_tag_t *tag)
+{
+    rum_set_error(NULL);
+    if (tag == NULL) {
+        rum_set_error("Programmer error: Unable to get id of nonexistent tag");
+        return -1;
+    }
+    return tag->id;
+}
+
+rum_strpool_t *
+rum_tag_get_strpool(const rum_tag_t *tag)
+{
+    rum_set_error(NULL);
+    if (tag == NULL) {
+        rum_set_error("Programmer error: Unable to get settings of nonexistent tag");
+        return NULL;
+    }
+    return tag->strpool;
+}
+
+void
+rum_tag_set_strpool(rum_tag_t *tag, rum_strpool_t *pool)
+{
+    rum_tag_t *child;
+
+    rum_set_error(NULL);
+    if (tag) {
+        tag->strpool = pool;
+        for (child = tag->first_child; child; child = child->next_sibling) {
+            rum_tag_set_strpool(child, pool);
+        }
+    }
+}
+
 rum_tag_t *
 rum_tag_get_parent(const rum_tag_t *tag)
 {
@@ -140,6 +196,36 @@ rum_tag_get_attr_name(const rum_tag_t *tag, int index)
     return tag->attrs[index].name;
 }
 
+rum_attr_type_t
+rum_tag_get_attr_type(const rum_tag_t *tag, int index)
+{
+    rum_set_error(NULL);
+    if ((tag == NULL) || (index < 0) || (index >= tag->nattrs)) {
+        rum_set_error("Programmer error: Unable to get type of nonexistent attribute for tag");
+        return RUM_ATTR_STRING;
+    }
+    return tag->attrs[index].type;
+}
+
+int
+rum_tag_attr_handle(const rum_tag_t *tag, const char *attr_name)
+{
+    int i;
+
+    rum_set_error(NULL);
+    if ((tag == NULL) || (attr_name == NULL)) {
+        rum_set_error("Programmer error: Unable to get handle of nonexistent attribute");
+        return -1;
+    }
+    for (i = 0; i < tag->nattrs; ++i) {
+        if (!strcmp(attr_name, tag->attrs[i].name)) {
+            return i;
+        }
+    }
+    rum_set_error("Attribute not supported for this tag");
+    return -1;
+}
+
 const rum_tag_t *
 rum_tag_get_child(const rum_tag_t *root, const char *tag_name)
 {
@@ -157,6 +243,108 @@ rum_tag_get_child(const rum_tag_t *root, const char *tag_name)
     return NULL;
 }
 
+int
+rum_language_get_ntags(const rum_tag_t *root)
+{
+    rum_set_error(NULL);
+    if (root == NULL) {
+        rum_set_error("Programmer error: Unable to count tags of nonexistent language");
+        return 0;
+    }
+    return root->ntags;
+}
+
+void
+rum_language_get_tags(const rum_tag_t *root, const rum_tag_t **tags)
+{
+    const rum_tag_t *tag;
+
+    rum_set_error(NULL);
+    for (tag = root; tag; tag = tag->next_sibling) {
+        tags[tag->id] = tag;
+        rum_language_get_tags(tag->first_child, tags);
+    }
+}
+
+const rum_tag_t *
+rum_language_get_tag(const rum_tag_t *root, int id)
+{
+    const rum_tag_t *tag, *found;
+
+    rum_set_error(NULL);
+    for (tag = root; tag; tag = tag->next_sibling) {
+        if (tag->id == id) {
+            return tag;
+        }
+        if ((found = rum_language_get_tag(tag->first_child, id)) != NULL) {
+            return found;
+        }
+    }
+    return NULL;
+}
+
+/* continue an FNV-1a hash with a string (including its terminating null byte) */
+static uint64_t
+fingerprint_str(uint64_t hash, const char *str)
+{
+    return rum_hash_bytes(hash, str, strlen(str) + 1);
+}
+
+static uint64_t
+fingerprint_subtree(uint64_t hash, const rum_tag_t *tag)
+{
+    int i, j, marker;
+
+    for (; tag; tag = tag->next_sibling) {
+        hash = fingerprint_str(hash, tag->name);
+        hash = rum_hash_bytes(hash, &(tag->id), sizeof(tag->id));
+        hash = rum_hash_bytes(hash, &(tag->is_empty), sizeof(tag->is_empty));
+        hash = rum_hash_bytes(hash, &(tag->nattrs), sizeof(tag->nattrs));
+        for (i = 0; i < tag->nattrs; ++i) {
+            hash = fingerprint_str(hash, tag->attrs[i].name);
+            hash = rum_hash_bytes(hash, &(tag->attrs[i].type), sizeof(tag->attrs[i].type));
+            if (tag->attrs[i].type == RUM_ATTR_ENUM) {
+                for (j = 0; tag->attrs[i].enum_values[j]; ++j) {
+                    hash = fingerprint_str(hash, tag->attrs[i].enum_values[j]);
+                }
+            }
+        }
+
+        /* bracket the children, so that different tree shapes hash differently */
+        marker = '(';
+        hash = rum_hash_bytes(hash, &marker, sizeof(marker));
+        hash = fingerprint_subtree(hash, tag->first_child);
+        marker = ')';
+        hash = rum_hash_bytes(hash, &marker, sizeof(marker));
+    }
+    return hash;
+}
+
+uint64_t
+rum_language_fingerprint(const rum_tag_t *root)
+{
+    rum_set_error(NULL);
+    if (root == NULL) {
+        rum_set_error("Programmer error: Unable to fingerprint nonexistent language");
+        return 0;
+    }
+    return fingerprint_subtree(RUM_HASH_INIT, root);
+}
+
+/* return a string representation of an attribute type */
+static const char *
+rum_attr_type_str(rum_attr_type_t type)
+{
+    switch (type) {
+        case RUM_ATTR_STRING:  return("string");
+        case RUM_ATTR_INTEGER: return("integer");
+        case RUM_ATTR_DECIMAL: return("decimal");
+        case RUM_ATTR_BOOLEAN: return("boolean");
+        case RUM_ATTR_ENUM:    return("enum");
+    }
+    return("(invalid type)");
+}
+
 static void
 rum_display_language_subtree(const rum_tag_t *root, int indent_level)
 {
@@ -168,8 +356,8 @@ rum_display_language_subtree(const rum_tag_t *root, int indent_level)
         printf("%*sTAG %s (%s)\n", (indent_level * 3), " ", tag->name,
             (tag->is_empty? "empty": "nonempty"));
         for (i = 0; i < tag->nattrs; ++i) {
-            printf("%*sATTR %s (%s)\n", (indent_level * 3), " ", tag->attrs[i].name,
-                (tag->attrs[i].is_required? "required" : "optional"));
+            printf("%*sATTR %s (%s, %s)\n", (indent_level * 3), " ", tag->attrs[i].name,
+                (tag->attrs[i].is_required? "required" : "optional"), rum_attr_type_str(tag->attrs[i].type));
         }
         printf("\n");
         if (tag->first_child) {
@@ -9,8 +9,18 @@
 #ifndef RUM_LANGUAGE__H
 #define RUM_LANGUAGE__H
 
+#include <stdint.h>
 #include <rum_types.h>
 
+/* types an attribute value can be declared as */
+typedef enum {
+    RUM_ATTR_STRING,  /* any text (the default) */
+    RUM_ATTR_INTEGER, /* optionally signed decimal integer that fits in a long */
+    RUM_ATTR_DECIMAL, /* optionally signed decimal number, with optional fraction and exponent */
+    RUM_ATTR_BOOLEAN, /* "true", "false", "1" or "0" (or no value, meaning true) */
+    RUM_ATTR_ENUM     /* one of a fixed list of strings */
+} rum_attr_type_t;
+
 /* language definition of an XML attribute (name="value") */
 struct rum_attr_s {
     /* this attribute's name */
@@ -22,6 +32,16 @@ struct rum_attr_s {
      * this value is set but ignored, so all attributes are treated as optional
      */
     int is_required;
+
+    /* type of this attribute's values; values of types other than RUM_ATTR_STRING are validated
+     * and converted to binary form when set, and may be retrieved with the typed element accessors
+     */
+    rum_attr_type_t type;
+
+    /* for RUM_ATTR_ENUM, the NULL-terminated list of allowed values
+     * (an element stores the value's index in this list, rather than a copy of the string)
+     */
+    const char **enum_values;
 };
 
 /* language definition of an XML tag: <tag [attrs] /> if empty, <tag [attrs]> ... </tag> otherwise */
@@ -29,6 +49,12 @@ struct rum_tag_s {
     /* the tag itself */
     const char *name;
 
+    /* this tag's number within its language, in order of creation (the root tag is 0) */
+    int id;
+
+    /* for the root tag, the number of tags in the language (unused for other tags) */
+    int ntags;
+
     /* whether this is an empty tag (boolean) */
     int is_empty;
 
@@ -36,6 +62,9 @@ struct rum_tag_s {
     int nattrs;
     rum_attr_t *attrs;
 
+    /* whether any of this tag's attributes has a type other than RUM_ATTR_STRING (boolean) */
+    int has_typed_attrs;
+
     /* this tag's place in the language's tag tree;
      * parent is NULL if this is the root tag, otherwise this tag is only valid within parent */
     rum_tag_t *parent;
@@ -44,6 +73,9 @@ struct rum_tag_s {
 
     /* a method to display elements of this tag type */
     rum_tag_display_method_t display;
+
+    /* if not NULL, attribute values and content of elements of this tag are interned here */
+    rum_strpool_t *strpool;
 };
 
 /* constructor */
@@ -51,6 +83,8 @@ rum_tag_t *rum_tag_new(rum_tag_t *parent, const char *name, int is_empty, int na
         rum_tag_display_method_t display_method);
 
 /* accessors */
+int rum_tag_get_id(const rum_tag_t *tag);
+rum_strpool_t *rum_tag_get_strpool(const rum_tag_t *tag);
 rum_tag_t *rum_tag_get_parent(const rum_tag_t *tag);
 rum_tag_t *rum_tag_get_next_sibling(const rum_tag_t *tag);
 rum_tag_t *rum_tag_get_first_child(const rum_tag_t *tag);
@@ -58,10 +92,39 @@ const char *rum_tag_get_name(const rum_tag_t *tag);
 int rum_tag_get_is_empty(const rum_tag_t *tag);
 int rum_tag_get_nattrs(const rum_tag_t *tag);
 const char *rum_tag_get_attr_name(const rum_tag_t *tag, int index);
+rum_attr_type_t rum_tag_get_attr_type(const rum_tag_t *tag, int index);
+
+/* return a handle for the named attribute of a tag, or -1 if the tag does not support it
+ *
+ * the handle is the attribute's index in the tag specification, so it can be resolved once
+ * and then passed to rum_element_get_value_by_handle() for any element of this tag
+ */
+int rum_tag_attr_handle(const rum_tag_t *tag, const char *attr_name);
+
+/* intern decoded attribute values and content of elements of this tag and all its descendants
+ * (tags added later inherit their parent's pool); pool may be NULL to stop interning
+ *
+ * the pool must outlive all documents parsed with the language
+ */
+void rum_tag_set_strpool(rum_tag_t *tag, rum_strpool_t *pool);
 
 /* return tag corresponding to tag_name, or NULL if the requested tag is not among root's children */
 const rum_tag_t *rum_tag_get_child(const rum_tag_t *root, const char *tag_name);
 
+/* return the number of tags in a language */
+int rum_language_get_ntags(const rum_tag_t *root);
+
+/* fill tags (which must have room for rum_language_get_ntags() entries) so that tags[id] is the tag with that id */
+void rum_language_get_tags(const rum_tag_t *root, const rum_tag_t **tags);
+
+/* return the tag with the given id, or NULL if the language has no such tag */
+const rum_tag_t *rum_language_get_tag(const rum_tag_t *root, int id);
+
+/* return a hash of a language's structure (tags, attributes and their types),
+ * so that data derived from a document can be checked against the language that produced it
+ */
+uint64_t rum_language_fingerprint(const rum_tag_t *root);
+
 /* print language in human-readable form */
 void rum_display_language(const rum_tag_t *root);
 
@@ -12,8 +12,6 @@
 #include <rump.h>
 #include "rum_private.h"
 
-#define DEBUG 0
-
 char *
 rum_state_str(rum_state_t state)
 {
@@ -40,6 +38,117 @@ rum_state_str(rum_state_t state)
     return("(invalid state)");
 }
 
+/* close a set of wanted tags over their ancestors and descendants */
+static rum_projection_t *
+new_projection(const rum_tag_t *language, unsigned char *wanted)
+{
+    rum_projection_t *projection;
+    const rum_tag_t **tags;
+    unsigned char *below;
+    int id, ntags = rum_language_get_ntags(language);
+
+    if ((projection = rum_malloc(sizeof(rum_projection_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for projection");
+        return NULL;
+    }
+    projection->ntags = ntags;
+    projection->keep = wanted;
+    if ((tags = rum_malloc(ntags * sizeof(rum_tag_t *))) == NULL) {
+        rum_free(projection, sizeof(rum_projection_t));
+        rum_set_error("Unable to allocate memory for projection");
+        return NULL;
+    }
+    if ((below = rum_malloc(ntags)) == NULL) {
+        rum_free(tags, ntags * sizeof(rum_tag_t *));
+        rum_free(projection, sizeof(rum_projection_t));
+        rum_set_error("Unable to allocate memory for projection");
+        return NULL;
+    }
+    rum_language_get_tags(language, tags);
+
+    /* a tag is always created after its parent, so children have higher ids */
+    for (id = 0; id < ntags; ++id) {
+        below[id] = wanted[id] || (id && below[tags[id]->parent->id]);
+    }
+    for (id = ntags - 1; id > 0; --id) {
+        if (wanted[id]) {
+            wanted[tags[id]->parent->id] = 1;
+        }
+    }
+    for (id = 0; id < ntags; ++id) {
+        wanted[id] = wanted[id] || below[id];
+    }
+
+    rum_free(below, ntags);
+    rum_free(tags, ntags * sizeof(rum_tag_t *));
+    return projection;
+}
+
+rum_projection_t *
+rum_projection_new(const rum_tag_t *language, const rum_tag_t **tags, int ntags)
+{
+    rum_projection_t *projection;
+    unsigned char *wanted;
+    int i, n;
+
+    rum_set_error(NULL);
+    if ((language == NULL) || ((tags == NULL) && (ntags > 0))) {
+        rum_set_error("Programmer error: Unable to create projection from nonexistent tags");
+        return NULL;
+    }
+    n = rum_language_get_ntags(language);
+    if ((wanted = rum_malloc(n)) == NULL) {
+        rum_set_error("Unable to allocate memory for projection");
+        return NULL;
+    }
+    memset(wanted, 0, n);
+    for (i = 0; i < ntags; ++i) {
+        if ((tags[i] == NULL) || (rum_tag_get_id(tags[i]) >= n)
+            || (rum_language_get_tag(language, rum_tag_get_id(tags[i])) != tags[i])) {
+            rum_free(wanted, n);
+            rum_set_error("Programmer error: Projection tag is not part of language");
+            return NULL;
+        }
+        wanted[rum_tag_get_id(tags[i])] = 1;
+    }
+    if ((projection = new_projection(language, wanted)) == NULL) {
+        rum_free(wanted, n);
+    }
+    return projection;
+}
+
+rum_projection_t *
+rum_projection_from_query(const rum_query_t *query)
+{
+    rum_projection_t *projection;
+    unsigned char *wanted;
+
+    rum_set_error(NULL);
+    if (query == NULL) {
+        rum_set_error("Programmer error: Unable to create projection from nonexistent query");
+        return NULL;
+    }
+    if ((wanted = rum_malloc(query->ntags)) == NULL) {
+        rum_set_error("Unable to allocate memory for projection");
+        return NULL;
+    }
+    memcpy(wanted, query->steps[query->nsteps - 1].tags, query->ntags);
+    if ((projection = new_projection(query->language, wanted)) == NULL) {
+        rum_free(wanted, query->ntags);
+    }
+    return projection;
+}
+
+void
+rum_projection_free(rum_projection_t *projection)
+{
+    rum_set_error(NULL);
+    if (projection) {
+        rum_free(projection->keep, projection->ntags);
+        rum_free(projection, sizeof(rum_projection_t));
+    }
+}
+
 rum_parser_t *
 rum_parser_new()
 {
@@ -60,20 +169,55 @@ rum_parser_free(rum_parser_t **headp)
     }
 }
 
+void
+rum_parser_set_options(rum_parser_t *head, const rum_parse_options_t *options)
+{
+    rum_set_error(NULL);
+    if (head) {
+        head->options = options;
+    }
+}
+
 int
 rum_parser_push(rum_parser_t **headp, rum_state_t state)
 {
     rum_parser_t *parser;
 
     rum_set_error(NULL);
-    if ((headp == NULL) || ((parser = malloc(sizeof(rum_parser_t))) == NULL)) {
-        rum_set_error("Unable to allocate memory for parser state");
+    if (headp == NULL) {
+        rum_set_error("Programmer error: Unable to push onto nonexistent stack");
         return -1;
     }
+
+    /* reuse a state popped off earlier if there is one (the rest of the spare list goes with it) */
+    if (*headp && (*headp)->spare) {
+        parser = (*headp)->spare;
+        (*headp)->spare = NULL;
+    } else {
+        if ((parser = rum_malloc(sizeof(rum_parser_t))) == NULL) {
+            rum_set_error("Unable to allocate memory for parser state");
+            return -1;
+        }
+        parser->attr_name = NULL;
+        parser->attr_name_size = 0;
+        parser->skip_names = NULL;
+        parser->skip_capacity = 0;
+        parser->skip_attrs = NULL;
+        parser->skip_attrs_capacity = 0;
+        parser->spare = NULL;
+    }
     parser->state = state;
     parser->quote_char = 0;
-    parser->attr_name = NULL;
+    rum_parser_clear_attr_name(parser);
     parser->element = NULL;
+    parser->start = 0;
+    parser->tag_start = 0;
+    parser->options = *headp? (*headp)->options : NULL;
+    parser->skip_len = 0;
+    parser->skip_attrs_len = 0;
+    parser->skip_in_content = 0;
+    parser->skip_entity_len = 0;
+    parser->depth = *headp? ((*headp)->depth + 1) : 0;
     parser->prev = *headp;
     parser->next = NULL;
     if (*headp) {
@@ -83,6 +227,21 @@ rum_parser_push(rum_parser_t **headp, rum_state_t state)
     return 0;
 }
 
+/* free a parser state and its list of spare states */
+static void
+free_states(rum_parser_t *parser)
+{
+    rum_parser_t *spare;
+
+    for (; parser; parser = spare) {
+        spare = parser->spare;
+        rum_free(parser->attr_name, parser->attr_name_size);
+        rum_free(parser->skip_names, parser->skip_capacity);
+        rum_free(parser->skip_attrs, parser->skip_attrs_capacity);
+        rum_free(parser, sizeof(rum_parser_t));
+    }
+}
+
 rum_element_t *
 rum_parser_pop(rum_parser_t **headp)
 {
@@ -102,83 +261,350 @@ rum_parser_pop(rum_parser_t **headp)
     *headp = old_head->prev;
     if (*headp) {
         (*headp)->next = NULL;
+        (*headp)->spare = old_head;
+    } else {
+        free_states(old_head);
     }
-    rum_parser_clear_attr_name(old_head);
-    free(old_head);
     return element;
 }
 
+void
+rum_parser_reset(rum_parser_t **headp)
+{
+    rum_parser_t *head;
+
+    rum_set_error(NULL);
+    if ((headp == NULL) || (*headp == NULL)) {
+        return;
+    }
+
+    /* states above the first are popped, so they are kept for reuse rather than freed */
+    while ((*headp)->prev) {
+        rum_parser_pop(headp);
+    }
+    head = *headp;
+    head->state = RUM_CONTENT;
+    head->quote_char = 0;
+    rum_parser_clear_attr_name(head);
+    head->element = NULL;
+    head->start = 0;
+    head->tag_start = 0;
+    head->skip_len = 0;
+    head->skip_attrs_len = 0;
+    head->skip_in_content = 0;
+    head->skip_entity_len = 0;
+}
+
 void
 rum_parser_clear_attr_name(rum_parser_t *parser)
 {
     rum_set_error(NULL);
-    if (parser) {
-        if (parser->attr_name) {
-            free(parser->attr_name);
+    if (parser && parser->attr_name) {
+        parser->attr_name[0] = 0;
+    }
+}
+
+/* remember the current buffer substring as the most recently parsed attribute name */
+static int
+save_attr_name(rum_parser_t *parser, rum_buffer_t *buffer)
+{
+    const char *attr_name;
+    size_t len, size;
+    char *storage;
+
+    if ((attr_name = rum_buffer_get_substr(buffer)) == NULL) {
+        return -1;
+    }
+    len = strlen(attr_name);
+    if (len + 1 > parser->attr_name_size) {
+        for (size = parser->attr_name_size? parser->attr_name_size : 32; len + 1 > size; size *= 2);
+        if ((storage = rum_realloc(parser->attr_name, parser->attr_name_size, size)) == NULL) {
+            rum_set_error("Unable to allocate memory for parser state");
+            return -1;
+        }
+        parser->attr_name = storage;
+        parser->attr_name_size = size;
+    }
+    memcpy(parser->attr_name, attr_name, len + 1);
+    return 0;
+}
+
+/* add the current buffer substring to the names of a skipped subtree's open elements */
+static int
+skip_push_name(rum_parser_t *parser, rum_buffer_t *buffer)
+{
+    size_t len = buffer->substr_end - buffer->substr_start + 1, capacity;
+    char *names;
+
+    if (parser->skip_len + len + 1 > parser->skip_capacity) {
+        for (capacity = parser->skip_capacity? parser->skip_capacity : 64; parser->skip_len + len + 1 > capacity;
+             capacity *= 2);
+        if ((names = rum_realloc(parser->skip_names, parser->skip_capacity, capacity)) == NULL) {
+            rum_set_error("Unable to allocate memory for parser state");
+            return -1;
+        }
+        parser->skip_names = names;
+        parser->skip_capacity = capacity;
+    }
+    memcpy(parser->skip_names + parser->skip_len, buffer->buf + buffer->substr_start, len);
+    parser->skip_len += len;
+    parser->skip_names[(parser->skip_len)++] = 0;
+    parser->skip_attrs_len = 0;
+    rum_buffer_reset_substr(buffer);
+    return 0;
+}
+
+/* add the current buffer substring to the attribute names of a skipped tag, unless it is already
+ * there, which is an error just as it would be for a kept element
+ */
+static int
+skip_add_attr(rum_parser_t *parser, rum_buffer_t *buffer)
+{
+    size_t len = buffer->substr_end - buffer->substr_start + 1, capacity, i;
+    char *attrs;
+
+    for (i = 0; i < parser->skip_attrs_len; i += strlen(parser->skip_attrs + i) + 1) {
+        if (!strncmp(parser->skip_attrs + i, buffer->buf + buffer->substr_start, len)
+            && (parser->skip_attrs[i + len] == 0)) {
+            rum_set_error("Attribute may not be specified twice in same element");
+            return -1;
+        }
+    }
+    if (parser->skip_attrs_len + len + 1 > parser->skip_attrs_capacity) {
+        for (capacity = parser->skip_attrs_capacity? parser->skip_attrs_capacity : 64;
+             parser->skip_attrs_len + len + 1 > capacity; capacity *= 2);
+        if ((attrs = rum_realloc(parser->skip_attrs, parser->skip_attrs_capacity, capacity)) == NULL) {
+            rum_set_error("Unable to allocate memory for parser state");
+            return -1;
+        }
+        parser->skip_attrs = attrs;
+        parser->skip_attrs_capacity = capacity;
+    }
+    memcpy(parser->skip_attrs + parser->skip_attrs_len, buffer->buf + buffer->substr_start, len);
+    parser->skip_attrs_len += len;
+    parser->skip_attrs[(parser->skip_attrs_len)++] = 0;
+    rum_buffer_reset_substr(buffer);
+    return 0;
+}
+
+/* check a character of a skipped subtree's attribute value or content, as decoding it would,
+ * without keeping the text: '<' is not allowed, and '&' must start a known entity reference
+ */
+static int
+skip_check_char(rum_parser_t *parser, int c)
+{
+    size_t len = parser->skip_entity_len;
+
+    if (c == '<') {
+        rum_set_error("'<' not allowed here");
+        return -1;
+    }
+    if (c == '&') {
+        if (len) {
+            rum_set_error("'&' not allowed here");
+            return -1;
+        }
+        parser->skip_entity[0] = '&';
+        parser->skip_entity_len = 1;
+    } else if (len && (c == ';')) {
+        parser->skip_entity_len = 0;
+        if ((len > RUM_PARSER_ENTITY_SIZE) || (rum_entity_char(parser->skip_entity, len) < 0)) {
+            rum_set_error("Unknown entity");
+            return -1;
+        }
+    } else if (len) {
+        /* a name too long to keep (or not ASCII) cannot be a known entity */
+        if ((len < RUM_PARSER_ENTITY_SIZE) && (c < 0x80)) {
+            parser->skip_entity[len] = c;
+        } else {
+            len = RUM_PARSER_ENTITY_SIZE;
+        }
+        parser->skip_entity_len = len + 1;
+    }
+    return 0;
+}
+
+/* finish checking a skipped subtree's attribute value or content, in which an entity reference
+ * must not be left open
+ */
+static int
+skip_end_text(rum_parser_t *parser)
+{
+    parser->skip_in_content = 0;
+    if (parser->skip_entity_len) {
+        parser->skip_entity_len = 0;
+        rum_set_error("'&' not allowed here");
+        return -1;
+    }
+    return 0;
+}
+
+/* remove the innermost open element of a skipped subtree, first checking that the current buffer substring
+ * matches its name unless buffer is NULL, and popping the parser state when the subtree is done
+ */
+static rum_element_t *
+skip_pop_name(rum_parser_t **headp, rum_buffer_t *buffer)
+{
+    rum_parser_t *parser = *headp;
+    size_t start;
+
+    for (start = parser->skip_len - 1; start && parser->skip_names[start - 1]; --start);
+    if (buffer) {
+        if ((buffer->substr_end - buffer->substr_start + 1 != parser->skip_len - 1 - start)
+            || memcmp(buffer->buf + buffer->substr_start, parser->skip_names + start, parser->skip_len - 1 - start)) {
+            rum_set_error("Close tag does not match open tag");
+            return NULL;
+        }
+        rum_buffer_reset_substr(buffer);
+    }
+    parser->skip_len = start;
+    if (parser->skip_len == 0) {
+        rum_parser_pop(headp);
+    }
+    return NULL;
+}
+
+/* return the child of a tag named by the current buffer substring, or NULL if there is none */
+static const rum_tag_t *
+find_child_tag(const rum_tag_t *parent, rum_buffer_t *buffer)
+{
+    const rum_tag_t *tag;
+    size_t len = buffer->substr_end - buffer->substr_start + 1;
+
+    for (tag = parent->first_child; tag; tag = tag->next_sibling) {
+        if (!strncmp(tag->name, buffer->buf + buffer->substr_start, len) && (tag->name[len] == 0)) {
+            return tag;
         }
-        parser->attr_name = NULL;
     }
+    return NULL;
 }
 
 /* push a new parser state on the stack when a new element is encountered */
 static int
 start_element(rum_parser_t **headp, rum_state_t state, const rum_tag_t *language, rum_buffer_t *buffer)
 {
-    char *tag_name;
+    const char *tag_name;
+    const rum_tag_t *tag;
+    const rum_projection_t *projection = (*headp)->options? (*headp)->options->projection : NULL;
+    rum_parse_stats_t *stats = (*headp)->options? (*headp)->options->stats : NULL;
     rum_element_t *parent = (*headp)->element;
+    size_t start = (*headp)->tag_start, parent_start = (*headp)->start;
 
     rum_set_error(NULL);
-    if ((tag_name = rum_buffer_clone_substr(buffer)) == NULL) {
+
+    /* with a projection, a subtree that is not needed gets a single parser state that only tracks names */
+    if (projection && parent && ((tag = find_child_tag(parent->tag, buffer)) != NULL)
+        && !projection->keep[tag->id]) {
+        if (rum_parser_push(headp, state) < 0) {
+            return -1;
+        }
+        (*headp)->skip_in_content = (state == RUM_CONTENT);
+        return skip_push_name(*headp, buffer);
+    }
+
+    if ((tag_name = rum_buffer_get_substr(buffer)) == NULL) {
         return -1;
     }
     rum_buffer_reset_substr(buffer);
     if (rum_parser_push(headp, state) < 0) {
-        free(tag_name);
         return -1;
     }
-    if (((*headp)->element = rum_element_new(parent, language, tag_name)) == NULL) {
-        free(tag_name);
+    if (((*headp)->element = rum_element_new_cached((*headp)->options? (*headp)->options->cache : NULL,
+                                                    parent, language, tag_name)) == NULL) {
         return -1;
     }
-    free(tag_name);
+    (*headp)->start = start;
+    (*headp)->element->offset = parent? (start - parent_start) : start;
+    if (stats) {
+        ++(stats->elements);
+        if ((*headp)->depth > stats->max_depth) {
+            stats->max_depth = (*headp)->depth;
+        }
+    }
     return 0;
 }
 
-/* add an attribute to the element, using the current buffer substring as the name, with an empty value */
+/* pop the parser state of an element at its final '>', recording the element's length,
+ * and hand the element to the element-complete callback, if any
+ */
+static rum_element_t *
+end_element(rum_parser_t **headp, rum_buffer_t *buffer)
+{
+    const rum_parse_options_t *options = (*headp)->options;
+    rum_element_t *element;
+    int action;
+
+    (*headp)->element->length = RUM_BUFFER_OFFSET(buffer) + 1 - (*headp)->start;
+    rum_buffer_reset_substr(buffer);
+    element = rum_parser_pop(headp);
+
+    if (options && options->on_complete && element->parent) {
+        action = options->on_complete(element, options->complete_data);
+
+        /* library calls made by the callback must not look like a parse error */
+        rum_set_error(NULL);
+        if (action == RUM_ELEMENT_RELEASE) {
+            rum_element_release(options->cache, element);
+            return (*headp)->element;
+        }
+        if (action == RUM_ELEMENT_TAKE) {
+            return (*headp)->element;
+        }
+    }
+    return element;
+}
+
+/* count an attribute value or content set on the current element, with the entity references
+ * decoded from it (each '&' starts one, since any other use is an error)
+ */
+static void
+count_value(rum_parser_t *parser, const char *value, int is_attr)
+{
+    rum_parse_stats_t *stats = parser->options? parser->options->stats : NULL;
+
+    if (stats) {
+        if (is_attr) {
+            ++(stats->attributes);
+        }
+        for (; (value = strchr(value, '&')) != NULL; ++value) {
+            ++(stats->entities);
+        }
+    }
+}
+
+/* add an attribute to the current element, using the current buffer substring as the name, with an empty value */
 static int
-add_empty_value(rum_element_t *element, rum_buffer_t *buffer)
+add_empty_value(rum_parser_t *parser, rum_buffer_t *buffer)
 {
-    char *attr_name;
+    const char *attr_name;
 
     rum_set_error(NULL);
-    if ((attr_name = rum_buffer_clone_substr(buffer)) == NULL) {
+    if ((attr_name = rum_buffer_get_substr(buffer)) == NULL) {
         return -1;
     }
-    if (rum_element_set_value(element, attr_name, "") < 0) {
-        free(attr_name);
+    if (rum_element_set_value(parser->element, attr_name, "") < 0) {
         return -1;
     }
-    free(attr_name);
+    count_value(parser, "", 1);
     rum_buffer_reset_substr(buffer);
     return 0;
 }
 
-/* if an element does not already have content, set its content to the current buffer substring */
+/* if the current element does not already have content, set its content to the current buffer substring */
 static int
-handle_content(rum_element_t *element, rum_buffer_t *buffer)
+handle_content(rum_parser_t *parser, rum_buffer_t *buffer)
 {
-    char *content;
+    const char *content;
 
     rum_set_error(NULL);
-    if ((element != NULL) && (rum_element_get_content(element) == NULL)) {
-        if ((content = rum_buffer_clone_substr(buffer)) == NULL) {
+    if ((parser->element != NULL) && (rum_element_get_content(parser->element) == NULL)) {
+        if ((content = rum_buffer_get_substr(buffer)) == NULL) {
             return -1;
         }
-        if (rum_element_set_content(element, content) < 0) {
-            free(content);
+        if (rum_element_set_content(parser->element, content) < 0) {
             return -1;
         }
-        free(content);
+        count_value(parser, content, 0);
         rum_buffer_reset_substr(buffer);
     }
     return 0;
@@ -197,22 +623,18 @@ rum_parser_error(rum_parser_t *parser, char *errmsg)
 static void
 rum_parser_set_state(rum_parser_t *parser, rum_state_t state)
 {
-    const char *name;
-
-    if (DEBUG) {
-        name = parser? rum_element_get_name(parser->element) : NULL;
-        printf("TAG %s %s -> %s\n", (name? name : "(none)"), rum_state_str(parser->state), rum_state_str(state));
-        rum_set_error(NULL);
+    if (parser->options && parser->options->trace) {
+        rum_trace_record(parser->options->trace, parser->state, state, parser->depth);
     }
     parser->state = state;
 }
 
-rum_element_t *
-rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffer_t *buffer, int c)
+static rum_element_t *
+parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffer_t *buffer, int c)
 {
-    char *attr_value;
-    const char *tag_name;
+    const char *attr_value, *tag_name;
     rum_element_t *element;
+    int skipping;
 
     rum_set_error(NULL);
 
@@ -221,24 +643,20 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
         return rum_parser_error(*headp, "Programmer error: Parser not configured properly");
     }
 
+    if ((*headp)->options && (*headp)->options->stats) {
+        (*headp)->options->stats->bytes += RUM_UTF8_LENGTH(c);
+    }
+
     if (!RUM_PARSER_IS_LEGAL_CHAR(c)) {
         return rum_parser_error(*headp, "Illegal character in input");
     }
 
-    if (DEBUG) {
-        printf("[%c] ", c);
-        if (buffer->substr_start) {
-            int i;
-            printf("substr=[");
-            for (i = buffer->substr_start; i <= buffer->substr_end; ++i) {
-                putchar(buffer->buf[i]);
-            }
-            printf("]");
-        }
-        printf("\n");
+    if ((*headp)->options && (*headp)->options->trace) {
+        (*headp)->options->trace->offset = RUM_BUFFER_OFFSET(buffer);
     }
 
     element = (*headp)->element;
+    skipping = ((*headp)->skip_len > 0);
 
     switch ((*headp)->state) {
         case RUM_CONTENT: /* not within any tag */
@@ -246,7 +664,15 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
             /* '<' ends this stretch of content and starts a new tag */
             if (c == '<') {
                 rum_parser_set_state(*headp, RUM_START_TAG);
-                if (handle_content((*headp)->element, buffer) < 0) {
+                (*headp)->tag_start = RUM_BUFFER_OFFSET(buffer);
+                if ((skipping && (*headp)->skip_in_content && (skip_end_text(*headp) < 0))
+                    || (handle_content(*headp, buffer) < 0)) {
+                    return rum_parser_error(*headp, rum_last_error());
+                }
+
+            /* content of a skipped subtree is checked but not kept */
+            } else if (skipping) {
+                if ((*headp)->skip_in_content && (skip_check_char(*headp, c) < 0)) {
                     return rum_parser_error(*headp, rum_last_error());
                 }
 
@@ -276,7 +702,7 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
                 rum_parser_set_state(*headp, RUM_OPENCOMMENT_BANG);
             } else if (c == '/') {
                 rum_parser_set_state(*headp, RUM_CLOSETAG_START);
-                if ((*headp)->element == NULL) {
+                if (((*headp)->element == NULL) && !skipping) {
                     return rum_parser_error(*headp, "Close tag without open tag");
                 }
             } else if (RUM_PARSER_IS_LEGAL_FIRST_CHAR(c)) {
@@ -296,7 +722,7 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
         case RUM_CLOSEPI: /* <?...? */
             if (c == '>') {
                 rum_parser_set_state(*headp, RUM_CONTENT);
-                if (handle_content((*headp)->element, buffer) < 0) {
+                if (handle_content(*headp, buffer) < 0) {
                     return rum_parser_error(*headp, rum_last_error());
                 }
             } else {
@@ -338,7 +764,7 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
         case RUM_CLOSECOMMENT_DASHDASH: /* <!--...-- */
             if (c == '>') {
                 rum_parser_set_state(*headp, RUM_CONTENT);
-                if (handle_content((*headp)->element, buffer) < 0) {
+                if (handle_content(*headp, buffer) < 0) {
                     return rum_parser_error(*headp, rum_last_error());
                 }
             } else {
@@ -350,6 +776,14 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
         case RUM_OPENTAG_NAME: /* <T... */
             if (RUM_PARSER_IS_LEGAL_NAME_CHAR(c)) {
                 rum_buffer_track_substr(buffer);
+
+            /* within a skipped subtree, only the name is needed, to match the close tag */
+            } else if (skipping && (RUM_PARSER_IS_SPACE(c) || (c == '>') || (c == '/'))) {
+                rum_parser_set_state(*headp, (c == '>')? RUM_CONTENT : ((c == '/')? RUM_OPENTAG_EMPTY : RUM_OPENTAG_SPACE));
+                if (skip_push_name(*headp, buffer) < 0) {
+                    return rum_parser_error(*headp, rum_last_error());
+                }
+                (*headp)->skip_in_content = (c == '>');
             } else if (RUM_PARSER_IS_SPACE(c)) {
                 /* this is the state to return to when the new state is popped */
                 rum_parser_set_state(*headp, RUM_CONTENT);
@@ -364,7 +798,7 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
                     return rum_parser_error(*headp, rum_last_error());
                 }
                 element = (*headp)->element;
-                if (rum_element_get_is_empty((*headp)->element)) {
+                if (element && rum_element_get_is_empty(element)) {
                     return rum_parser_error(*headp, "Empty tag not closed with '/>'");
                 }
             } else if (c == '/') {
@@ -384,7 +818,8 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
                 rum_parser_set_state(*headp, RUM_OPENTAG_EMPTY);
             } else if (c == '>') {
                 rum_parser_set_state(*headp, RUM_CONTENT);
-                if (rum_element_get_is_empty((*headp)->element)) {
+                (*headp)->skip_in_content = skipping;
+                if (!skipping && rum_element_get_is_empty((*headp)->element)) {
                     return rum_parser_error(*headp, "Empty tag not closed with '/>'");
                 }
             } else if (RUM_PARSER_IS_LEGAL_FIRST_CHAR(c)) {
@@ -396,12 +831,14 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
             break;
 
         case RUM_OPENTAG_EMPTY: /* <TAG ... / */
-            if (c == '>') {
+            if (skipping && (c == '>')) {
+                rum_parser_set_state(*headp, RUM_CONTENT);
+                element = skip_pop_name(headp, NULL);
+            } else if (c == '>') {
                 if (!rum_element_get_is_empty((*headp)->element)) {
                     return rum_parser_error(*headp, "Nonempty tag closed with '/>'");
                 }
-                element = rum_parser_pop(headp);
-                rum_buffer_reset_substr(buffer);
+                element = end_element(headp, buffer);
             } else {
                 return rum_parser_error(*headp, "'/' not followed by '>' in open tag");
             }
@@ -410,19 +847,27 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
         case RUM_OPENTAG_ATTRNAME: /* <TAG ... A... */
             if (RUM_PARSER_IS_LEGAL_NAME_CHAR(c)) {
                 rum_buffer_track_substr(buffer);
+
+            /* attributes of skipped elements are checked for syntax only */
+            } else if (skipping && (RUM_PARSER_IS_SPACE(c) || (c == '>') || (c == '='))) {
+                rum_parser_set_state(*headp, (c == '>')? RUM_CONTENT : ((c == '=')? RUM_OPENTAG_ATTREQUALS : RUM_OPENTAG_SPACE));
+                if (skip_add_attr(*headp, buffer) < 0) {
+                    return rum_parser_error(*headp, rum_last_error());
+                }
+                (*headp)->skip_in_content = (c == '>');
             } else if (RUM_PARSER_IS_SPACE(c)) {
                 rum_parser_set_state(*headp, RUM_OPENTAG_SPACE);
-                if (add_empty_value((*headp)->element, buffer) < 0) {
+                if (add_empty_value(*headp, buffer) < 0) {
                     return rum_parser_error(*headp, rum_last_error());
                 }
             } else if (c == '>') {
                 rum_parser_set_state(*headp, RUM_CONTENT);
-                if (add_empty_value((*headp)->element, buffer) < 0) {
+                if (add_empty_value(*headp, buffer) < 0) {
                     return rum_parser_error(*headp, rum_last_error());
                 }
             } else if (c == '=') {
                 rum_parser_set_state(*headp, RUM_OPENTAG_ATTREQUALS);
-                if (((*headp)->attr_name = rum_buffer_clone_substr(buffer)) == NULL) {
+                if (save_attr_name(*headp, buffer) < 0) {
                     return rum_parser_error(*headp, rum_last_error());
                 }
                 rum_buffer_reset_substr(buffer);
@@ -441,17 +886,26 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
             break;
 
         case RUM_OPENTAG_ATTRVALUE: /* <TAG ... ATTR=Q... where Q is (*headp)->quote_char */
-            if (c != (*headp)->quote_char) {
+            if (skipping) {
+                if (c == (*headp)->quote_char) {
+                    rum_parser_set_state(*headp, RUM_OPENTAG_HAVEVALUE);
+                    if (skip_end_text(*headp) < 0) {
+                        return rum_parser_error(*headp, rum_last_error());
+                    }
+                } else if (skip_check_char(*headp, c) < 0) {
+                    return rum_parser_error(*headp, rum_last_error());
+                }
+            } else if (c != (*headp)->quote_char) {
                 rum_buffer_track_substr(buffer);
             } else /* have end quote */ {
                 rum_parser_set_state(*headp, RUM_OPENTAG_HAVEVALUE);
-                if ((attr_value = rum_buffer_clone_substr(buffer)) == NULL) {
+                if ((attr_value = rum_buffer_get_substr(buffer)) == NULL) {
                     return rum_parser_error(*headp, rum_last_error());
                 }
                 if (rum_element_set_value((*headp)->element, (*headp)->attr_name, attr_value) < 0) {
                     return rum_parser_error(*headp, rum_last_error());
                 }
-                free(attr_value);
+                count_value(*headp, attr_value, 1);
                 rum_parser_clear_attr_name(*headp);
                 rum_buffer_reset_substr(buffer);
             }
@@ -462,7 +916,8 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
                 rum_parser_set_state(*headp, RUM_OPENTAG_EMPTY);
             } else if (c == '>') {
                 rum_parser_set_state(*headp, RUM_CONTENT);
-                if (rum_element_get_is_empty((*headp)->element)) {
+                (*headp)->skip_in_content = skipping;
+                if (!skipping && rum_element_get_is_empty((*headp)->element)) {
                     return rum_parser_error(*headp, "Empty tag not closed with '/>'");
                 }
             } else if (RUM_PARSER_IS_SPACE(c)) {
@@ -485,6 +940,12 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
         case RUM_CLOSETAG_NAME: /* </T... */
             if (RUM_PARSER_IS_LEGAL_NAME_CHAR(c)) {
                 rum_buffer_track_substr(buffer);
+            } else if (skipping && (c == '>')) {
+                rum_parser_set_state(*headp, RUM_CONTENT);
+                element = skip_pop_name(headp, buffer);
+                if (rum_last_error()) {
+                    return rum_parser_error(*headp, rum_last_error());
+                }
             } else if (c == '>') {
                 if ((*headp)->element == NULL) {
                     return rum_parser_error(*headp, "Close tag found without open tag");
@@ -493,8 +954,7 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
                 if (rum_buffer_substrncmp(buffer, tag_name, strlen(tag_name))) {
                         return rum_parser_error(*headp, "Close tag does not match open tag");
                 }
-                element = rum_parser_pop(headp);
-                rum_buffer_reset_substr(buffer);
+                element = end_element(headp, buffer);
             } else {
                 return rum_parser_error(*headp, "Invalid character in close tag");
             }
@@ -502,3 +962,41 @@ rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffe
     }
     return element;
 }
+
+rum_element_t *
+rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffer_t *buffer, int c)
+{
+    rum_element_t *element;
+
+    RUM_PROFILE_ENTER(RUM_PHASE_SCAN);
+    element = parse_char(headp, language, buffer, c);
+    RUM_PROFILE_LEAVE(RUM_PHASE_SCAN);
+    return element;
+}
+
+rum_element_t *
+rum_parser_parse_byte(rum_parser_t **headp, const rum_tag_t *language, rum_buffer_t *buffer, int byte)
+{
+    rum_element_t *element;
+    int c = byte;
+
+    rum_set_error(NULL);
+    if (buffer == NULL) {
+        return rum_parser_error(headp? *headp : NULL, "Programmer error: Parser not configured properly");
+    }
+
+    /* ASCII outside a multibyte character is its own code point */
+    if ((byte >= 0x80) || buffer->decoder.need) {
+        if ((c = rum_utf8_decode(&(buffer->decoder), byte)) == RUM_UTF8_INCOMPLETE) {
+            return NULL;
+        }
+        if (c == RUM_UTF8_INVALID) {
+            return rum_parser_error(headp? *headp : NULL, "Invalid UTF-8 in input");
+        }
+    }
+    element = rum_parser_parse_char(headp, language, buffer, c);
+    if (rum_last_error() == NULL) {
+        rum_buffer_add_char(buffer, c);
+    }
+    return element;
+}
@@ -47,6 +47,9 @@
     || (((c) >= 0x203F) && ((c) <= 0x2040)) \
     || RUM_PARSER_IS_LEGAL_FIRST_CHAR(c))
 
+/* longest entity reference ('&' and name) that a skipped subtree needs to recognize */
+#define RUM_PARSER_ENTITY_SIZE (8)
+
 /* return true if c is an XML whitespace character (more restrictive than C isspace()) */
 #define RUM_PARSER_IS_SPACE(c) (((c) == 0x20) || ((c) == 0x9) || ((c) == 0xD) || ((c) == 0xA))
 
@@ -76,6 +79,70 @@ typedef enum {
     RUM_CLOSETAG_NAME          /* portion of the tag name in a close tag has been encountered */
 } rum_state_t;
 
+/* set of tags whose elements a projected parse builds: those of interest, plus their ancestors
+ * (to hold them) and descendants (their content); keep[id] is nonzero for the tag with that id
+ */
+struct rum_projection_s {
+    int ntags;
+    unsigned char *keep;
+};
+
+/* what an element-complete callback wants done with the element it was passed */
+typedef enum {
+    RUM_ELEMENT_KEEP,       /* leave the element in the tree */
+    RUM_ELEMENT_RELEASE,    /* detach the element from its parent and free it with its subtree */
+    RUM_ELEMENT_TAKE        /* the callback has detached the element from its parent (with
+                             * rum_element_detach()) and now owns it, so the parser must not
+                             * touch it again
+                             */
+} rum_complete_action_t;
+
+/* options for parsing a document (all fields may be left zero for the default behavior) */
+struct rum_parse_options_s {
+    /* if not NULL, elements of other tags are skipped with their whole subtree: they are checked
+     * for well-formedness (legal characters, syntax, matching close tags, entity references, and
+     * repeated attributes), but not against the language, and nothing is allocated or decoded for them
+     */
+    const rum_projection_t *projection;
+
+    /* if not NULL, elements reuse memory released to this cache (see rum_element_release()) */
+    rum_element_cache_t *cache;
+
+    /* if not NULL, called (with complete_data) as soon as each element other than the root is
+     * complete, i.e. when its close tag has been parsed, with its whole subtree built; it returns
+     * a rum_complete_action_t, and a released element is freed at once (to the cache, if any), so
+     * a document of any size can be processed one subtree at a time; a taken element can be handed
+     * to another thread as soon as it is detached, since the parser no longer refers to it
+     *
+     * the root is left to the caller, and the parse goes on as if a released or taken element had
+     * never been there (rum_parser_parse_char() returns its parent instead)
+     */
+    rum_complete_callback_t on_complete;
+    void *complete_data;
+
+    /* if not NULL, the parse's costs are added to these statistics */
+    rum_parse_stats_t *stats;
+
+    /* if not NULL, each parser state transition is recorded here (see rum_trace.h) */
+    rum_trace_t *trace;
+};
+
+/* what a parse cost; rum_parser_parse_char() counts input and what it builds from it, and
+ * rum_parse_file_with_options() zeroes the statistics first and fills in the rest
+ */
+struct rum_parse_stats_s {
+    size_t bytes;                   /* input bytes consumed */
+    unsigned long elements;         /* elements created */
+    unsigned long attributes;       /* attribute values set */
+    int max_depth;                  /* deepest element created (the root is at depth 1) */
+    unsigned long entities;         /* entity references replaced in attribute values and content */
+    size_t bytes_allocated;         /* total bytes allocated by the library (including by growing) */
+    size_t peak_allocated;          /* most bytes allocated by the library at one time, beyond those
+                                     * already allocated when the parse started */
+    unsigned long buffer_growths;   /* times the input buffer had to be grown */
+    double seconds;                 /* wall-clock time taken */
+};
+
 /* parser engine */
 struct rum_parser_s {
     /* current state of engine */
@@ -84,17 +151,68 @@ struct rum_parser_s {
     /* attribute values can use either single or double quotes, so remember which one */
     int quote_char;
 
-    /* the most recently parsed attribute name */
+    /* the most recently parsed attribute name (empty if none), in storage of attr_name_size bytes
+     * that is kept while this state is reused
+     */
     char *attr_name;
+    size_t attr_name_size;
 
     /* the element currently being parsed */
     rum_element_t *element;
 
+    /* offsets within the input of the element's '<', and of the most recent '<' seen in this state */
+    size_t start;
+    size_t tag_start;
+
+    /* parse options, inherited by each new parser state */
+    const rum_parse_options_t *options;
+
+    /* when this state is skipping a subtree (see rum_parse_options_t), the names of the subtree's
+     * open elements, each followed by a null byte (skip_len is zero when not skipping)
+     */
+    char *skip_names;
+    size_t skip_len;
+    size_t skip_capacity;
+
+    /* when skipping, the attribute names of the current tag, each followed by a null byte, so that
+     * repeated attributes are caught without an element to record them in
+     */
+    char *skip_attrs;
+    size_t skip_attrs_len;
+    size_t skip_attrs_capacity;
+
+    /* when skipping, whether the content being parsed would be decoded if the subtree were kept
+     * (only content before an element's first nested tag is), and the entity reference being
+     * parsed in that content or in an attribute value ('&' and as much of the name as fits;
+     * skip_entity_len is zero when not in one)
+     */
+    int skip_in_content;
+    char skip_entity[RUM_PARSER_ENTITY_SIZE];
+    size_t skip_entity_len;
+
+    /* the number of states below this one in the stack */
+    int depth;
+
     /* the position of this parser state in the stack */
     rum_parser_t *prev;
     rum_parser_t *next;
+
+    /* in the state at the top of the stack, a list (linked through this field) of states popped
+     * off above it, kept for reuse by later pushes so that parsing allocates no parser states
+     * beyond the deepest nesting seen; they are freed when the bottom state is popped
+     */
+    rum_parser_t *spare;
 };
 
+/* return a projection that keeps elements of the given tags of a language */
+rum_projection_t *rum_projection_new(const rum_tag_t *language, const rum_tag_t **tags, int ntags);
+
+/* return a projection that keeps the elements a query can match */
+rum_projection_t *rum_projection_from_query(const rum_query_t *query);
+
+/* destructor */
+void rum_projection_free(rum_projection_t *projection);
+
 /* return a string representation of a parser state */
 char *rum_state_str(rum_state_t state);
 
@@ -104,16 +222,32 @@ rum_parser_t *rum_parser_new();
 /* convenience routine to pop all items off a parser state stack */
 void rum_parser_free(rum_parser_t **headp);
 
+/* set the options used by a parser state stack (the options must outlive the parse) */
+void rum_parser_set_options(rum_parser_t *head, const rum_parse_options_t *options);
+
 /* push a parser state onto the stack */
 int rum_parser_push(rum_parser_t **headp, rum_state_t state);
 
-/* pop a parser state off the stack, returning the element that it had parsed */
+/* pop a parser state off the stack, returning the element that it had parsed
+ * (the state is kept for reuse, unless it is the last one, in which case all are freed)
+ */
 rum_element_t *rum_parser_pop(rum_parser_t **headp);
 
+/* return a parser state stack to its state before any input (as from rum_parser_new()), whatever
+ * was parsed with it, keeping its memory for reuse; elements it was parsing are not freed
+ */
+void rum_parser_reset(rum_parser_t **headp);
+
 /* free any memory allocated for the last attribute name, and reset it to NULL */
 void rum_parser_clear_attr_name(rum_parser_t *parser);
 
 /* parse a character according to the current state, returning the element currently being parsed */
 rum_element_t *rum_parser_parse_char(rum_parser_t **headp, const rum_tag_t *language, rum_buffer_t *buffer, int c);
 
+/* parse a byte of UTF-8 input, and add it to the buffer: once a character's last byte arrives,
+ * the character is parsed and added as by rum_parser_parse_char() and rum_buffer_add_char()
+ * (returning the element currently being parsed); until then nothing is parsed and NULL is returned
+ */
+rum_element_t *rum_parser_parse_byte(rum_parser_t **headp, const rum_tag_t *language, rum_buffer_t *buffer, int byte);
+
 #endif /* RUM_PARSER__H */
@@ -9,7 +9,53 @@
 #ifndef RUM_PRIVATE__H
 #define RUM_PRIVATE__H
 
-/* set the library's global last error message */
+#include <stddef.h>
+#include <stdint.h>
+#include <rum_types.h>
+
+/* set the library's last error message for this thread */
 void rum_set_error(char *errmsg);
 
+/* allocate, resize and free memory with the library's allocator */
+void *rum_malloc(size_t size);
+void *rum_realloc(void *ptr, size_t old_size, size_t new_size);
+void rum_free(void *ptr, size_t size);
+
+/* return the number of bytes currently allocated by the library in this thread */
+size_t rum_allocated_bytes();
+
+/* starting value of a hash computed with rum_hash_bytes() */
+#define RUM_HASH_INIT (14695981039346656037ULL)
+
+/* continue a 64-bit FNV-1a hash with a block of bytes (the library's one hash function for tables
+ * and fingerprints; hashes are never saved, except in language fingerprints)
+ */
+uint64_t rum_hash_bytes(uint64_t hash, const void *bytes, size_t len);
+
+/* return the text of a compact string (NULL if unset) */
+const char *rum_str_get(const rum_str_t *str);
+
+/* point a compact string at out-of-line text */
+void rum_str_set_ptr(rum_str_t *str, int kind, const char *ptr);
+
+/* return the character an entity reference (the '&' and name, without the ';') stands for,
+ * or -1 if it is unknown
+ */
+int rum_entity_char(const char *ref, size_t len);
+
+/* return the number of bytes allocated for an element of a tag */
+size_t rum_element_size(const rum_tag_t *tag);
+
+/* return the binary values of an element whose tag has typed attributes */
+rum_binary_t *rum_element_binary(const rum_element_t *element);
+
+/* clear the cached subtree hashes of an element and its ancestors, after a change to the element */
+void rum_element_clear_hash(rum_element_t *element);
+
+/* release the mapping and element block of a document loaded from a snapshot */
+void rum_snapshot_release(rum_document_t *document);
+
+/* free the attribute value indexes of a document */
+void rum_document_free_indexes(rum_document_t *document);
+
 #endif /* RUM_PRIVATE__H */
@@ -0,0 +1,244 @@
+/*
+    rum_profile.c
+
+    profiling the phases of a parse for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <rump.h>
+#include "rum_private.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/* hardware counters read, in the order of the group's values */
+enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_BRANCH_MISSES,
+    COUNTER_CACHE_MISSES,
+    NCOUNTERS
+};
+
+/* phases can be nested at most this deep */
+#define MAX_NESTING (16)
+
+static const char *phase_names[RUM_NPHASES] = { "other", "scan", "buffer", "element", "decode", "display" };
+
+/* figures charged to one phase */
+struct phase_figures_s {
+    unsigned long calls;
+    uint64_t ns;
+    uint64_t counts[NCOUNTERS];
+};
+
+/* profiling state (like the library's error message, this is global) */
+static struct {
+    int active;
+
+    /* file descriptors of the counter group (leader first), or -1 for timing only */
+    int fds[NCOUNTERS];
+    int have_counters;
+
+    /* whether the figures include counts (boolean, kept after profiling stops) */
+    int counted;
+
+    /* the last readings, whose differences from the next are charged to the innermost phase */
+    uint64_t last_ns;
+    uint64_t last_counts[NCOUNTERS];
+
+    /* phases entered and not yet left */
+    rum_profile_phase_t stack[MAX_NESTING];
+    int depth;
+
+    struct phase_figures_s figures[RUM_NPHASES];
+} profile;
+
+static uint64_t
+clock_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#ifdef __linux__
+/* open one counter of the group, returning its file descriptor or -1 */
+static int
+open_counter(uint64_t config, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = (group_fd == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+static void
+close_counters()
+{
+    int i;
+
+    for (i = 0; i < NCOUNTERS; ++i) {
+        if (profile.fds[i] >= 0) {
+            close(profile.fds[i]);
+        }
+        profile.fds[i] = -1;
+    }
+    profile.have_counters = 0;
+}
+
+/* open and start the counter group, returning 0 on success or -1 if they are unavailable */
+static int
+open_counters()
+{
+#ifdef __linux__
+    static const uint64_t configs[NCOUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES
+    };
+    int i;
+
+    for (i = 0; i < NCOUNTERS; ++i) {
+        if ((profile.fds[i] = open_counter(configs[i], (i? profile.fds[0] : -1))) < 0) {
+            close_counters();
+            return -1;
+        }
+    }
+    if ((ioctl(profile.fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) < 0)
+        || (ioctl(profile.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0)) {
+        close_counters();
+        return -1;
+    }
+    profile.have_counters = 1;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/* take readings, and charge the differences from the last ones to the innermost phase */
+static void
+charge()
+{
+    struct phase_figures_s *figures = &(profile.figures[profile.depth? profile.stack[profile.depth - 1] : RUM_PHASE_OTHER]);
+    uint64_t values[1 + NCOUNTERS], now = clock_ns();
+    int i;
+
+    figures->ns += now - profile.last_ns;
+    profile.last_ns = now;
+
+    /* a group read gives the number of counters, then their values */
+    if (profile.have_counters
+        && (read(profile.fds[0], values, sizeof(values)) == sizeof(values)) && (values[0] == NCOUNTERS)) {
+        for (i = 0; i < NCOUNTERS; ++i) {
+            figures->counts[i] += values[1 + i] - profile.last_counts[i];
+            profile.last_counts[i] = values[1 + i];
+        }
+    }
+}
+
+int
+rum_profile_start()
+{
+    int i;
+
+    rum_set_error(NULL);
+#ifndef RUM_PROFILE
+    /* nothing would be profiled */
+    rum_set_error("Library was not built for profiling (see \"make profile\")");
+    return -1;
+#endif
+    if (profile.active) {
+        rum_profile_stop();
+    }
+    memset(&profile, 0, sizeof(profile));
+    for (i = 0; i < NCOUNTERS; ++i) {
+        profile.fds[i] = -1;
+    }
+    profile.counted = (open_counters() == 0);
+    profile.active = 1;
+    profile.last_ns = clock_ns();
+    return profile.counted;
+}
+
+void
+rum_profile_stop()
+{
+    rum_set_error(NULL);
+    if (profile.active) {
+        charge();
+        close_counters();
+        profile.active = 0;
+    }
+}
+
+void
+rum_profile_enter(rum_profile_phase_t phase)
+{
+    if (profile.active && (profile.depth < MAX_NESTING)) {
+        charge();
+        profile.stack[(profile.depth)++] = phase;
+        ++(profile.figures[phase].calls);
+    }
+}
+
+void
+rum_profile_leave(rum_profile_phase_t phase)
+{
+    if (profile.active && profile.depth && (profile.stack[profile.depth - 1] == phase)) {
+        charge();
+        --(profile.depth);
+    }
+}
+
+/* print a ratio, or a dash if it is meaningless */
+static void
+print_ratio(FILE *fp, const char *format, double numerator, double denominator)
+{
+    if (denominator > 0) {
+        fprintf(fp, format, numerator / denominator);
+    } else {
+        fprintf(fp, " %12s", "-");
+    }
+}
+
+void
+rum_profile_report(FILE *fp, size_t bytes)
+{
+    const struct phase_figures_s *figures;
+    int phase;
+
+    rum_set_error(NULL);
+    fprintf(fp, "%-8s %10s %12s %12s %12s %12s %12s %12s\n", "phase", "calls", "ms", "ns/byte",
+            "cycles/byte", "IPC", "br-misses", "cache-misses");
+    for (phase = 0; phase < RUM_NPHASES; ++phase) {
+        figures = &(profile.figures[phase]);
+        fprintf(fp, "%-8s %10lu %12.3f", phase_names[phase], figures->calls, figures->ns / 1e6);
+        print_ratio(fp, " %12.2f", figures->ns, bytes);
+        if (profile.counted) {
+            print_ratio(fp, " %12.2f", figures->counts[COUNTER_CYCLES], bytes);
+            print_ratio(fp, " %12.2f", figures->counts[COUNTER_INSTRUCTIONS], figures->counts[COUNTER_CYCLES]);
+            fprintf(fp, " %12llu %12llu\n", (unsigned long long) figures->counts[COUNTER_BRANCH_MISSES],
+                    (unsigned long long) figures->counts[COUNTER_CACHE_MISSES]);
+        } else {
+            fprintf(fp, " %12s %12s %12s %12s\n", "-", "-", "-", "-");
+        }
+    }
+}
@@ -0,0 +1,61 @@
+/*
+    rum_profile.h
+
+    declarations for profiling the phases of a parse in RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_PROFILE__H
+#define RUM_PROFILE__H
+
+#include <stdio.h>
+#include <rum_types.h>
+
+/*
+ * In a profiling build (compiled with -DRUM_PROFILE, as "make profile" does), the library brackets
+ * each phase of a parse with readings of the CPU's hardware counters (via perf_event_open(),
+ * counting user-space cycles, instructions, branch misses and cache misses), or just of the clock
+ * (via clock_gettime()) where the counters are unavailable. Phases nest (decoding happens within
+ * scanning, for example), and each reading is charged to the innermost phase, so the figures for
+ * a phase exclude those nested within it. In an ordinary build, the brackets compile to nothing.
+ *
+ * Each bracket costs a system call when counters are used, which is charged to the kernel rather
+ * than to any phase, but profiled parses are still much slower than ordinary ones.
+ */
+
+/* phases of a parse */
+typedef enum {
+    RUM_PHASE_OTHER,    /* outside any other phase, e.g. reading input */
+    RUM_PHASE_SCAN,     /* scanning characters in rum_parser_parse_char() */
+    RUM_PHASE_BUFFER,   /* buffering input in rum_buffer_add_char() */
+    RUM_PHASE_ELEMENT,  /* constructing elements in rum_element_new() */
+    RUM_PHASE_DECODE,   /* decoding entity references in attribute values and content */
+    RUM_PHASE_DISPLAY,  /* displaying a document (bracketed by the application) */
+    RUM_NPHASES
+} rum_profile_phase_t;
+
+#ifdef RUM_PROFILE
+#define RUM_PROFILE_ENTER(phase) rum_profile_enter(phase)
+#define RUM_PROFILE_LEAVE(phase) rum_profile_leave(phase)
+#else
+#define RUM_PROFILE_ENTER(phase)
+#define RUM_PROFILE_LEAVE(phase)
+#endif
+
+/* start profiling (discarding any earlier figures), returning 1 if hardware counters are being
+ * read, 0 if only the clock is, or -1 on error (including if the library is not a profiling build)
+ */
+int rum_profile_start();
+
+/* stop profiling, keeping the figures for rum_profile_report() */
+void rum_profile_stop();
+
+/* mark the start and end of a phase (normally used through RUM_PROFILE_ENTER and RUM_PROFILE_LEAVE) */
+void rum_profile_enter(rum_profile_phase_t phase);
+void rum_profile_leave(rum_profile_phase_t phase);
+
+/* print the figures for each phase, with per-byte figures for the given number of input bytes */
+void rum_profile_report(FILE *fp, size_t bytes);
+
+#endif /* RUM_PROFILE__H */
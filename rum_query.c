@@ -0,0 +1,433 @@
+/*
+    rum_query.c
+
+    compiled path query functions for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rump.h>
+#include "rum_private.h"
+
+/* longest tag or attribute name accepted in a query */
+#define RUM_QUERY_MAX_NAME (256)
+
+/* the most recent position computed for each step while a query runs,
+ * so that the positions of successive siblings are found without rescanning
+ */
+struct query_position_s {
+    const rum_element_t *element;
+    long position;
+};
+
+/* free everything allocated for a query */
+static void
+free_steps(rum_query_t *query)
+{
+    int i, j;
+
+    for (i = 0; i < query->nsteps; ++i) {
+        rum_free(query->steps[i].tags, query->ntags);
+        for (j = 0; j < query->steps[i].npreds; ++j) {
+            rum_free(query->steps[i].preds[j].handles, query->ntags * sizeof(int));
+            if (query->steps[i].preds[j].value) {
+                rum_free(query->steps[i].preds[j].value, strlen(query->steps[i].preds[j].value) + 1);
+            }
+        }
+    }
+    rum_free(query->relevant, query->ntags);
+}
+
+/* error handling: free the partially compiled query, set error message, return NULL */
+static rum_query_t *
+rum_query_compile_error(rum_query_t *query, const rum_tag_t **tags, char *errmsg)
+{
+    free_steps(query);
+    rum_free(tags, query->ntags * sizeof(rum_tag_t *));
+    rum_free(query, sizeof(rum_query_t));
+    rum_set_error(errmsg);
+    return NULL;
+}
+
+/* copy an XML name from the query into name, returning the number of characters consumed (0 if none) */
+static size_t
+parse_name(const char *text, char *name)
+{
+    size_t len = 0;
+
+    if (RUM_PARSER_IS_LEGAL_FIRST_CHAR((unsigned char) *text)) {
+        for (len = 1; RUM_PARSER_IS_LEGAL_NAME_CHAR((unsigned char) text[len]); ++len);
+    }
+    if (len >= RUM_QUERY_MAX_NAME) {
+        return 0;
+    }
+    memcpy(name, text, len);
+    name[len] = 0;
+    return len;
+}
+
+/* return true if a tag can be reached from any tag in from (NULL meaning the document itself) along an axis */
+static int
+is_reachable(const rum_tag_t *tag, const unsigned char *from, rum_query_axis_t axis)
+{
+    const rum_tag_t *ancestor;
+
+    if (from == NULL) {
+        return (axis == RUM_QUERY_DESCENDANT) || (tag->parent == NULL);
+    }
+    for (ancestor = tag->parent; ancestor; ancestor = ancestor->parent) {
+        if (from[ancestor->id]) {
+            return 1;
+        }
+        if (axis == RUM_QUERY_CHILD) {
+            break;
+        }
+    }
+    return 0;
+}
+
+/* parse the predicates of a step, returning the number of characters consumed, or -1 on error */
+static int
+parse_preds(const char *text, struct rum_query_step_s *step, const rum_tag_t **tags, int ntags)
+{
+    struct rum_query_pred_s *pred;
+    char name[RUM_QUERY_MAX_NAME];
+    const char *p = text, *end;
+    int id, found;
+    size_t len;
+
+    while (*p == '[') {
+        ++p;
+        if (step->npreds == RUM_QUERY_MAX_PREDS) {
+            rum_set_error("Too many predicates in query step");
+            return -1;
+        }
+        pred = &(step->preds[step->npreds]);
+
+        /* [@attr='value'] or [@attr="value"] */
+        if (*p == '@') {
+            if ((len = parse_name(p + 1, name)) == 0) {
+                rum_set_error("Invalid attribute name in query");
+                return -1;
+            }
+            p += len + 1;
+            if ((*p != '=') || ((p[1] != '\'') && (p[1] != '\"')) || ((end = strchr(p + 2, p[1])) == NULL)) {
+                rum_set_error("Query attribute value must be quoted");
+                return -1;
+            }
+            if ((pred->handles = rum_malloc(ntags * sizeof(int))) == NULL) {
+                rum_set_error("Unable to allocate memory for query");
+                return -1;
+            }
+            pred->value = NULL;
+            ++(step->npreds);
+            if ((pred->value = rum_malloc(end - p - 1)) == NULL) {
+                rum_set_error("Unable to allocate memory for query");
+                return -1;
+            }
+            memcpy(pred->value, p + 2, end - p - 2);
+            pred->value[end - p - 2] = 0;
+            p = end + 1;
+
+            /* tags without the attribute can never match, so drop them from the step */
+            for (id = 0, found = 0; id < ntags; ++id) {
+                pred->handles[id] = step->tags[id]? rum_tag_attr_handle(tags[id], name) : -1;
+                if (pred->handles[id] < 0) {
+                    step->tags[id] = 0;
+                } else {
+                    found = 1;
+                }
+            }
+            if (!found) {
+                rum_set_error("Query attribute not supported by tag");
+                return -1;
+            }
+
+        /* [N] */
+        } else if ((*p >= '1') && (*p <= '9')) {
+            if (step->position_pred >= 0) {
+                rum_set_error("Only one position predicate allowed per query step");
+                return -1;
+            }
+            pred->handles = NULL;
+            pred->value = NULL;
+            pred->position = strtol(p, (char **) &end, 10);
+            p = end;
+            step->position_pred = (step->npreds)++;
+
+        } else {
+            rum_set_error("Invalid predicate in query");
+            return -1;
+        }
+
+        if (*p++ != ']') {
+            rum_set_error("Predicate in query not closed with ']'");
+            return -1;
+        }
+    }
+    return p - text;
+}
+
+rum_query_t *
+rum_query_compile(const rum_tag_t *language, const char *text)
+{
+    rum_query_t *query;
+    struct rum_query_step_s *step;
+    const rum_tag_t **tags;
+    char name[RUM_QUERY_MAX_NAME];
+    const unsigned char *from = NULL;
+    rum_query_axis_t axis = RUM_QUERY_CHILD;
+    int id, named, found, len;
+
+    rum_set_error(NULL);
+    if ((language == NULL) || (text == NULL)) {
+        rum_set_error("Programmer error: Unable to compile nonexistent query");
+        return NULL;
+    }
+    if ((query = rum_malloc(sizeof(rum_query_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for query");
+        return NULL;
+    }
+    query->language = language;
+    query->ntags = rum_language_get_ntags(language);
+    query->nsteps = 0;
+    query->relevant = NULL;
+    if ((tags = rum_malloc(query->ntags * sizeof(rum_tag_t *))) == NULL) {
+        return rum_query_compile_error(query, tags, "Unable to allocate memory for query");
+    }
+    rum_language_get_tags(language, tags);
+
+    if (!strncmp(text, "//", 2)) {
+        axis = RUM_QUERY_DESCENDANT;
+        text += 2;
+    } else if (*text == '/') {
+        ++text;
+    }
+
+    while (1) {
+        if (query->nsteps == RUM_QUERY_MAX_STEPS) {
+            return rum_query_compile_error(query, tags, "Too many steps in query");
+        }
+        step = &(query->steps[query->nsteps]);
+        step->axis = axis;
+        step->npreds = 0;
+        step->position_pred = -1;
+        if ((step->tags = rum_malloc(query->ntags)) == NULL) {
+            return rum_query_compile_error(query, tags, "Unable to allocate memory for query");
+        }
+        ++(query->nsteps);
+
+        /* resolve the step's name test to the set of tags it can match */
+        if (*text == '*') {
+            name[0] = 0;
+            len = 1;
+        } else if ((len = parse_name(text, name)) == 0) {
+            return rum_query_compile_error(query, tags, "Invalid tag name in query");
+        }
+        text += len;
+        for (id = 0, named = 0, found = 0; id < query->ntags; ++id) {
+            step->tags[id] = 0;
+            if (name[0] && strcmp(rum_tag_get_name(tags[id]), name)) {
+                continue;
+            }
+            named = 1;
+            if (is_reachable(tags[id], from, axis)) {
+                step->tags[id] = 1;
+                found = 1;
+            }
+        }
+        if (!named) {
+            return rum_query_compile_error(query, tags, "Query tag not found in language");
+        }
+        if (!found) {
+            return rum_query_compile_error(query, tags, "Query tag not allowed here");
+        }
+
+        if ((len = parse_preds(text, step, tags, query->ntags)) < 0) {
+            return rum_query_compile_error(query, tags, rum_last_error());
+        }
+        text += len;
+
+        /* on to the next step, if any */
+        from = step->tags;
+        if (*text == 0) {
+            break;
+        } else if (!strncmp(text, "//", 2)) {
+            axis = RUM_QUERY_DESCENDANT;
+            text += 2;
+        } else if (*text == '/') {
+            axis = RUM_QUERY_CHILD;
+            ++text;
+        } else {
+            return rum_query_compile_error(query, tags, "Invalid character in query");
+        }
+    }
+
+    /* a tag is relevant if it can match the last step or contain such a tag;
+     * a tag is always created after its parent, so children have higher ids
+     */
+    if ((query->relevant = rum_malloc(query->ntags)) == NULL) {
+        return rum_query_compile_error(query, tags, "Unable to allocate memory for query");
+    }
+    memcpy(query->relevant, from, query->ntags);
+    for (id = query->ntags - 1; id > 0; --id) {
+        if (query->relevant[id]) {
+            query->relevant[tags[id]->parent->id] = 1;
+        }
+    }
+
+    rum_free(tags, query->ntags * sizeof(rum_tag_t *));
+    return query;
+}
+
+void
+rum_query_free(rum_query_t *query)
+{
+    rum_set_error(NULL);
+    if (query) {
+        free_steps(query);
+        rum_free(query, sizeof(rum_query_t));
+    }
+}
+
+/* return true if an element passes a step's tag test and its predicates before the given index,
+ * other than position
+ */
+static int
+passes_tests(const struct rum_query_step_s *step, const rum_element_t *element, int npreds)
+{
+    const struct rum_query_pred_s *pred;
+    const char *value;
+    int i, id = element->tag->id;
+
+    if (!step->tags[id]) {
+        return 0;
+    }
+    for (i = 0; i < npreds; ++i) {
+        pred = &(step->preds[i]);
+        if (pred->value && (((value = rum_str_get(&(element->values[pred->handles[id]]))) == NULL)
+                            || strcmp(value, pred->value))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* return the position of an element among its siblings that pass the step's tests before its position test */
+static long
+element_position(const struct rum_query_step_s *step, const rum_element_t *element, const rum_element_t *root,
+    struct query_position_s *cache)
+{
+    const rum_element_t *sibling;
+    long position = 0;
+
+    /* the search root is treated as the only child of the document */
+    if (element == root) {
+        return 1;
+    }
+
+    /* count on from the last element whose position was found, if it is an earlier sibling */
+    sibling = element->parent->first_child;
+    if (cache->element && (cache->element->parent == element->parent)) {
+        if (cache->element == element) {
+            return cache->position;
+        }
+        for (sibling = cache->element->next_sibling; sibling && (sibling != element); sibling = sibling->next_sibling);
+        if (sibling) {
+            sibling = cache->element->next_sibling;
+            position = cache->position;
+        } else {
+            sibling = element->parent->first_child;
+        }
+    }
+    for (; sibling != element; sibling = sibling->next_sibling) {
+        if (passes_tests(step, sibling, step->position_pred)) {
+            ++position;
+        }
+    }
+    cache->element = element;
+    cache->position = ++position;
+    return position;
+}
+
+/* return true if an element matches the query's first nsteps steps, ending with it */
+static int
+matches_steps(const rum_query_t *query, int nsteps, const rum_element_t *element, const rum_element_t *root,
+    struct query_position_s *cache)
+{
+    const struct rum_query_step_s *step = &(query->steps[nsteps - 1]);
+    const rum_element_t *ancestor;
+
+    if (!passes_tests(step, element, step->npreds)) {
+        return 0;
+    }
+    if ((step->position_pred >= 0)
+        && (element_position(step, element, root, &(cache[nsteps - 1])) != step->preds[step->position_pred].position)) {
+        return 0;
+    }
+
+    /* the first step is relative to the document, whose only child is the search root */
+    if (nsteps == 1) {
+        return (step->axis == RUM_QUERY_DESCENDANT) || (element == root);
+    }
+    if (element == root) {
+        return 0;
+    }
+    if (step->axis == RUM_QUERY_CHILD) {
+        return matches_steps(query, nsteps - 1, element->parent, root, cache);
+    }
+    for (ancestor = element->parent; ; ancestor = ancestor->parent) {
+        if (matches_steps(query, nsteps - 1, ancestor, root, cache)) {
+            return 1;
+        }
+        if (ancestor == root) {
+            return 0;
+        }
+    }
+}
+
+int
+rum_query_run(const rum_query_t *query, const rum_element_t *root, const rum_element_t **matches,
+    int max_matches)
+{
+    struct query_position_s cache[RUM_QUERY_MAX_STEPS];
+    const struct rum_query_step_s *last;
+    const rum_element_t *element;
+    int i, nmatches = 0;
+
+    rum_set_error(NULL);
+    if ((query == NULL) || (root == NULL) || ((matches == NULL) && (max_matches > 0))) {
+        rum_set_error("Programmer error: Unable to run nonexistent query");
+        return -1;
+    }
+    if (root->tag->id >= query->ntags) {
+        rum_set_error("Programmer error: Query was compiled for a different language");
+        return -1;
+    }
+    for (i = 0; i < query->nsteps; ++i) {
+        cache[i].element = NULL;
+    }
+    last = &(query->steps[query->nsteps - 1]);
+
+    /* visit the tree in document order, skipping subtrees that cannot hold a match */
+    for (element = root; element; ) {
+        if (query->relevant[element->tag->id]) {
+            if (last->tags[element->tag->id] && matches_steps(query, query->nsteps, element, root, cache)) {
+                if (nmatches < max_matches) {
+                    matches[nmatches] = element;
+                }
+                ++nmatches;
+            }
+            if (element->first_child) {
+                element = element->first_child;
+                continue;
+            }
+        }
+        for (; (element != root) && (element->next_sibling == NULL); element = element->parent);
+        element = (element == root)? NULL : element->next_sibling;
+    }
+    return nmatches;
+}
@@ -0,0 +1,93 @@
+/*
+    rum_query.h
+
+    declarations for compiled path queries in RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_QUERY__H
+#define RUM_QUERY__H
+
+#include <rum_types.h>
+
+/*
+ * A path query selects elements by their position in the tree, for example:
+ *
+ *    cabinet/shelf[@id='top']/bottle    bottles on the top shelf
+ *    //bottle[@type="Scotch whisky"]    Scotch bottles anywhere
+ *    /cabinet/shelf[2]//bottle          bottles within the second shelf
+ *
+ * A query is a series of steps separated by "/" (a child of the previous step's element)
+ * or "//" (a descendant of it). A leading "/" is optional; a leading "//" means anywhere
+ * in the document. Each step is a tag name or "*", followed by any number of predicates:
+ * [@attr='value'] requires an attribute to have a value, and [N] (counting from 1)
+ * requires the element to be the Nth sibling among those meeting the step's earlier tests.
+ *
+ * A query is compiled against a language, resolving tag and attribute names once,
+ * and rejecting queries that could never match anything.
+ */
+
+/* maximum number of steps in a query, and of predicates in one step */
+#define RUM_QUERY_MAX_STEPS (32)
+#define RUM_QUERY_MAX_PREDS (8)
+
+/* how a step relates to the previous one */
+typedef enum {
+    RUM_QUERY_CHILD,
+    RUM_QUERY_DESCENDANT
+} rum_query_axis_t;
+
+/* one predicate of a query step */
+struct rum_query_pred_s {
+    /* if value is not NULL, this is an attribute test, and handles[id] is the attribute's handle
+     * for the tag with that id; otherwise this is a position test
+     */
+    int *handles;
+    char *value;
+    long position;
+};
+
+/* one step of a query */
+struct rum_query_step_s {
+    rum_query_axis_t axis;
+
+    /* tags[id] is nonzero if the step can match elements of the tag with that id */
+    unsigned char *tags;
+
+    int npreds;
+    struct rum_query_pred_s preds[RUM_QUERY_MAX_PREDS];
+
+    /* index of the step's position predicate, or -1 if it has none (only one is allowed) */
+    int position_pred;
+};
+
+/* compiled query */
+struct rum_query_s {
+    const rum_tag_t *language;
+    int ntags;
+
+    int nsteps;
+    struct rum_query_step_s steps[RUM_QUERY_MAX_STEPS];
+
+    /* relevant[id] is nonzero if elements of the tag with that id can be or contain a match,
+     * so that other subtrees can be skipped
+     */
+    unsigned char *relevant;
+};
+
+/* compile a query against a language, returning NULL (with an error message) if it is invalid */
+rum_query_t *rum_query_compile(const rum_tag_t *language, const char *text);
+
+/* destructor */
+void rum_query_free(rum_query_t *query);
+
+/* run a query on the tree below (and including) root, which is treated as the document's root element
+ *
+ * up to max_matches matching elements are stored in matches in document order;
+ * the total number of matches is returned (or -1 on error); no memory is allocated
+ */
+int rum_query_run(const rum_query_t *query, const rum_element_t *root, const rum_element_t **matches,
+        int max_matches);
+
+#endif /* RUM_QUERY__H */
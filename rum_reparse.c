@@ -0,0 +1,313 @@
+/*
+    rum_reparse.c
+
+    incremental re-parsing of edited documents for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <rump.h>
+#include "rum_private.h"
+
+/* text to parse, in up to three pieces (the text before an edit, the inserted text, and the text
+ * after it), so that edited text need not be copied in order to be parsed
+ */
+struct edited_text_s {
+    const char *str[3];
+    size_t len[3];
+};
+
+/* describe the edited form of source[start..end), in which removed_len bytes at edit_offset
+ * (which must be within that range) are replaced by inserted
+ */
+static void
+edited_text(struct edited_text_s *text, const char *source, size_t start, size_t end,
+    size_t edit_offset, size_t removed_len, const char *inserted, size_t inserted_len)
+{
+    text->str[0] = source + start;
+    text->len[0] = edit_offset - start;
+    text->str[1] = inserted;
+    text->len[1] = inserted_len;
+    text->str[2] = source + edit_offset + removed_len;
+    text->len[2] = end - edit_offset - removed_len;
+}
+
+/* error handling: ensure last error message is retained, free allocated memory, return NULL */
+static rum_element_t *
+parse_text_error(rum_parser_t **headp, rum_buffer_t *buffer, rum_element_t *root)
+{
+    /* save error message because later calls will wipe it */
+    char *errmsg = rum_last_error();
+
+    rum_parser_free(headp);
+    rum_buffer_free(buffer);
+    if (root) {
+        rum_element_free(root);
+    }
+    rum_set_error(errmsg);
+    return NULL;
+}
+
+/* parse text according to a language, returning its root element; if is_element is nonzero,
+ * the text must consist of exactly that one element, with nothing before or after it
+ */
+static rum_element_t *
+parse_text(const rum_tag_t *language, const struct edited_text_s *text, int is_element)
+{
+    rum_parser_t *head = NULL;
+    rum_buffer_t *buffer = NULL;
+    rum_element_t *root = NULL;
+    size_t i, total = 0;
+    int piece, c;
+
+    if (((head = rum_parser_new()) == NULL) || ((buffer = rum_buffer_new()) == NULL)) {
+        return parse_text_error(&head, buffer, root);
+    }
+    for (piece = 0; piece < 3; ++piece) {
+        for (i = 0; i < text->len[piece]; ++i) {
+            c = (unsigned char) text->str[piece][i];
+            rum_parser_parse_byte(&head, language, buffer, c);
+
+            /* a new element without a parent is a root element, and there can be only one
+             * (this is checked first, because the character that creates it may also be an error)
+             */
+            if (head->element && (head->element->parent == NULL) && (head->element != root)) {
+                if (root) {
+                    rum_element_free(head->element);
+                    rum_set_error("Input holds more than one root element");
+                    return parse_text_error(&head, buffer, root);
+                }
+                root = head->element;
+            }
+            if (rum_last_error()) {
+                return parse_text_error(&head, buffer, root);
+            }
+        }
+        total += text->len[piece];
+    }
+
+    if (root == NULL) {
+        rum_set_error("Root tag not found in input");
+        return parse_text_error(&head, buffer, root);
+    }
+    if ((head->prev != NULL) || (head->state != RUM_CONTENT) || RUM_BUFFER_IN_CHAR(buffer)) {
+        rum_set_error("All tags not closed");
+        return parse_text_error(&head, buffer, root);
+    }
+    if (is_element && ((root->offset != 0) || (root->length != total))) {
+        rum_set_error("Edited text is not a single element");
+        return parse_text_error(&head, buffer, root);
+    }
+
+    rum_parser_free(&head);
+    rum_buffer_free(buffer);
+    return root;
+}
+
+rum_document_t *
+rum_document_parse(const char *text, size_t size, const rum_tag_t *language)
+{
+    struct edited_text_s whole;
+    rum_document_t *document;
+    rum_element_t *root;
+    char *source;
+
+    rum_set_error(NULL);
+    if ((text == NULL) || (language == NULL)) {
+        rum_set_error("Programmer error: Unable to parse nonexistent text");
+        return NULL;
+    }
+    edited_text(&whole, text, 0, size, size, 0, "", 0);
+    if ((root = parse_text(language, &whole, 0)) == NULL) {
+        return NULL;
+    }
+    if ((source = rum_malloc(size + 1)) == NULL) {
+        rum_element_free(root);
+        rum_set_error("Unable to allocate memory for document source");
+        return NULL;
+    }
+    if ((document = rum_document_new(root)) == NULL) {
+        rum_free(source, size + 1);
+        rum_element_free(root);
+        rum_set_error("Unable to allocate memory for document");
+        return NULL;
+    }
+    memcpy(source, text, size);
+    source[size] = 0;
+    document->source = source;
+    document->source_size = size;
+    document->source_capacity = size + 1;
+    return document;
+}
+
+const char *
+rum_document_get_source(const rum_document_t *document, size_t *size)
+{
+    rum_set_error(NULL);
+    if ((document == NULL) || (size == NULL)) {
+        rum_set_error("Programmer error: Unable to get source of nonexistent document");
+        return NULL;
+    }
+    *size = document->source_size;
+    return document->source;
+}
+
+/* return the smallest element in the tree below (and including) root whose span strictly contains
+ * the edited bytes, leaving its '<' and final '>' in place, and store its offset in startp;
+ * return NULL if there is none
+ */
+static rum_element_t *
+find_enclosing(rum_element_t *root, size_t edit_offset, size_t removed_len, size_t *startp)
+{
+    rum_element_t *element = root, *found = NULL;
+    size_t parent_start = 0, start;
+
+    while (element) {
+        start = parent_start + element->offset;
+        if ((element->length > 0) && (start < edit_offset)
+            && (edit_offset + removed_len < start + element->length)) {
+            found = element;
+            *startp = parent_start = start;
+            element = element->first_child;
+
+        /* siblings are in document order, so none of the rest can contain the edit */
+        } else if (start >= edit_offset + removed_len) {
+            break;
+        } else {
+            element = element->next_sibling;
+        }
+    }
+    return found;
+}
+
+/* apply an edit to a document's copy of its text, returning 0 on success or -1 on error */
+static int
+edit_source(rum_document_t *document, size_t edit_offset, size_t removed_len,
+    const char *inserted, size_t inserted_len)
+{
+    size_t size = document->source_size - removed_len + inserted_len, capacity;
+    char *source;
+
+    if (size + 1 > document->source_capacity) {
+        for (capacity = document->source_capacity * 2; size + 1 > capacity; capacity *= 2);
+        if ((source = rum_realloc(document->source, document->source_capacity, capacity)) == NULL) {
+            rum_set_error("Unable to allocate memory for document source");
+            return -1;
+        }
+        document->source = source;
+        document->source_capacity = capacity;
+    }
+    memmove(document->source + edit_offset + inserted_len, document->source + edit_offset + removed_len,
+            document->source_size - edit_offset - removed_len + 1);
+    memcpy(document->source + edit_offset, inserted, inserted_len);
+    document->source_size = size;
+    return 0;
+}
+
+/* replace an element (or the whole tree, if target is NULL) with a newly parsed one,
+ * and adjust the spans of the elements that follow it
+ */
+static void
+splice(rum_document_t *document, rum_element_t *target, rum_element_t *replacement,
+    size_t removed_len, size_t inserted_len)
+{
+    rum_element_t *element, *sibling;
+
+    if (target == NULL) {
+        rum_element_free(document->root);
+        document->root = replacement;
+        return;
+    }
+
+    replacement->offset = target->offset;
+    replacement->parent = target->parent;
+    replacement->next_sibling = target->next_sibling;
+    if (target->parent == NULL) {
+        document->root = replacement;
+    } else if (target->parent->first_child == target) {
+        target->parent->first_child = replacement;
+    } else {
+        for (sibling = target->parent->first_child; sibling->next_sibling != target;
+             sibling = sibling->next_sibling);
+        sibling->next_sibling = replacement;
+    }
+    rum_element_clear_hash(replacement->parent);
+    target->parent = NULL;
+    target->next_sibling = NULL;
+    rum_element_free(target);
+
+    /* offsets are relative to the parent, so only the later siblings of the replacement
+     * and of each of its ancestors move, and only its ancestors change length
+     * (size_t arithmetic wraps, so adding and then subtracting is safe)
+     */
+    for (element = replacement; element; element = element->parent) {
+        for (sibling = element->next_sibling; sibling; sibling = sibling->next_sibling) {
+            sibling->offset = sibling->offset + inserted_len - removed_len;
+        }
+        if (element->parent) {
+            element->parent->length = element->parent->length + inserted_len - removed_len;
+        }
+    }
+}
+
+int
+rum_document_reparse(rum_document_t *document, size_t edit_offset, size_t removed_len,
+    const char *inserted_text)
+{
+    struct edited_text_s text;
+    rum_element_t *target, *replacement = NULL;
+    size_t start = 0, inserted_len;
+
+    rum_set_error(NULL);
+    if ((document == NULL) || (inserted_text == NULL)) {
+        rum_set_error("Programmer error: Unable to re-parse nonexistent document");
+        return -1;
+    }
+    if (document->source == NULL) {
+        rum_set_error("Document was not parsed from text");
+        return -1;
+    }
+    if (document->is_shared) {
+        rum_set_error("Unable to edit a shared document");
+        return -1;
+    }
+    if ((edit_offset > document->source_size) || (removed_len > document->source_size - edit_offset)) {
+        rum_set_error("Edit is outside document text");
+        return -1;
+    }
+    inserted_len = strlen(inserted_text);
+
+    /* re-parse the smallest enclosing element that still parses as a single element of its tag */
+    target = find_enclosing(document->root, edit_offset, removed_len, &start);
+    while (target) {
+        edited_text(&text, document->source, start, start + target->length,
+                    edit_offset, removed_len, inserted_text, inserted_len);
+        if ((replacement = parse_text(target->tag, &text, 1)) != NULL) {
+            break;
+        }
+        start -= target->offset;
+        target = target->parent;
+    }
+
+    /* if no element will do, re-parse everything */
+    if (target == NULL) {
+        edited_text(&text, document->source, 0, document->source_size,
+                    edit_offset, removed_len, inserted_text, inserted_len);
+        if ((replacement = parse_text(document->root->tag, &text, 0)) == NULL) {
+            return -1;
+        }
+    }
+
+    if (edit_source(document, edit_offset, removed_len, inserted_text, inserted_len) < 0) {
+        rum_element_free(replacement);
+        rum_set_error("Unable to allocate memory for document source");
+        return -1;
+    }
+    splice(document, target, replacement, removed_len, inserted_len);
+
+    /* indexes may refer to the replaced elements */
+    rum_document_free_indexes(document);
+    return 0;
+}
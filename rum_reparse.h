@@ -0,0 +1,52 @@
+/*
+    rum_reparse.h
+
+    declarations for incremental re-parsing of edited documents in RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_REPARSE__H
+#define RUM_REPARSE__H
+
+#include <stddef.h>
+#include <rum_types.h>
+
+/*
+ * A document parsed from text in memory keeps a copy of the text, and each element records
+ * its span within it (see rum_element_get_span()). When the text is edited, only the smallest
+ * element that strictly contains the edit is parsed again, as if its tag were the root of the
+ * language (so it gets the same validation it would get in the context of the whole document),
+ * and the new subtree replaces the old one. If the edited text does not parse as a single
+ * element of the same tag (for example, because the edit closed the element early), each
+ * enclosing element is tried in turn, and then the whole document, so the result is always the
+ * same as parsing the edited text from scratch.
+ *
+ * Only the re-parsed element's text is parsed again, but the rest of an edit is not bounded by
+ * its size: finding the element and splicing in the new subtree walk the siblings that come
+ * before it and after it at every level above it (to find it and to shift their offsets), and
+ * the document's copy of the text is moved along from the edit onward. An edit therefore takes
+ * time in proportion to the number of siblings along the path to it and to the size of the
+ * text after it, which for a document with very wide elements or a very large text can exceed
+ * the cost of the parse itself.
+ */
+
+/* return a document parsed from size bytes of text according to a language, keeping a copy of the text */
+rum_document_t *rum_document_parse(const char *text, size_t size, const rum_tag_t *language);
+
+/* return the current text of a document parsed with rum_document_parse() (storing its size in size),
+ * or NULL if the document was not parsed from text
+ */
+const char *rum_document_get_source(const rum_document_t *document, size_t *size);
+
+/* replace removed_len bytes of a document's text at edit_offset with inserted_text, and update the
+ * document to match, returning 0 on success or -1 on error (in which case the document is unchanged);
+ * a shared document (see rum_document_share()) cannot be edited
+ *
+ * the replaced elements are freed, so any pointers to them (or their descendants) become invalid,
+ * as do any attribute value indexes of the document
+ */
+int rum_document_reparse(rum_document_t *document, size_t edit_offset, size_t removed_len,
+        const char *inserted_text);
+
+#endif /* RUM_REPARSE__H */
@@ -0,0 +1,191 @@
+/*
+    rum_session.c
+
+    non-blocking parse session functions for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <rump.h>
+#include "rum_private.h"
+
+/* most bytes read at a time (the data is parsed from the stack, so sessions need no read buffer) */
+#define READ_SIZE (4096)
+
+rum_session_t *
+rum_session_new(const rum_tag_t *language, const rum_parse_options_t *options)
+{
+    rum_session_t *session;
+
+    rum_set_error(NULL);
+    if (language == NULL) {
+        rum_set_error("Programmer error: Unable to create session with nonexistent language");
+        return NULL;
+    }
+    if ((session = rum_malloc(sizeof(rum_session_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for session");
+        return NULL;
+    }
+    memset(session, 0, sizeof(rum_session_t));
+    session->language = language;
+    session->options = options;
+    return session;
+}
+
+/* free the parser state and input buffer, which are needed only while the document is incomplete */
+static void
+finish(rum_session_t *session)
+{
+    rum_parser_free(&(session->head));
+    rum_buffer_free(session->buffer);
+    session->buffer = NULL;
+}
+
+void
+rum_session_free(rum_session_t *session)
+{
+    rum_set_error(NULL);
+    if (session) {
+        finish(session);
+        rum_element_free(session->root);
+        rum_free(session, sizeof(rum_session_t));
+    }
+}
+
+/* error handling: remember the error message, so later calls fail the same way, and free
+ * everything but the session itself
+ */
+static rum_session_status_t
+rum_session_error(rum_session_t *session)
+{
+    char *errmsg = rum_last_error();
+
+    finish(session);
+    rum_element_free(session->root);
+    session->root = NULL;
+    session->errmsg = errmsg;
+    rum_set_error(errmsg);
+    return RUM_SESSION_ERROR;
+}
+
+rum_session_status_t
+rum_session_feed(rum_session_t *session, const char *data, size_t size, size_t *consumed)
+{
+    rum_element_t *element;
+    size_t i;
+    int c;
+
+    rum_set_error(NULL);
+    if (consumed) {
+        *consumed = 0;
+    }
+    if ((session == NULL) || ((data == NULL) && size)) {
+        rum_set_error("Programmer error: Unable to feed nonexistent session");
+        return RUM_SESSION_ERROR;
+    }
+    if (session->errmsg) {
+        rum_set_error(session->errmsg);
+        return RUM_SESSION_ERROR;
+    }
+    if (session->done) {
+        return RUM_SESSION_DONE;
+    }
+
+    /* the parser state and buffer are only needed once there is input */
+    if (session->head == NULL) {
+        if (((session->head = rum_parser_new()) == NULL) || ((session->buffer = rum_buffer_new()) == NULL)) {
+            return rum_session_error(session);
+        }
+        rum_parser_set_options(session->head, session->options);
+    }
+
+    for (i = 0; (i < size) && !(session->done); ++i) {
+        c = (unsigned char) data[i];
+        element = rum_parser_parse_byte(&(session->head), session->language, session->buffer, c);
+
+        /* note the root element as soon as it exists, so it is freed even on error */
+        if ((session->root == NULL) && session->head->element) {
+            session->root = session->head->element;
+        }
+        if (rum_last_error()) {
+            return rum_session_error(session);
+        }
+
+        /* the document is complete when its root element is popped off the parser stack */
+        if (element && (element == session->root) && (element != session->head->element)) {
+            session->done = 1;
+        }
+    }
+    if (consumed) {
+        *consumed = i;
+    }
+    if (session->done) {
+        finish(session);
+        return RUM_SESSION_DONE;
+    }
+
+    /* only the token in progress is needed to continue */
+    if (rum_buffer_shrink(session->buffer) < 0) {
+        return rum_session_error(session);
+    }
+    return RUM_SESSION_NEED_MORE;
+}
+
+rum_session_status_t
+rum_session_on_readable(rum_session_t *session, int fd)
+{
+    rum_session_status_t status;
+    char data[READ_SIZE];
+    ssize_t nread;
+
+    rum_set_error(NULL);
+    if (session == NULL) {
+        rum_set_error("Programmer error: Unable to read into nonexistent session");
+        return RUM_SESSION_ERROR;
+    }
+    if (session->errmsg || session->done) {
+        return rum_session_feed(session, NULL, 0, NULL);
+    }
+
+    for (;;) {
+        if ((nread = read(fd, data, sizeof(data))) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return RUM_SESSION_NEED_MORE;
+            }
+            rum_set_error("Unable to read input");
+            return rum_session_error(session);
+        }
+        if (nread == 0) {
+            rum_set_error(session->root? "Input ends inside document" : "Root tag not found in input");
+            return rum_session_error(session);
+        }
+        if ((status = rum_session_feed(session, data, nread, NULL)) != RUM_SESSION_NEED_MORE) {
+            return status;
+        }
+    }
+}
+
+rum_element_t *
+rum_session_take_document(rum_session_t *session)
+{
+    rum_element_t *root;
+
+    rum_set_error(NULL);
+    if (session == NULL) {
+        rum_set_error("Programmer error: Unable to take document of nonexistent session");
+        return NULL;
+    }
+    if (!(session->done)) {
+        return NULL;
+    }
+    root = session->root;
+    session->root = NULL;
+    return root;
+}
@@ -0,0 +1,82 @@
+/*
+    rum_session.h
+
+    declarations for non-blocking parse sessions in RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_SESSION__H
+#define RUM_SESSION__H
+
+#include <stddef.h>
+#include <rum_types.h>
+#include <rum_parser.h>
+
+/*
+ * A parse session parses one document as its input trickles in, so that an event loop (using
+ * epoll() or the like) can keep many partial documents going on a few threads. Whenever a file
+ * descriptor is readable, rum_session_on_readable() reads whatever is available without blocking,
+ * advances the parser, and reports whether the document is complete or more input is needed.
+ * Input from elsewhere (such as a TLS library) can be given with rum_session_feed() instead.
+ *
+ * Sessions are kept small: one that has not yet received any input holds only the session itself,
+ * the parser state and input buffer are allocated when input first arrives, the buffer is shrunk
+ * to the token in progress after each read (see rum_buffer_shrink()), and the parser state and
+ * buffer are freed as soon as the document is complete. Between reads, a partial document holds
+ * one parser state per level of nesting, the buffer with its token in progress, and its elements
+ * so far: a few hundred bytes beyond the elements.
+ *
+ * The document is complete as soon as its root element ends; anything after that is not parsed.
+ */
+
+/* what a session needs next */
+typedef enum {
+    RUM_SESSION_ERROR = -1,     /* the input is not a valid document (see rum_last_error()) */
+    RUM_SESSION_NEED_MORE = 0,  /* the document is not complete yet */
+    RUM_SESSION_DONE = 1        /* the document is complete (see rum_session_take_document()) */
+} rum_session_status_t;
+
+struct rum_session_s {
+    const rum_tag_t *language;
+
+    /* the caller's parse options (not copied, so they must outlive the session), or NULL */
+    const rum_parse_options_t *options;
+
+    /* parser state and input buffer, allocated when input first arrives and freed when done */
+    rum_parser_t *head;
+    rum_buffer_t *buffer;
+
+    /* the document's root element, once it exists */
+    rum_element_t *root;
+
+    /* once the document is complete or an error occurs, nothing more is parsed */
+    int done;
+    char *errmsg;
+};
+
+/* constructor: parse a document according to a language with the given options (which may be NULL) */
+rum_session_t *rum_session_new(const rum_tag_t *language, const rum_parse_options_t *options);
+
+/* destructor (frees the document too, unless it was taken) */
+void rum_session_free(rum_session_t *session);
+
+/* parse size bytes of input, storing the number of bytes used in consumed if it is not NULL
+ * (less than size only when the document is completed before the end of the input)
+ */
+rum_session_status_t rum_session_feed(rum_session_t *session, const char *data, size_t size, size_t *consumed);
+
+/* read and parse everything available from a non-blocking file descriptor, until it would block,
+ * the document is complete, or the input ends (which is an error if the document is incomplete);
+ * since it reads until it would block, this works with edge-triggered notification
+ *
+ * input read after the end of the document is discarded
+ */
+rum_session_status_t rum_session_on_readable(rum_session_t *session, int fd);
+
+/* take ownership of the document's root element once the session is done; the caller must free it
+ * with rum_element_free() (returns NULL if the document is not complete)
+ */
+rum_element_t *rum_session_take_document(rum_session_t *session);
+
+#endif /* RUM_SESSION__H */
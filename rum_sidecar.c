@@ -0,0 +1,579 @@
+/*
+    rum_sidecar.c
+
+    sidecar offset index functions for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <rump.h>
+#include "rum_private.h"
+
+/* while scanning, discard already-indexed input once the buffer holds this many bytes */
+#define RUM_SIDECAR_COMPACT_SIZE (64 * CHUNKSIZE)
+
+/* state of an index being built */
+struct sidecar_scan_s {
+    const rum_tag_t **tags;
+    int ntags;
+
+    /* resolved key attributes */
+    struct rum_sidecar_keyspec_s *keyspecs;
+    size_t nkeyspecs;
+    size_t keyspecs_capacity;
+
+    /* ranges of the root's children, in document order */
+    rum_sidecar_range_t *children;
+    size_t nchildren;
+    size_t children_capacity;
+
+    /* key records, in document order until the index is finished */
+    struct rum_sidecar_key_s *keys;
+    size_t nkeys;
+    size_t keys_capacity;
+
+    /* key values */
+    char *strings;
+    size_t strings_size;
+    size_t strings_capacity;
+
+    /* starts[d] is the offset of the open element at depth d */
+    uint64_t *starts;
+    size_t starts_capacity;
+};
+
+/* a key record with its value, for sorting */
+struct sidecar_sort_s {
+    const char *value;
+    const struct rum_sidecar_key_s *key;
+};
+
+/* ensure an array being built has room for needed items of the given size */
+static int
+grow_array(void **array, size_t *capacity, size_t needed, size_t size)
+{
+    size_t new_capacity;
+    void *new_array;
+
+    if (needed <= *capacity) {
+        return 0;
+    }
+    for (new_capacity = *capacity? *capacity : 64; new_capacity < needed; new_capacity *= 2);
+    if ((new_array = rum_realloc(*array, *capacity * size, new_capacity * size)) == NULL) {
+        rum_set_error("Unable to allocate memory for index");
+        return -1;
+    }
+    *array = new_array;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/* free the state of an index being built */
+static void
+free_scan(struct sidecar_scan_s *scan)
+{
+    rum_free(scan->tags, scan->ntags * sizeof(rum_tag_t *));
+    rum_free(scan->keyspecs, scan->keyspecs_capacity * sizeof(*(scan->keyspecs)));
+    rum_free(scan->children, scan->children_capacity * sizeof(*(scan->children)));
+    rum_free(scan->keys, scan->keys_capacity * sizeof(*(scan->keys)));
+    rum_free(scan->strings, scan->strings_capacity);
+    rum_free(scan->starts, scan->starts_capacity * sizeof(*(scan->starts)));
+}
+
+/* look up the language's tags, and resolve each requested key attribute for every tag with the given name */
+static int
+init_scan(struct sidecar_scan_s *scan, const rum_tag_t *language,
+    const char **tag_names, const char **attr_names, int nkeys)
+{
+    int i, id, handle, found;
+
+    memset(scan, 0, sizeof(*scan));
+    scan->ntags = rum_language_get_ntags(language);
+    if ((scan->tags = rum_malloc(scan->ntags * sizeof(rum_tag_t *))) == NULL) {
+        scan->ntags = 0;
+        rum_set_error("Unable to allocate memory for index");
+        return -1;
+    }
+    rum_language_get_tags(language, scan->tags);
+    if (nkeys == 0) {
+        return 0;
+    }
+
+    /* a tag name can appear more than once in a language, so allow one key per tag per requested key */
+    if ((scan->keyspecs = rum_malloc(nkeys * scan->ntags * sizeof(*(scan->keyspecs)))) == NULL) {
+        rum_set_error("Unable to allocate memory for index");
+        return -1;
+    }
+    scan->keyspecs_capacity = nkeys * scan->ntags;
+    for (i = 0; i < nkeys; ++i) {
+        for (id = 0, found = 0; id < scan->ntags; ++id) {
+            if (!strcmp(rum_tag_get_name(scan->tags[id]), tag_names[i])
+                && ((handle = rum_tag_attr_handle(scan->tags[id], attr_names[i])) >= 0)) {
+                scan->keyspecs[scan->nkeyspecs].tag_id = id;
+                scan->keyspecs[scan->nkeyspecs].handle = handle;
+                ++(scan->nkeyspecs);
+                ++found;
+            }
+        }
+        if (found == 0) {
+            rum_set_error("Key attribute not found in language");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* record the range and key values of a completely parsed element */
+static int
+record_element(struct sidecar_scan_s *scan, const rum_element_t *element, uint64_t start, uint64_t end)
+{
+    rum_sidecar_range_t range;
+    rum_element_t *parent = rum_element_get_parent(element);
+    const char *value;
+    size_t i, len;
+
+    range.start = start;
+    range.end = end;
+    range.tag_id = rum_tag_get_id(element->tag);
+    range.reserved = 0;
+
+    if (parent && (rum_element_get_parent(parent) == NULL)) {
+        if (grow_array((void **) &(scan->children), &(scan->children_capacity), scan->nchildren + 1,
+                       sizeof(*(scan->children))) < 0) {
+            return -1;
+        }
+        scan->children[(scan->nchildren)++] = range;
+    }
+
+    for (i = 0; i < scan->nkeyspecs; ++i) {
+        if ((scan->keyspecs[i].tag_id != range.tag_id)
+            || ((value = rum_element_get_value_by_handle(element, scan->keyspecs[i].handle)) == NULL)) {
+            continue;
+        }
+        len = strlen(value) + 1;
+        if ((grow_array((void **) &(scan->keys), &(scan->keys_capacity), scan->nkeys + 1,
+                        sizeof(*(scan->keys))) < 0)
+            || (grow_array((void **) &(scan->strings), &(scan->strings_capacity), scan->strings_size + len, 1) < 0)) {
+            return -1;
+        }
+        memcpy(scan->strings + scan->strings_size, value, len);
+        scan->keys[scan->nkeys].keyspec = i;
+        scan->keys[scan->nkeys].value = scan->strings_size;
+        scan->keys[scan->nkeys].range = range;
+        ++(scan->nkeys);
+        scan->strings_size += len;
+    }
+    return 0;
+}
+
+/* order key records by key specification, then value, then position in the file */
+static int
+compare_keys(const void *a, const void *b)
+{
+    const struct sidecar_sort_s *sa = a, *sb = b;
+    int rc;
+
+    if (sa->key->keyspec != sb->key->keyspec) {
+        return (sa->key->keyspec < sb->key->keyspec)? -1 : 1;
+    }
+    if ((rc = strcmp(sa->value, sb->value)) != 0) {
+        return rc;
+    }
+    return (sa->key->range.start < sb->key->range.start)? -1 : (sa->key->range.start > sb->key->range.start);
+}
+
+/* lay out a finished scan in index file format */
+static rum_sidecar_t *
+finish_scan(struct sidecar_scan_s *scan, const rum_tag_t *language, uint64_t source_size)
+{
+    struct rum_sidecar_header_s *header;
+    struct rum_sidecar_key_s *keys;
+    struct sidecar_sort_s *sorted;
+    rum_sidecar_t *sidecar;
+    size_t i, size;
+
+    if ((sidecar = rum_malloc(sizeof(rum_sidecar_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for index");
+        return NULL;
+    }
+    size = sizeof(*header) + scan->nchildren * sizeof(*(scan->children))
+           + scan->nkeyspecs * sizeof(*(scan->keyspecs)) + scan->nkeys * sizeof(*(scan->keys)) + scan->strings_size;
+    if ((sidecar->data = rum_malloc(size)) == NULL) {
+        rum_free(sidecar, sizeof(rum_sidecar_t));
+        rum_set_error("Unable to allocate memory for index");
+        return NULL;
+    }
+    if ((sorted = rum_malloc((scan->nkeys + 1) * sizeof(*sorted))) == NULL) {
+        rum_free(sidecar->data, size);
+        rum_free(sidecar, sizeof(rum_sidecar_t));
+        rum_set_error("Unable to allocate memory for index");
+        return NULL;
+    }
+    sidecar->language = language;
+    sidecar->size = size;
+    sidecar->is_mapped = 0;
+
+    header = (struct rum_sidecar_header_s *) sidecar->data;
+    memset(header, 0, sizeof(*header));
+    strcpy(header->magic, RUM_SIDECAR_MAGIC);
+    header->version = RUM_SIDECAR_VERSION;
+    header->byte_order = RUM_SIDECAR_BYTE_ORDER;
+    header->fingerprint = rum_language_fingerprint(language);
+    header->source_size = source_size;
+    header->nchildren = scan->nchildren;
+    header->children_offset = sizeof(*header);
+    header->nkeyspecs = scan->nkeyspecs;
+    header->keyspecs_offset = header->children_offset + scan->nchildren * sizeof(*(scan->children));
+    header->nkeys = scan->nkeys;
+    header->keys_offset = header->keyspecs_offset + scan->nkeyspecs * sizeof(*(scan->keyspecs));
+    header->strings_size = scan->strings_size;
+    header->strings_offset = header->keys_offset + scan->nkeys * sizeof(*(scan->keys));
+
+    memcpy(sidecar->data + header->children_offset, scan->children, scan->nchildren * sizeof(*(scan->children)));
+    memcpy(sidecar->data + header->keyspecs_offset, scan->keyspecs, scan->nkeyspecs * sizeof(*(scan->keyspecs)));
+    memcpy(sidecar->data + header->strings_offset, scan->strings, scan->strings_size);
+
+    /* sort the key records so they can be binary searched */
+    for (i = 0; i < scan->nkeys; ++i) {
+        sorted[i].value = scan->strings + scan->keys[i].value;
+        sorted[i].key = &(scan->keys[i]);
+    }
+    qsort(sorted, scan->nkeys, sizeof(*sorted), compare_keys);
+    keys = (struct rum_sidecar_key_s *) (sidecar->data + header->keys_offset);
+    for (i = 0; i < scan->nkeys; ++i) {
+        keys[i] = *(sorted[i].key);
+    }
+    rum_free(sorted, (scan->nkeys + 1) * sizeof(*sorted));
+    return sidecar;
+}
+
+/* error handling: ensure last error message is retained, free allocated memory, return NULL */
+static rum_sidecar_t *
+rum_sidecar_build_error(rum_parser_t **headp, rum_buffer_t *buffer, rum_element_t *root,
+    struct sidecar_scan_s *scan)
+{
+    /* save error message because later calls will wipe it */
+    char *errmsg = rum_last_error();
+
+    rum_parser_free(headp);
+    rum_buffer_free(buffer);
+    if (root) {
+        rum_element_free(root);
+    }
+    free_scan(scan);
+    rum_set_error(errmsg);
+    return NULL;
+}
+
+rum_sidecar_t *
+rum_sidecar_build(FILE *fp, const rum_tag_t *language,
+    const char **tag_names, const char **attr_names, int nkeys)
+{
+    struct sidecar_scan_s scan;
+    rum_parser_t *head = NULL;
+    rum_buffer_t *buffer = NULL;
+    rum_element_t *current, *element, *root = NULL;
+    rum_sidecar_t *sidecar;
+    uint64_t offset = 0, tag_start = 0;
+    size_t depth = 0;
+    int c;
+
+    rum_set_error(NULL);
+    memset(&scan, 0, sizeof(scan));
+    if ((fp == NULL) || (language == NULL) || (nkeys < 0) || (nkeys && ((tag_names == NULL) || (attr_names == NULL)))) {
+        rum_set_error("Programmer error: Unable to build index with nonexistent settings");
+        return NULL;
+    }
+    if ((init_scan(&scan, language, tag_names, attr_names, nkeys) < 0)
+        || ((head = rum_parser_new()) == NULL) || ((buffer = rum_buffer_new()) == NULL)) {
+        return rum_sidecar_build_error(&head, buffer, root, &scan);
+    }
+
+    /* parse input a character at a time, exactly as rum_parse_file() does, noting where each element starts */
+    while ((c = getc(fp)) != EOF) {
+        if ((c == '<') && (head->state == RUM_CONTENT)) {
+            tag_start = offset;
+        }
+        current = head->element;
+        element = rum_parser_parse_byte(&head, language, buffer, c);
+        if (rum_last_error()) {
+            return rum_sidecar_build_error(&head, buffer, root, &scan);
+        }
+        ++offset;
+
+        /* a new element was started */
+        if (head->element && (head->element != current) && (rum_element_get_parent(head->element) == current)) {
+            if (grow_array((void **) &(scan.starts), &(scan.starts_capacity), depth + 1,
+                           sizeof(*(scan.starts))) < 0) {
+                return rum_sidecar_build_error(&head, buffer, root, &scan);
+            }
+            scan.starts[depth++] = tag_start;
+            if (current == NULL) {
+                root = head->element;
+            }
+        }
+
+        /* an element was finished; once it is recorded, only the root needs to be kept */
+        if (element && (element != head->element)) {
+            if (record_element(&scan, element, scan.starts[--depth], offset) < 0) {
+                return rum_sidecar_build_error(&head, buffer, root, &scan);
+            }
+            if (rum_element_get_parent(element) != NULL) {
+                rum_element_free(element);
+            }
+        }
+
+        if (buffer->pos >= RUM_SIDECAR_COMPACT_SIZE) {
+            rum_buffer_compact(buffer);
+        }
+    }
+
+    if (root == NULL) {
+        rum_set_error("Root tag not found in input");
+        return rum_sidecar_build_error(&head, buffer, root, &scan);
+    }
+    if (depth || RUM_BUFFER_IN_CHAR(buffer)) {
+        rum_set_error("All tags not closed");
+        return rum_sidecar_build_error(&head, buffer, root, &scan);
+    }
+
+    if ((sidecar = finish_scan(&scan, language, offset)) == NULL) {
+        return rum_sidecar_build_error(&head, buffer, root, &scan);
+    }
+    rum_parser_free(&head);
+    rum_buffer_free(buffer);
+    rum_element_free(root);
+    free_scan(&scan);
+    return sidecar;
+}
+
+void
+rum_sidecar_free(rum_sidecar_t *sidecar)
+{
+    rum_set_error(NULL);
+    if (sidecar) {
+        if (sidecar->is_mapped) {
+            munmap(sidecar->data, sidecar->size);
+        } else {
+            rum_free(sidecar->data, sidecar->size);
+        }
+        rum_free(sidecar, sizeof(rum_sidecar_t));
+    }
+}
+
+int
+rum_sidecar_save(const rum_sidecar_t *sidecar, const char *path)
+{
+    FILE *fp;
+    int rc = 0;
+
+    rum_set_error(NULL);
+    if ((sidecar == NULL) || (path == NULL)) {
+        rum_set_error("Programmer error: Unable to save nonexistent index");
+        return -1;
+    }
+    if ((fp = fopen(path, "wb")) == NULL) {
+        rum_set_error("Unable to open index file for writing");
+        return -1;
+    }
+    if (fwrite(sidecar->data, 1, sidecar->size, fp) != sidecar->size) {
+        rc = -1;
+    }
+    if ((fclose(fp) != 0) || (rc < 0)) {
+        rum_set_error("Unable to write index file");
+        return -1;
+    }
+    return 0;
+}
+
+/* return true if a section of count items of the given size fits within a file */
+static int
+section_fits(uint64_t offset, uint64_t count, size_t size, size_t file_size)
+{
+    return (offset <= file_size) && (count <= (file_size - offset) / size) && !(offset % sizeof(uint64_t));
+}
+
+/* return true if a range is consistent with the index's source file and language */
+static int
+range_is_valid(const rum_sidecar_range_t *range, const struct rum_sidecar_header_s *header, int ntags)
+{
+    return (range->tag_id < (uint32_t) ntags) && (range->start < range->end) && (range->end <= header->source_size);
+}
+
+/* check a mapped index against the file size and language */
+static int
+validate_sidecar(const char *map, size_t file_size, const rum_tag_t *language)
+{
+    const struct rum_sidecar_header_s *header = (const void *) map;
+    const rum_sidecar_range_t *children;
+    const struct rum_sidecar_keyspec_s *keyspecs;
+    const struct rum_sidecar_key_s *keys;
+    const rum_tag_t *tag;
+    int ntags = rum_language_get_ntags(language);
+    uint64_t i;
+
+    if (memcmp(header->magic, RUM_SIDECAR_MAGIC, sizeof(RUM_SIDECAR_MAGIC))
+        || (header->byte_order != RUM_SIDECAR_BYTE_ORDER)) {
+        rum_set_error("File is not an index");
+        return -1;
+    }
+    if (header->version != RUM_SIDECAR_VERSION) {
+        rum_set_error("Index version is not supported");
+        return -1;
+    }
+    if (header->fingerprint != rum_language_fingerprint(language)) {
+        rum_set_error("Index was built with a different language");
+        return -1;
+    }
+    if (!section_fits(header->children_offset, header->nchildren, sizeof(*children), file_size)
+        || !section_fits(header->keyspecs_offset, header->nkeyspecs, sizeof(*keyspecs), file_size)
+        || !section_fits(header->keys_offset, header->nkeys, sizeof(*keys), file_size)
+        || (header->strings_offset > file_size) || (header->strings_size > file_size - header->strings_offset)
+        || (header->strings_size && map[header->strings_offset + header->strings_size - 1])) {
+        rum_set_error("Index is corrupt");
+        return -1;
+    }
+
+    children = (const void *) (map + header->children_offset);
+    for (i = 0; i < header->nchildren; ++i) {
+        if (!range_is_valid(&(children[i]), header, ntags)) {
+            rum_set_error("Index is corrupt");
+            return -1;
+        }
+    }
+    keyspecs = (const void *) (map + header->keyspecs_offset);
+    for (i = 0; i < header->nkeyspecs; ++i) {
+        if ((keyspecs[i].tag_id >= (uint32_t) ntags)
+            || ((tag = rum_language_get_tag(language, keyspecs[i].tag_id)) == NULL)
+            || (keyspecs[i].handle >= (uint32_t) rum_tag_get_nattrs(tag))) {
+            rum_set_error("Index is corrupt");
+            return -1;
+        }
+    }
+    keys = (const void *) (map + header->keys_offset);
+    for (i = 0; i < header->nkeys; ++i) {
+        if ((keys[i].keyspec >= header->nkeyspecs) || (keys[i].value >= header->strings_size)
+            || !range_is_valid(&(keys[i].range), header, ntags)) {
+            rum_set_error("Index is corrupt");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+rum_sidecar_t *
+rum_sidecar_load(const char *path, const rum_tag_t *language)
+{
+    rum_sidecar_t *sidecar;
+    struct stat st;
+    void *map;
+    int fd;
+
+    rum_set_error(NULL);
+    if ((path == NULL) || (language == NULL)) {
+        rum_set_error("Programmer error: Unable to load index with nonexistent settings");
+        return NULL;
+    }
+
+    /* map the whole file */
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        rum_set_error("Unable to open index file");
+        return NULL;
+    }
+    if ((fstat(fd, &st) < 0) || ((size_t) st.st_size < sizeof(struct rum_sidecar_header_s))
+        || ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)) {
+        close(fd);
+        rum_set_error("Unable to map index file");
+        return NULL;
+    }
+    close(fd);
+
+    if (validate_sidecar(map, st.st_size, language) < 0) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    if ((sidecar = rum_malloc(sizeof(rum_sidecar_t))) == NULL) {
+        munmap(map, st.st_size);
+        rum_set_error("Unable to allocate memory for index");
+        return NULL;
+    }
+    sidecar->language = language;
+    sidecar->data = map;
+    sidecar->size = st.st_size;
+    sidecar->is_mapped = 1;
+    return sidecar;
+}
+
+uint64_t
+rum_sidecar_get_nchildren(const rum_sidecar_t *sidecar)
+{
+    rum_set_error(NULL);
+    return sidecar? ((const struct rum_sidecar_header_s *) sidecar->data)->nchildren : 0;
+}
+
+const rum_sidecar_range_t *
+rum_sidecar_find_child(const rum_sidecar_t *sidecar, uint64_t n)
+{
+    const struct rum_sidecar_header_s *header;
+
+    rum_set_error(NULL);
+    if (sidecar == NULL) {
+        rum_set_error("Programmer error: Unable to search nonexistent index");
+        return NULL;
+    }
+    header = (const void *) sidecar->data;
+    if (n >= header->nchildren) {
+        return NULL;
+    }
+    return &(((const rum_sidecar_range_t *) (sidecar->data + header->children_offset))[n]);
+}
+
+const rum_sidecar_range_t *
+rum_sidecar_find_key(const rum_sidecar_t *sidecar, const char *tag_name, const char *attr_name, const char *value)
+{
+    const struct rum_sidecar_header_s *header;
+    const struct rum_sidecar_keyspec_s *keyspecs;
+    const struct rum_sidecar_key_s *keys;
+    const char *strings;
+    const rum_tag_t *tag;
+    uint64_t i, lo, hi, mid;
+
+    rum_set_error(NULL);
+    if ((sidecar == NULL) || (tag_name == NULL) || (attr_name == NULL) || (value == NULL)) {
+        rum_set_error("Programmer error: Unable to search nonexistent index");
+        return NULL;
+    }
+    header = (const void *) sidecar->data;
+    keyspecs = (const void *) (sidecar->data + header->keyspecs_offset);
+    keys = (const void *) (sidecar->data + header->keys_offset);
+    strings = sidecar->data + header->strings_offset;
+
+    for (i = 0; i < header->nkeyspecs; ++i) {
+        tag = rum_language_get_tag(sidecar->language, keyspecs[i].tag_id);
+        if (strcmp(rum_tag_get_name(tag), tag_name)
+            || strcmp(rum_tag_get_attr_name(tag, keyspecs[i].handle), attr_name)) {
+            continue;
+        }
+
+        /* find the first record that is not less than (i, value) */
+        for (lo = 0, hi = header->nkeys; lo < hi; ) {
+            mid = lo + (hi - lo) / 2;
+            if ((keys[mid].keyspec < i) || ((keys[mid].keyspec == i) && (strcmp(strings + keys[mid].value, value) < 0))) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if ((lo < header->nkeys) && (keys[lo].keyspec == i) && !strcmp(strings + keys[lo].value, value)) {
+            return &(keys[lo].range);
+        }
+    }
+    return NULL;
+}
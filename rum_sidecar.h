@@ -0,0 +1,115 @@
+/*
+    rum_sidecar.h
+
+    sidecar offset indexes for random access into RuM files
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_SIDECAR__H
+#define RUM_SIDECAR__H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <rum_types.h>
+
+/*
+ * A sidecar index is built by one scan of a RuM file, and records the byte range of each
+ * child of the root element, and of each element with a value for one of a configurable set
+ * of key attributes. A single element can then be parsed from the file by its range,
+ * without parsing anything else.
+ *
+ * An index file holds a header, then the child ranges in document order, then the key
+ * specifications, then the key records sorted by key and value, then a pool of
+ * null-terminated strings. As with snapshots, numbers are in the byte order of the
+ * machine that built the index.
+ */
+
+#define RUM_SIDECAR_MAGIC "RuMidx"
+#define RUM_SIDECAR_VERSION (1)
+#define RUM_SIDECAR_BYTE_ORDER (0x01020304)
+
+/* index file header */
+struct rum_sidecar_header_s {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+
+    /* fingerprint of the language that the file was scanned with */
+    uint64_t fingerprint;
+
+    /* size of the indexed file, to catch use of an index with a different file */
+    uint64_t source_size;
+
+    /* location and size of each section */
+    uint64_t nchildren;
+    uint64_t children_offset;
+    uint64_t nkeyspecs;
+    uint64_t keyspecs_offset;
+    uint64_t nkeys;
+    uint64_t keys_offset;
+    uint64_t strings_size;
+    uint64_t strings_offset;
+};
+
+/* byte range of one element within the indexed file: from its '<' up to and including its final '>' */
+struct rum_sidecar_range_s {
+    uint64_t start;
+    uint64_t end;   /* one past the last byte */
+    uint32_t tag_id;
+    uint32_t reserved;
+};
+
+/* a key attribute: the attribute with the given handle of the tag with the given id */
+struct rum_sidecar_keyspec_s {
+    uint32_t tag_id;
+    uint32_t handle;
+};
+
+/* an element with a value for a key attribute */
+struct rum_sidecar_key_s {
+    /* index of the key specification */
+    uint64_t keyspec;
+
+    /* offset of the value in the string pool */
+    uint64_t value;
+
+    rum_sidecar_range_t range;
+};
+
+/* sidecar index; data holds the index in its file layout, whether built in memory or mapped from a file */
+struct rum_sidecar_s {
+    const rum_tag_t *language;
+    char *data;
+    size_t size;
+    int is_mapped;
+};
+
+/* index a file, scanning it once with full validation, and recording the range of each child of the root
+ * and of each element with a value for attr_names[i] of a tag named tag_names[i] (for i < nkeys)
+ */
+rum_sidecar_t *rum_sidecar_build(FILE *fp, const rum_tag_t *language,
+        const char **tag_names, const char **attr_names, int nkeys);
+
+/* destructor */
+void rum_sidecar_free(rum_sidecar_t *sidecar);
+
+/* save an index to a file, returning 0 on success or -1 on error */
+int rum_sidecar_save(const rum_sidecar_t *sidecar, const char *path);
+
+/* load an index saved with the same language; the file is mapped into memory rather than read */
+rum_sidecar_t *rum_sidecar_load(const char *path, const rum_tag_t *language);
+
+/* return the number of children of the root element in the indexed file */
+uint64_t rum_sidecar_get_nchildren(const rum_sidecar_t *sidecar);
+
+/* return the range of the nth (counting from 0) child of the root element, or NULL if there is none */
+const rum_sidecar_range_t *rum_sidecar_find_child(const rum_sidecar_t *sidecar, uint64_t n);
+
+/* return the range of the first element of a tag named tag_name whose attr_name attribute equals value,
+ * or NULL if there is none (or the attribute was not indexed)
+ */
+const rum_sidecar_range_t *rum_sidecar_find_key(const rum_sidecar_t *sidecar, const char *tag_name,
+        const char *attr_name, const char *value);
+
+#endif /* RUM_SIDECAR__H */
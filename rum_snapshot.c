@@ -0,0 +1,552 @@
+/*
+    rum_snapshot.c
+
+    binary snapshot functions for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <rump.h>
+#include "rum_private.h"
+
+/* initial number of hash slots for the strings of a snapshot being saved (must be a power of two) */
+#define RUM_SNAPSHOT_INITIAL_SLOTS (256)
+
+/* string pool of a snapshot being saved, with each distinct string stored once */
+struct snapshot_strings_s {
+    /* open-addressed hash table of pool offsets plus one (zero meaning empty) */
+    uint64_t *slots;
+    size_t nslots;
+    size_t nstrings;
+
+    /* the pool itself */
+    char *pool;
+    size_t size;
+    size_t capacity;
+};
+
+/* initialize an empty string pool for a snapshot being saved */
+static int
+init_strings(struct snapshot_strings_s *strings)
+{
+    strings->nslots = RUM_SNAPSHOT_INITIAL_SLOTS;
+    strings->nstrings = 0;
+    strings->pool = NULL;
+    strings->size = 0;
+    strings->capacity = 0;
+    if ((strings->slots = rum_malloc(strings->nslots * sizeof(uint64_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for snapshot");
+        return -1;
+    }
+    memset(strings->slots, 0, strings->nslots * sizeof(uint64_t));
+    return 0;
+}
+
+/* free the string pool of a snapshot being saved */
+static void
+free_strings(struct snapshot_strings_s *strings)
+{
+    rum_free(strings->slots, strings->nslots * sizeof(uint64_t));
+    rum_free(strings->pool, strings->capacity);
+}
+
+/* return the next element after element in document order, or NULL when the subtree of root is done,
+ * adjusting depth by the change in nesting level
+ */
+static const rum_element_t *
+next_in_document(const rum_element_t *element, const rum_element_t *root, int *depth)
+{
+    if (element->first_child) {
+        ++(*depth);
+        return element->first_child;
+    }
+    for (; element != root; element = element->parent, --(*depth)) {
+        if (element->next_sibling) {
+            return element->next_sibling;
+        }
+    }
+    return NULL;
+}
+
+/* hash of a string */
+static size_t
+hash_str(const char *str)
+{
+    return rum_hash_bytes(RUM_HASH_INIT, str, strlen(str));
+}
+
+/* double the size of the string hash table */
+static int
+grow_strings(struct snapshot_strings_s *strings)
+{
+    uint64_t *slots;
+    size_t i, j, nslots = strings->nslots * 2;
+
+    if ((slots = rum_malloc(nslots * sizeof(uint64_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for snapshot");
+        return -1;
+    }
+    memset(slots, 0, nslots * sizeof(uint64_t));
+    for (i = 0; i < strings->nslots; ++i) {
+        if (strings->slots[i]) {
+            j = hash_str(strings->pool + strings->slots[i] - 1) & (nslots - 1);
+            while (slots[j]) {
+                j = (j + 1) & (nslots - 1);
+            }
+            slots[j] = strings->slots[i];
+        }
+    }
+    rum_free(strings->slots, strings->nslots * sizeof(uint64_t));
+    strings->slots = slots;
+    strings->nslots = nslots;
+    return 0;
+}
+
+/* return the pool offset plus one of a string, adding it to the pool if needed (0 for NULL, -1 on error) */
+static int64_t
+add_string(struct snapshot_strings_s *strings, const char *str)
+{
+    size_t i, len, capacity;
+    char *pool;
+
+    if (str == NULL) {
+        return 0;
+    }
+    if ((strings->nstrings + 1) * 2 > strings->nslots) {
+        if (grow_strings(strings) < 0) {
+            return -1;
+        }
+    }
+    for (i = hash_str(str) & (strings->nslots - 1); strings->slots[i]; i = (i + 1) & (strings->nslots - 1)) {
+        if (!strcmp(strings->pool + strings->slots[i] - 1, str)) {
+            return strings->slots[i];
+        }
+    }
+
+    len = strlen(str) + 1;
+    if (strings->size + len > strings->capacity) {
+        for (capacity = strings->capacity? strings->capacity : CHUNKSIZE; strings->size + len > capacity;
+             capacity *= 2);
+        if ((pool = rum_realloc(strings->pool, strings->capacity, capacity)) == NULL) {
+            rum_set_error("Unable to allocate memory for snapshot");
+            return -1;
+        }
+        strings->pool = pool;
+        strings->capacity = capacity;
+    }
+    memcpy(strings->pool + strings->size, str, len);
+    strings->slots[i] = strings->size + 1;
+    strings->size += len;
+    ++(strings->nstrings);
+    return strings->slots[i];
+}
+
+/* write all sections of a snapshot to a file */
+static int
+write_snapshot(const char *path, struct rum_snapshot_header_s *header, struct rum_snapshot_node_s *nodes,
+    struct rum_snapshot_value_s *values, struct snapshot_strings_s *strings)
+{
+    FILE *fp;
+    int rc = 0;
+
+    if ((fp = fopen(path, "wb")) == NULL) {
+        rum_set_error("Unable to open snapshot file for writing");
+        return -1;
+    }
+    if ((fwrite(header, sizeof(*header), 1, fp) != 1)
+        || (fwrite(nodes, sizeof(*nodes), header->nnodes, fp) != header->nnodes)
+        || (fwrite(values, sizeof(*values), header->nvalues, fp) != header->nvalues)
+        || (fwrite(strings->pool, 1, strings->size, fp) != strings->size)) {
+        rc = -1;
+    }
+    if ((fclose(fp) != 0) || (rc < 0)) {
+        rum_set_error("Unable to write snapshot file");
+        return -1;
+    }
+    return 0;
+}
+
+/* fill in the nodes, values and strings of a snapshot in document order */
+static int
+fill_snapshot(const rum_element_t *root, struct rum_snapshot_node_s *nodes, struct rum_snapshot_value_s *values,
+    struct snapshot_strings_s *strings)
+{
+    const rum_element_t *element;
+    uint32_t *last = NULL, *newlast;
+    size_t i, v = 0, maxdepth = 0;
+    int64_t offset;
+    int depth = 0, j, rc = 0;
+
+    /* last[d] is the most recent node at depth d */
+    for (i = 0, element = root; element && (rc == 0); ++i, element = next_in_document(element, root, &depth)) {
+        if ((size_t) depth >= maxdepth) {
+            if ((newlast = rum_realloc(last, maxdepth * sizeof(uint32_t),
+                                       (maxdepth + 64) * sizeof(uint32_t))) == NULL) {
+                rum_set_error("Unable to allocate memory for snapshot");
+                rc = -1;
+                break;
+            }
+            last = newlast;
+            maxdepth += 64;
+        }
+
+        nodes[i].tag_id = element->tag->id;
+        nodes[i].parent = depth? (last[depth - 1] + 1) : 0;
+        nodes[i].next_sibling = 0;
+        nodes[i].first_child = 0;
+        if (depth) {
+            if (element->parent->first_child == element) {
+                nodes[last[depth - 1]].first_child = i + 1;
+            } else {
+                nodes[last[depth]].next_sibling = i + 1;
+            }
+        }
+        last[depth] = i;
+
+        if ((offset = add_string(strings, rum_str_get(&(element->content)))) < 0) {
+            rc = -1;
+            break;
+        }
+        nodes[i].content = offset;
+        nodes[i].values = v;
+        for (j = 0; j < element->tag->nattrs; ++j, ++v) {
+            if ((offset = add_string(strings, rum_str_get(&(element->values[j])))) < 0) {
+                rc = -1;
+                break;
+            }
+            values[v].text = offset;
+            values[v].binary = 0;
+            if (element->tag->has_typed_attrs) {
+                memcpy(&(values[v].binary), &(rum_element_binary(element)[j]), sizeof(rum_binary_t));
+            }
+        }
+    }
+    rum_free(last, maxdepth * sizeof(uint32_t));
+    return rc;
+}
+
+int
+rum_document_save(const rum_document_t *document, const rum_tag_t *language, const char *path)
+{
+    struct rum_snapshot_header_s header;
+    struct rum_snapshot_node_s *nodes;
+    struct rum_snapshot_value_s *values;
+    struct snapshot_strings_s strings;
+    const rum_element_t *element;
+    size_t nnodes = 0, nvalues = 0;
+    int depth = 0, rc;
+
+    rum_set_error(NULL);
+    if ((document == NULL) || (document->root == NULL) || (language == NULL) || (path == NULL)) {
+        rum_set_error("Programmer error: Unable to save nonexistent document");
+        return -1;
+    }
+
+    /* size the sections (allocating at least one value, so the allocation is never empty) */
+    for (element = document->root; element; element = next_in_document(element, document->root, &depth)) {
+        ++nnodes;
+        nvalues += element->tag->nattrs;
+    }
+    if (nnodes >= UINT32_MAX) {
+        rum_set_error("Document is too large for a snapshot");
+        return -1;
+    }
+    if ((nodes = rum_malloc(nnodes * sizeof(*nodes))) == NULL) {
+        rum_set_error("Unable to allocate memory for snapshot");
+        return -1;
+    }
+    if ((values = rum_malloc((nvalues + 1) * sizeof(*values))) == NULL) {
+        rum_free(nodes, nnodes * sizeof(*nodes));
+        rum_set_error("Unable to allocate memory for snapshot");
+        return -1;
+    }
+    if ((rc = init_strings(&strings)) == 0) {
+        rc = fill_snapshot(document->root, nodes, values, &strings);
+    }
+
+    if (rc == 0) {
+        memset(&header, 0, sizeof(header));
+        strcpy(header.magic, RUM_SNAPSHOT_MAGIC);
+        header.version = RUM_SNAPSHOT_VERSION;
+        header.byte_order = RUM_SNAPSHOT_BYTE_ORDER;
+        header.fingerprint = rum_language_fingerprint(language);
+        header.nnodes = nnodes;
+        header.nodes_offset = sizeof(header);
+        header.nvalues = nvalues;
+        header.values_offset = header.nodes_offset + nnodes * sizeof(*nodes);
+        header.strings_size = strings.size;
+        header.strings_offset = header.values_offset + nvalues * sizeof(*values);
+        rc = write_snapshot(path, &header, nodes, values, &strings);
+    }
+
+    free_strings(&strings);
+    rum_free(nodes, nnodes * sizeof(*nodes));
+    rum_free(values, (nvalues + 1) * sizeof(*values));
+    return rc;
+}
+
+/* return true if a section of count items of the given size lies within a file */
+static int
+section_fits(uint64_t offset, uint64_t count, size_t size, size_t file_size)
+{
+    return (offset <= file_size) && (count <= (file_size - offset) / size);
+}
+
+/* return true if an attribute value of a snapshot points into the string pool, and a typed value
+ * that is stored as an index (an enumerated value) is within its attribute's list of values
+ */
+static int
+value_is_valid(const struct rum_snapshot_header_s *header, const struct rum_snapshot_value_s *value,
+    const rum_attr_t *attr)
+{
+    rum_binary_t binary;
+    long nvalues;
+
+    if (value->text > header->strings_size) {
+        return 0;
+    }
+    if (value->text && (attr->type == RUM_ATTR_ENUM)) {
+        memcpy(&binary, &(value->binary), sizeof(rum_binary_t));
+        for (nvalues = 0; attr->enum_values[nvalues]; ++nvalues);
+        if ((binary.integer < 0) || (binary.integer >= nvalues)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* check that a snapshot's nodes describe a valid tree in document order for the language,
+ * with values that can be used as they are, and return the total size of the elements they
+ * describe (or 0 if invalid)
+ */
+static size_t
+validate_nodes(const struct rum_snapshot_header_s *header, const struct rum_snapshot_node_s *nodes,
+    const struct rum_snapshot_value_s *values, const rum_tag_t **tags, int ntags)
+{
+    const struct rum_snapshot_node_s *node;
+    const rum_tag_t *tag;
+    size_t size = 0;
+    uint64_t i;
+    int j;
+
+    for (i = 0; i < header->nnodes; ++i) {
+        node = nodes + i;
+        if (node->tag_id >= (uint32_t) ntags) {
+            return 0;
+        }
+        tag = tags[node->tag_id];
+
+        /* in document order, parents come earlier, first children immediately follow,
+         * and next siblings come later, so the tree cannot have cycles
+         */
+        if ((i == 0)? ((node->parent != 0) || (tag->parent != NULL))
+                : ((node->parent == 0) || (node->parent > i)
+                   || (tag->parent != tags[nodes[node->parent - 1].tag_id]))) {
+            return 0;
+        }
+        if ((node->first_child && ((node->first_child != i + 2) || (node->first_child > header->nnodes)
+                                   || (nodes[node->first_child - 1].parent != i + 1)))
+            || (node->next_sibling && ((node->next_sibling <= i + 1) || (node->next_sibling > header->nnodes)
+                                       || (nodes[node->next_sibling - 1].parent != node->parent)))) {
+            return 0;
+        }
+        if ((node->content > header->strings_size) || (node->values > header->nvalues)
+            || ((uint64_t) tag->nattrs > header->nvalues - node->values)) {
+            return 0;
+        }
+        for (j = 0; j < tag->nattrs; ++j) {
+            if (!value_is_valid(header, values + node->values + j, &(tag->attrs[j]))) {
+                return 0;
+            }
+        }
+        size += rum_element_size(tag);
+    }
+    return size;
+}
+
+/* build the elements of a loaded snapshot in a single block, with text pointing into the mapping */
+static rum_element_t *
+build_elements(const struct rum_snapshot_header_s *header, const char *map, const rum_tag_t **tags,
+    void *block)
+{
+    const struct rum_snapshot_node_s *nodes = (const void *) (map + header->nodes_offset);
+    const struct rum_snapshot_value_s *values = (const void *) (map + header->values_offset);
+    const char *pool = map + header->strings_offset;
+    rum_element_t **elements, *element;
+    char *next = block;
+    uint64_t i;
+    int j;
+
+    /* elements are created in document order, so keep track of them to link later ones */
+    if ((elements = rum_malloc(header->nnodes * sizeof(rum_element_t *))) == NULL) {
+        rum_set_error("Unable to allocate memory for snapshot");
+        return NULL;
+    }
+    for (i = 0; i < header->nnodes; ++i) {
+        element = elements[i] = (rum_element_t *) next;
+        element->tag = tags[nodes[i].tag_id];
+        next += rum_element_size(element->tag);
+
+        element->parent = nodes[i].parent? elements[nodes[i].parent - 1] : NULL;
+        element->next_sibling = NULL;
+        element->first_child = NULL;
+        element->offset = 0;
+        element->length = 0;
+        element->hash = 0;
+        if (nodes[i].parent && (nodes[nodes[i].parent - 1].first_child == i + 1)) {
+            element->parent->first_child = element;
+        }
+
+        element->content.kind = RUM_STR_UNSET;
+        if (nodes[i].content) {
+            rum_str_set_ptr(&(element->content), RUM_STR_SHARED, pool + nodes[i].content - 1);
+        }
+        for (j = 0; j < element->tag->nattrs; ++j) {
+            element->values[j].kind = RUM_STR_UNSET;
+            if (values[nodes[i].values + j].text) {
+                rum_str_set_ptr(&(element->values[j]), RUM_STR_SHARED, pool + values[nodes[i].values + j].text - 1);
+            }
+            if (element->tag->has_typed_attrs) {
+                memcpy(&(rum_element_binary(element)[j]), &(values[nodes[i].values + j].binary),
+                       sizeof(rum_binary_t));
+            }
+        }
+    }
+
+    /* link siblings */
+    for (i = 0; i < header->nnodes; ++i) {
+        if (nodes[i].next_sibling) {
+            elements[i]->next_sibling = elements[nodes[i].next_sibling - 1];
+        }
+    }
+
+    element = elements[0];
+    rum_free(elements, header->nnodes * sizeof(rum_element_t *));
+    return element;
+}
+
+/* check a mapped snapshot's header against the file size and language */
+static int
+validate_header(const struct rum_snapshot_header_s *header, size_t file_size, const rum_tag_t *language)
+{
+    const char *map = (const char *) header;
+
+    if (memcmp(header->magic, RUM_SNAPSHOT_MAGIC, sizeof(RUM_SNAPSHOT_MAGIC))
+        || (header->byte_order != RUM_SNAPSHOT_BYTE_ORDER)) {
+        rum_set_error("File is not a snapshot");
+        return -1;
+    }
+    if (header->version != RUM_SNAPSHOT_VERSION) {
+        rum_set_error("Snapshot version is not supported");
+        return -1;
+    }
+    if (header->fingerprint != rum_language_fingerprint(language)) {
+        rum_set_error("Snapshot was saved with a different language");
+        return -1;
+    }
+    if ((header->nnodes == 0)
+        || !section_fits(header->nodes_offset, header->nnodes, sizeof(struct rum_snapshot_node_s), file_size)
+        || !section_fits(header->values_offset, header->nvalues, sizeof(struct rum_snapshot_value_s), file_size)
+        || !section_fits(header->strings_offset, header->strings_size, 1, file_size)
+        || (header->nodes_offset % sizeof(uint64_t)) || (header->values_offset % sizeof(uint64_t))
+        || (header->strings_size && map[header->strings_offset + header->strings_size - 1])) {
+        rum_set_error("Snapshot is corrupt");
+        return -1;
+    }
+    return 0;
+}
+
+/* error handling: ensure last error message is retained, free allocated memory, return NULL */
+static rum_document_t *
+rum_snapshot_load_error(void *map, size_t map_size, const rum_tag_t **tags, int ntags)
+{
+    /* save error message because later calls will wipe it */
+    char *errmsg = rum_last_error();
+
+    rum_free(tags, ntags * sizeof(rum_tag_t *));
+    munmap(map, map_size);
+    rum_set_error(errmsg);
+    return NULL;
+}
+
+rum_document_t *
+rum_document_load(const char *path, const rum_tag_t *language)
+{
+    const struct rum_snapshot_header_s *header;
+    const rum_tag_t **tags = NULL;
+    rum_document_t *document;
+    rum_element_t *root;
+    struct stat st;
+    void *map, *block;
+    size_t size;
+    int fd, ntags = 0;
+
+    rum_set_error(NULL);
+    if ((path == NULL) || (language == NULL)) {
+        rum_set_error("Programmer error: Unable to load snapshot with nonexistent settings");
+        return NULL;
+    }
+
+    /* map the whole file */
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        rum_set_error("Unable to open snapshot file");
+        return NULL;
+    }
+    if ((fstat(fd, &st) < 0) || ((size_t) st.st_size < sizeof(*header))
+        || ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)) {
+        close(fd);
+        rum_set_error("Unable to map snapshot file");
+        return NULL;
+    }
+    close(fd);
+
+    /* verify that the snapshot is intact and was produced with this language */
+    header = map;
+    if (validate_header(header, st.st_size, language) < 0) {
+        return rum_snapshot_load_error(map, st.st_size, tags, ntags);
+    }
+    ntags = rum_language_get_ntags(language);
+    if ((tags = rum_malloc(ntags * sizeof(rum_tag_t *))) == NULL) {
+        rum_set_error("Unable to allocate memory for snapshot");
+        return rum_snapshot_load_error(map, st.st_size, tags, ntags);
+    }
+    rum_language_get_tags(language, tags);
+    if ((size = validate_nodes(header, (const void *) ((const char *) map + header->nodes_offset),
+                               (const void *) ((const char *) map + header->values_offset), tags, ntags)) == 0) {
+        rum_set_error("Snapshot is corrupt");
+        return rum_snapshot_load_error(map, st.st_size, tags, ntags);
+    }
+
+    /* build the elements, all in one block, then the document around them */
+    if ((block = rum_malloc(size)) == NULL) {
+        rum_set_error("Unable to allocate memory for snapshot");
+        return rum_snapshot_load_error(map, st.st_size, tags, ntags);
+    }
+    if (((root = build_elements(header, map, tags, block)) == NULL)
+        || ((document = rum_document_new(root)) == NULL)) {
+        rum_free(block, size);
+        return rum_snapshot_load_error(map, st.st_size, tags, ntags);
+    }
+    rum_free(tags, ntags * sizeof(rum_tag_t *));
+    document->map = map;
+    document->map_size = st.st_size;
+    document->elements = block;
+    document->elements_size = size;
+    return document;
+}
+
+void
+rum_snapshot_release(rum_document_t *document)
+{
+    munmap(document->map, document->map_size);
+    rum_free(document->elements, document->elements_size);
+    document->map = NULL;
+    document->elements = NULL;
+}
@@ -0,0 +1,82 @@
+/*
+    rum_snapshot.h
+
+    binary snapshots of parsed documents for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_SNAPSHOT__H
+#define RUM_SNAPSHOT__H
+
+#include <stdint.h>
+#include <rum_types.h>
+
+/*
+ * A snapshot file holds a header, then an array of element nodes in document order,
+ * then an array of attribute value records, then a pool of null-terminated strings.
+ * All references within the file are indices or offsets, so the file can be mapped
+ * at any address. Numbers are stored in the byte order of the machine that saved it;
+ * a snapshot from a machine with a different byte order is rejected.
+ */
+
+#define RUM_SNAPSHOT_MAGIC "RuMsnap"
+#define RUM_SNAPSHOT_VERSION (1)
+#define RUM_SNAPSHOT_BYTE_ORDER (0x01020304)
+
+/* snapshot file header */
+struct rum_snapshot_header_s {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+
+    /* fingerprint of the language that the document was parsed with */
+    uint64_t fingerprint;
+
+    /* location and size of each section */
+    uint64_t nnodes;
+    uint64_t nodes_offset;
+    uint64_t nvalues;
+    uint64_t values_offset;
+    uint64_t strings_size;
+    uint64_t strings_offset;
+};
+
+/* one element; element references are node indices plus one (zero meaning none) */
+struct rum_snapshot_node_s {
+    uint32_t tag_id;
+    uint32_t parent;
+    uint32_t next_sibling;
+    uint32_t first_child;
+
+    /* offset of content in the string pool plus one (zero meaning unset) */
+    uint64_t content;
+
+    /* index of this element's first attribute value record (one record per attribute of the tag) */
+    uint64_t values;
+};
+
+/* one attribute value */
+struct rum_snapshot_value_s {
+    /* offset of the text in the string pool plus one (zero meaning unset) */
+    uint64_t text;
+
+    /* binary form of a typed value (the bytes of a rum_binary_t) */
+    uint64_t binary;
+};
+
+/* save a document to a snapshot file, returning 0 on success or -1 on error */
+int rum_document_save(const rum_document_t *document, const rum_tag_t *language, const char *path);
+
+/* load a document from a snapshot file saved with the same language
+ *
+ * the file is mapped into memory, and the document's text points directly into the mapping,
+ * so the file must not be modified while the document exists
+ *
+ * loading skips tokenizing, validation against the language and string decoding, but is not
+ * free: every node is checked, and rebuilt as an element in one allocated block, so it takes
+ * time and memory proportional to the number of elements (though no copies of the strings)
+ */
+rum_document_t *rum_document_load(const char *path, const rum_tag_t *language);
+
+#endif /* RUM_SNAPSHOT__H */
@@ -0,0 +1,139 @@
+/*
+    rum_stream.c
+
+    record stream functions for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <rump.h>
+#include "rum_private.h"
+
+rum_stream_t *
+rum_stream_new(FILE *fp, const rum_tag_t *language, const rum_parse_options_t *options)
+{
+    rum_stream_t *stream;
+
+    rum_set_error(NULL);
+    if ((fp == NULL) || (language == NULL)) {
+        rum_set_error("Programmer error: Unable to create stream with nonexistent settings");
+        return NULL;
+    }
+    if ((stream = rum_malloc(sizeof(rum_stream_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for stream");
+        return NULL;
+    }
+    memset(stream, 0, sizeof(rum_stream_t));
+    stream->fp = fp;
+    stream->language = language;
+    if (options) {
+        stream->options = *options;
+    }
+    if (((stream->cache = rum_element_cache_new(language)) == NULL)
+        || ((stream->head = rum_parser_new()) == NULL)
+        || ((stream->buffer = rum_buffer_new()) == NULL)) {
+        rum_stream_free(stream);
+        rum_set_error("Unable to allocate memory for stream");
+        return NULL;
+    }
+    stream->options.cache = stream->cache;
+    rum_parser_set_options(stream->head, &(stream->options));
+    return stream;
+}
+
+void
+rum_stream_free(rum_stream_t *stream)
+{
+    rum_set_error(NULL);
+    if (stream) {
+        rum_element_free(stream->record);
+        rum_parser_free(&(stream->head));
+        rum_buffer_free(stream->buffer);
+        rum_element_cache_free(stream->cache);
+        rum_free(stream, sizeof(rum_stream_t));
+    }
+}
+
+/* error handling: remember the error message, so later calls fail the same way, and return NULL */
+static rum_element_t *
+rum_stream_error(rum_stream_t *stream)
+{
+    stream->errmsg = rum_last_error();
+    return NULL;
+}
+
+rum_element_t *
+rum_stream_next(rum_stream_t *stream)
+{
+    rum_element_t *element;
+    int c;
+
+    rum_set_error(NULL);
+    if (stream == NULL) {
+        rum_set_error("Programmer error: Unable to read from nonexistent stream");
+        return NULL;
+    }
+    if (stream->errmsg) {
+        rum_set_error(stream->errmsg);
+        return NULL;
+    }
+
+    /* the previous record's elements and input are no longer needed */
+    if (stream->record) {
+        rum_element_release(stream->cache, stream->record);
+        stream->record = NULL;
+    }
+    rum_buffer_compact(stream->buffer);
+
+    while ((c = getc(stream->fp)) != EOF) {
+        element = rum_parser_parse_byte(&(stream->head), stream->language, stream->buffer, c);
+
+        /* note the record's root element as soon as it exists, so it is freed even on error */
+        if ((stream->record == NULL) && stream->head->element) {
+            stream->record = stream->head->element;
+        }
+        if (rum_last_error()) {
+            return rum_stream_error(stream);
+        }
+
+        /* the record is complete when its root element is popped off the parser stack */
+        if (element && (element == stream->record) && (element != stream->head->element)) {
+            ++(stream->nrecords);
+            return element;
+        }
+    }
+
+    if ((stream->record != NULL) || (stream->head->state != RUM_CONTENT) || RUM_BUFFER_IN_CHAR(stream->buffer)) {
+        rum_set_error("Stream ends inside a record");
+        return rum_stream_error(stream);
+    }
+    return NULL;
+}
+
+rum_element_t *
+rum_stream_keep(rum_stream_t *stream)
+{
+    rum_element_t *record;
+
+    rum_set_error(NULL);
+    if (stream == NULL) {
+        rum_set_error("Programmer error: Unable to keep record of nonexistent stream");
+        return NULL;
+    }
+    record = stream->record;
+    stream->record = NULL;
+    return record;
+}
+
+unsigned long
+rum_stream_get_nrecords(const rum_stream_t *stream)
+{
+    rum_set_error(NULL);
+    if (stream == NULL) {
+        rum_set_error("Programmer error: Unable to get record count of nonexistent stream");
+        return 0;
+    }
+    return stream->nrecords;
+}
@@ -0,0 +1,74 @@
+/*
+    rum_stream.h
+
+    declarations for parsing streams of records in RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_STREAM__H
+#define RUM_STREAM__H
+
+#include <stdio.h>
+#include <rum_types.h>
+#include <rum_parser.h>
+
+/*
+ * A record stream is a series of documents sent back to back on one file stream (optionally
+ * separated by white space, comments or processing instructions), each with the language's
+ * root tag as its outermost tag. Each call to rum_stream_next() returns the next record.
+ *
+ * The parser state, input buffer and elements are reused from one record to the next rather
+ * than rebuilt: the parser's states are kept for reuse once popped, the buffer discards each
+ * record's input but keeps its memory, and a record's elements are released to an element
+ * cache when the next record is read. Once the first few records have been parsed, reading
+ * a record of a similar shape allocates nothing (other than for long attribute values or
+ * content, which are stored out of line).
+ */
+
+struct rum_stream_s {
+    FILE *fp;
+    const rum_tag_t *language;
+
+    /* the caller's options, plus the stream's element cache */
+    rum_parse_options_t options;
+    rum_element_cache_t *cache;
+
+    rum_parser_t *head;
+    rum_buffer_t *buffer;
+
+    /* the record most recently returned, released when the next one is read */
+    rum_element_t *record;
+
+    /* number of records read so far */
+    unsigned long nrecords;
+
+    /* once an error occurs, no more records can be read */
+    char *errmsg;
+};
+
+/* constructor: read records from an open file stream, parsing them according to a language
+ * with the given options (which may be NULL, and are copied)
+ */
+rum_stream_t *rum_stream_new(FILE *fp, const rum_tag_t *language, const rum_parse_options_t *options);
+
+/* destructor (frees the most recently returned record, and the stream's element cache) */
+void rum_stream_free(rum_stream_t *stream);
+
+/* return the next record's root element, or NULL at the end of the stream (with no error message)
+ * or on error (with one)
+ *
+ * the record belongs to the stream, and is valid only until the next call to rum_stream_next()
+ * or rum_stream_free(); rum_stream_keep() can be used to keep it longer
+ */
+rum_element_t *rum_stream_next(rum_stream_t *stream);
+
+/* take ownership of the record most recently returned, so that it is not released when the next
+ * record is read; the caller must free it with rum_element_free()
+ */
+rum_element_t *rum_stream_keep(rum_stream_t *stream);
+
+/* return the number of records read so far */
+unsigned long rum_stream_get_nrecords(const rum_stream_t *stream);
+
+#endif /* RUM_STREAM__H */
@@ -0,0 +1,173 @@
+/*
+    rum_strpool.c
+
+    string interning pool functions for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rump.h>
+#include "rum_private.h"
+
+/* initial number of hash slots in a pool (must be a power of two) */
+#define RUM_STRPOOL_INITIAL_SLOTS (64)
+
+
+rum_strpool_t *
+rum_strpool_new()
+{
+    rum_strpool_t *pool;
+
+    rum_set_error(NULL);
+    if ((pool = rum_malloc(sizeof(rum_strpool_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for string pool");
+        return NULL;
+    }
+    if ((pool->slots = rum_malloc(RUM_STRPOOL_INITIAL_SLOTS * sizeof(char *))) == NULL) {
+        rum_set_error("Unable to allocate memory for string pool");
+        rum_free(pool, sizeof(rum_strpool_t));
+        return NULL;
+    }
+    memset(pool->slots, 0, RUM_STRPOOL_INITIAL_SLOTS * sizeof(char *));
+    pool->nslots = RUM_STRPOOL_INITIAL_SLOTS;
+    pool->nstrings = 0;
+    pool->blocks = NULL;
+    return pool;
+}
+
+void
+rum_strpool_free(rum_strpool_t *pool)
+{
+    struct rum_strpool_block_s *block;
+
+    rum_set_error(NULL);
+    if (pool) {
+        while ((block = pool->blocks) != NULL) {
+            pool->blocks = block->next;
+            rum_free(block, sizeof(struct rum_strpool_block_s) + block->size);
+        }
+        rum_free(pool->slots, pool->nslots * sizeof(char *));
+        rum_free(pool, sizeof(rum_strpool_t));
+    }
+}
+
+/* double the size of the hash table, rehashing all pooled strings */
+static int
+rum_strpool_grow(rum_strpool_t *pool)
+{
+    const char **slots;
+    size_t i, j, nslots = pool->nslots * 2;
+
+    if ((slots = rum_malloc(nslots * sizeof(char *))) == NULL) {
+        rum_set_error("Unable to allocate memory to extend string pool");
+        return -1;
+    }
+    memset(slots, 0, nslots * sizeof(char *));
+    for (i = 0; i < pool->nslots; ++i) {
+        if (pool->slots[i]) {
+            j = rum_hash_bytes(RUM_HASH_INIT, pool->slots[i], strlen(pool->slots[i])) & (nslots - 1);
+            while (slots[j]) {
+                j = (j + 1) & (nslots - 1);
+            }
+            slots[j] = pool->slots[i];
+        }
+    }
+    rum_free(pool->slots, pool->nslots * sizeof(char *));
+    pool->slots = slots;
+    pool->nslots = nslots;
+    return 0;
+}
+
+/* copy a string into the pool's block storage */
+static char *
+rum_strpool_store(rum_strpool_t *pool, const char *str, size_t len)
+{
+    struct rum_strpool_block_s *block = pool->blocks;
+    size_t size;
+    char *copy;
+
+    if ((block == NULL) || ((block->size - block->used) < (len + 1))) {
+        size = (len + 1 > RUM_STRPOOL_BLOCKSIZE)? (len + 1) : RUM_STRPOOL_BLOCKSIZE;
+        if ((block = rum_malloc(sizeof(struct rum_strpool_block_s) + size)) == NULL) {
+            rum_set_error("Unable to allocate memory for pooled string");
+            return NULL;
+        }
+        block->size = size;
+        block->used = 0;
+
+        /* an oversized string fills its block, so keep the current block first */
+        if (pool->blocks && (size > RUM_STRPOOL_BLOCKSIZE)) {
+            block->next = pool->blocks->next;
+            pool->blocks->next = block;
+        } else {
+            block->next = pool->blocks;
+            pool->blocks = block;
+        }
+    }
+    copy = block->data + block->used;
+    memcpy(copy, str, len);
+    copy[len] = 0;
+    block->used += len + 1;
+    return copy;
+}
+
+const char *
+rum_strpool_intern_n(rum_strpool_t *pool, const char *str, size_t len)
+{
+    size_t i;
+    const char *pooled;
+
+    rum_set_error(NULL);
+    if ((pool == NULL) || (str == NULL)) {
+        rum_set_error("Programmer error: Unable to intern string in nonexistent pool");
+        return NULL;
+    }
+
+    /* keep the table at most half full */
+    if ((pool->nstrings + 1) * 2 > pool->nslots) {
+        if (rum_strpool_grow(pool) < 0) {
+            return NULL;
+        }
+    }
+
+    /* look for an existing copy */
+    for (i = rum_hash_bytes(RUM_HASH_INIT, str, len) & (pool->nslots - 1); (pooled = pool->slots[i]) != NULL;
+         i = (i + 1) & (pool->nslots - 1)) {
+        if (!strncmp(pooled, str, len) && (pooled[len] == 0)) {
+            return pooled;
+        }
+    }
+
+    /* not found, so add it */
+    if ((pooled = rum_strpool_store(pool, str, len)) == NULL) {
+        return NULL;
+    }
+    pool->slots[i] = pooled;
+    ++(pool->nstrings);
+    return pooled;
+}
+
+const char *
+rum_strpool_intern(rum_strpool_t *pool, const char *str)
+{
+    rum_set_error(NULL);
+    if (str == NULL) {
+        rum_set_error("Programmer error: Unable to intern nonexistent string");
+        return NULL;
+    }
+    return rum_strpool_intern_n(pool, str, strlen(str));
+}
+
+size_t
+rum_strpool_get_count(const rum_strpool_t *pool)
+{
+    rum_set_error(NULL);
+    if (pool == NULL) {
+        rum_set_error("Programmer error: Unable to count nonexistent string pool");
+        return 0;
+    }
+    return pool->nstrings;
+}
@@ -0,0 +1,54 @@
+/*
+    rum_strpool.h
+
+    string interning pool for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_STRPOOL__H
+#define RUM_STRPOOL__H
+
+#include <stddef.h>
+#include <rum_types.h>
+
+/* pool strings will be allocated in blocks of this many bytes (longer strings get their own block) */
+#define RUM_STRPOOL_BLOCKSIZE (4096)
+
+/* a block of storage for pooled strings */
+struct rum_strpool_block_s {
+    struct rum_strpool_block_s *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+/* set of unique strings; each distinct string is stored once, so pooled strings
+ * can be compared by pointer
+ */
+struct rum_strpool_s {
+    /* open-addressed hash table of pooled strings (size is a power of two) */
+    const char **slots;
+    size_t nslots;
+    size_t nstrings;
+
+    /* storage for the strings themselves */
+    struct rum_strpool_block_s *blocks;
+};
+
+/* constructor */
+rum_strpool_t *rum_strpool_new();
+
+/* destructor (frees all pooled strings) */
+void rum_strpool_free(rum_strpool_t *pool);
+
+/* return the pooled copy of a string, adding it to the pool if not already present */
+const char *rum_strpool_intern(rum_strpool_t *pool, const char *str);
+
+/* return the pooled copy of the first len characters of a string (which must not contain a null byte) */
+const char *rum_strpool_intern_n(rum_strpool_t *pool, const char *str, size_t len);
+
+/* return the number of distinct strings in the pool */
+size_t rum_strpool_get_count(const rum_strpool_t *pool);
+
+#endif /* RUM_STRPOOL__H */
@@ -0,0 +1,74 @@
+/*
+    rum_trace.c
+
+    tracing parser state transitions for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <rump.h>
+#include "rum_private.h"
+
+rum_trace_t *
+rum_trace_new()
+{
+    rum_trace_t *trace;
+
+    rum_set_error(NULL);
+    if ((trace = rum_malloc(sizeof(rum_trace_t))) == NULL) {
+        rum_set_error("Unable to allocate memory for trace");
+        return NULL;
+    }
+    rum_trace_clear(trace);
+    return trace;
+}
+
+void
+rum_trace_free(rum_trace_t *trace)
+{
+    rum_set_error(NULL);
+    rum_free(trace, sizeof(rum_trace_t));
+}
+
+void
+rum_trace_clear(rum_trace_t *trace)
+{
+    rum_set_error(NULL);
+    if (trace) {
+        trace->ntransitions = 0;
+        trace->offset = 0;
+    }
+}
+
+void
+rum_trace_record(rum_trace_t *trace, int old_state, int new_state, int depth)
+{
+    struct rum_trace_entry_s *entry = &(trace->entries[trace->ntransitions & (RUM_TRACE_SIZE - 1)]);
+
+    entry->offset = trace->offset;
+    entry->depth = depth;
+    entry->old_state = old_state;
+    entry->new_state = new_state;
+    ++(trace->ntransitions);
+}
+
+void
+rum_trace_dump(const rum_trace_t *trace, FILE *fp)
+{
+    const struct rum_trace_entry_s *entry;
+    unsigned long i;
+
+    rum_set_error(NULL);
+    if (trace == NULL) {
+        return;
+    }
+    i = (trace->ntransitions > RUM_TRACE_SIZE)? (trace->ntransitions - RUM_TRACE_SIZE) : 0;
+    fprintf(fp, "Last %lu of %lu parser state transitions:\n", trace->ntransitions - i, trace->ntransitions);
+    for (; i < trace->ntransitions; ++i) {
+        entry = &(trace->entries[i & (RUM_TRACE_SIZE - 1)]);
+        fprintf(fp, "   offset %lu, depth %u: %s -> %s\n", (unsigned long) entry->offset, entry->depth,
+                rum_state_str(entry->old_state), rum_state_str(entry->new_state));
+    }
+}
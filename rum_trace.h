@@ -0,0 +1,60 @@
+/*
+    rum_trace.h
+
+    declarations for tracing parser state transitions in RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_TRACE__H
+#define RUM_TRACE__H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <rum_types.h>
+
+/*
+ * A trace is a ring buffer of the parser's most recent state transitions, given to a parse
+ * through its options (see rum_parse_options_t). Recording a transition only stores a few
+ * numbers in a fixed-size array, so a trace can be left on for production input and dumped
+ * when a parse fails, showing how the parser got where it did. Without a trace, the parser
+ * only checks for one.
+ */
+
+/* number of transitions kept (a power of 2) */
+#define RUM_TRACE_SIZE (1024)
+
+/* one state transition */
+struct rum_trace_entry_s {
+    size_t offset;              /* offset within the input of the character that caused it */
+    unsigned short depth;       /* depth of the parser state in its stack */
+    unsigned char old_state;    /* rum_state_t values */
+    unsigned char new_state;
+};
+
+struct rum_trace_s {
+    struct rum_trace_entry_s entries[RUM_TRACE_SIZE];
+
+    /* number of transitions recorded (the most recent is at (ntransitions - 1) % RUM_TRACE_SIZE) */
+    unsigned long ntransitions;
+
+    /* offset within the input of the character being parsed, kept up to date by the parser */
+    size_t offset;
+};
+
+/* constructor */
+rum_trace_t *rum_trace_new();
+
+/* destructor */
+void rum_trace_free(rum_trace_t *trace);
+
+/* forget all recorded transitions */
+void rum_trace_clear(rum_trace_t *trace);
+
+/* record a transition at the current offset (normally called by the parser) */
+void rum_trace_record(rum_trace_t *trace, int old_state, int new_state, int depth);
+
+/* print the recorded transitions that are still kept, oldest first */
+void rum_trace_dump(const rum_trace_t *trace, FILE *fp);
+
+#endif /* RUM_TRACE__H */
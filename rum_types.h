@@ -9,11 +9,34 @@
 #ifndef RUM_TYPES__H
 #define RUM_TYPES__H
 
+typedef struct rum_allocator_s rum_allocator_t;
 typedef struct rum_buffer_s rum_buffer_t;
+typedef struct rum_strpool_s rum_strpool_t;
 typedef struct rum_parser_s rum_parser_t;
+typedef struct rum_parse_options_s rum_parse_options_t;
+typedef struct rum_parse_stats_s rum_parse_stats_t;
+typedef struct rum_projection_s rum_projection_t;
 typedef struct rum_attr_s rum_attr_t;
 typedef struct rum_tag_s rum_tag_t;
 typedef struct rum_element_s rum_element_t;
+typedef struct rum_document_s rum_document_t;
+typedef struct rum_element_cache_s rum_element_cache_t;
+typedef struct rum_str_s rum_str_t;
+typedef union rum_binary_u rum_binary_t;
+typedef struct rum_sidecar_s rum_sidecar_t;
+typedef struct rum_sidecar_range_s rum_sidecar_range_t;
+typedef struct rum_query_s rum_query_t;
+typedef struct rum_index_s rum_index_t;
+typedef struct rum_diff_s rum_diff_t;
+typedef struct rum_stream_s rum_stream_t;
+typedef struct rum_trace_s rum_trace_t;
+typedef struct rum_parse_cache_s rum_parse_cache_t;
+typedef struct rum_session_s rum_session_t;
+typedef struct rum_walk_s rum_walk_t;
+typedef struct rum_walk_task_s rum_walk_task_t;
+typedef struct rum_utf8_decoder_s rum_utf8_decoder_t;
 typedef void (*rum_tag_display_method_t)(const rum_element_t *element);
+typedef void (*rum_diff_callback_t)(const rum_diff_t *diff, void *data);
+typedef int (*rum_complete_callback_t)(rum_element_t *element, void *data);
 
 #endif /* RUM_TYPES__H */
@@ -0,0 +1,121 @@
+/*
+    rum_utf8.c
+
+    UTF-8 decoding functions for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <rump.h>
+#include "rum_private.h"
+
+int
+rum_utf8_decode(rum_utf8_decoder_t *decoder, int byte)
+{
+    rum_set_error(NULL);
+
+    /* a lead byte gives the length of the sequence (0xC0, 0xC1 and 0xF5 and up can only be
+     * overlong or too large)
+     */
+    if (decoder->need == 0) {
+        if (byte < 0x80) {
+            return byte;
+        } else if ((byte >= 0xC2) && (byte <= 0xDF)) {
+            decoder->code_point = byte & 0x1F;
+            decoder->need = 1;
+            decoder->min = 0x80;
+        } else if ((byte >= 0xE0) && (byte <= 0xEF)) {
+            decoder->code_point = byte & 0x0F;
+            decoder->need = 2;
+            decoder->min = 0x800;
+        } else if ((byte >= 0xF0) && (byte <= 0xF4)) {
+            decoder->code_point = byte & 0x07;
+            decoder->need = 3;
+            decoder->min = 0x10000;
+        } else {
+            rum_set_error("Invalid UTF-8 in input");
+            return RUM_UTF8_INVALID;
+        }
+        return RUM_UTF8_INCOMPLETE;
+    }
+
+    if ((byte & 0xC0) != 0x80) {
+        decoder->need = 0;
+        rum_set_error("Invalid UTF-8 in input");
+        return RUM_UTF8_INVALID;
+    }
+    decoder->code_point = (decoder->code_point << 6) | (byte & 0x3F);
+    if (--(decoder->need)) {
+        return RUM_UTF8_INCOMPLETE;
+    }
+    if ((decoder->code_point < decoder->min) || (decoder->code_point > 0x10FFFF)
+        || ((decoder->code_point >= 0xD800) && (decoder->code_point <= 0xDFFF))) {
+        rum_set_error("Invalid UTF-8 in input");
+        return RUM_UTF8_INVALID;
+    }
+    return decoder->code_point;
+}
+
+int
+rum_utf8_encode(int c, char *out)
+{
+    rum_set_error(NULL);
+    if (c < 0x80) {
+        out[0] = c;
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = 0xC0 | (c >> 6);
+        out[1] = 0x80 | (c & 0x3F);
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = 0xE0 | (c >> 12);
+        out[1] = 0x80 | ((c >> 6) & 0x3F);
+        out[2] = 0x80 | (c & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (c >> 18);
+    out[1] = 0x80 | ((c >> 12) & 0x3F);
+    out[2] = 0x80 | ((c >> 6) & 0x3F);
+    out[3] = 0x80 | (c & 0x3F);
+    return 4;
+}
+
+size_t
+rum_utf8_ascii_span(const char *data, size_t size)
+{
+    size_t i = 0;
+    uint64_t word;
+#ifdef __SSE2__
+    int mask;
+#endif
+
+    rum_set_error(NULL);
+
+#ifdef __SSE2__
+    /* the top bits of 16 bytes at once */
+    for (; i + 16 <= size; i += 16) {
+        if ((mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (data + i)))) != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; i + sizeof(word) <= size; i += sizeof(word)) {
+        memcpy(&word, data + i, sizeof(word));
+        if (word & 0x8080808080808080ULL) {
+            break;
+        }
+    }
+    while ((i < size) && !(data[i] & 0x80)) {
+        ++i;
+    }
+    return i;
+}
@@ -0,0 +1,51 @@
+/*
+    rum_utf8.h
+
+    declarations for UTF-8 decoding in RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_UTF8__H
+#define RUM_UTF8__H
+
+#include <stddef.h>
+#include <rum_types.h>
+
+/*
+ * Input is UTF-8. The parser sees whole code points, so the Unicode ranges of the XML character
+ * classes (see rum_parser.h) apply, while the input buffer, and so every offset and span, is in
+ * bytes. Input is decoded a byte at a time (it may arrive in pieces that split a character), and
+ * is rejected if it is not well-formed: overlong forms, surrogates, code points beyond 0x10FFFF,
+ * and stray or missing continuation bytes are all errors.
+ *
+ * Most markup is ASCII, which needs no decoding at all, so a block of input can be checked for
+ * non-ASCII bytes many at a time first (see rum_utf8_ascii_span()).
+ */
+
+/* what rum_utf8_decode() returns when a byte does not complete a character */
+#define RUM_UTF8_INCOMPLETE (-1)
+#define RUM_UTF8_INVALID    (-2)
+
+/* number of bytes UTF-8 takes to encode the code point c */
+#define RUM_UTF8_LENGTH(c) (((c) < 0x80)? 1 : ((c) < 0x800)? 2 : ((c) < 0x10000)? 3 : 4)
+
+/* state of a character being decoded (all zero between characters) */
+struct rum_utf8_decoder_s {
+    int code_point;     /* bits decoded so far */
+    int need;           /* continuation bytes still to come */
+    int min;            /* smallest code point the sequence may encode (anything less is overlong) */
+};
+
+/* decode a byte of input, returning the code point it completes, RUM_UTF8_INCOMPLETE if the
+ * character needs more bytes, or RUM_UTF8_INVALID (with an error set) if the input is not UTF-8
+ */
+int rum_utf8_decode(rum_utf8_decoder_t *decoder, int byte);
+
+/* encode a code point as UTF-8 in out (which has room for 4 bytes), returning its length */
+int rum_utf8_encode(int c, char *out);
+
+/* return the number of ASCII bytes at the start of data (checking many bytes at a time) */
+size_t rum_utf8_ascii_span(const char *data, size_t size);
+
+#endif /* RUM_UTF8__H */
@@ -0,0 +1,292 @@
+/*
+    rum_walk.c
+
+    parallel document traversal functions for RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <rump.h>
+#include "rum_private.h"
+
+/* a worker's range of tasks: it takes them from next, and thieves take them from end */
+struct walk_worker_s {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+
+    int id;
+    pthread_t thread;
+    int started;
+    struct walk_state_s *state;
+};
+
+/* everything the workers share */
+struct walk_state_s {
+    const rum_walk_t *walk;
+    rum_walk_task_t *tasks;
+    struct walk_worker_s *workers;
+    int nworkers;
+
+    /* set (atomically) when a visit callback asks to stop */
+    int stopped;
+};
+
+/* list of tasks being built */
+struct task_list_s {
+    rum_walk_task_t *tasks;
+    size_t ntasks;
+    size_t capacity;
+};
+
+static int
+add_task(struct task_list_s *list, const rum_element_t *element, size_t nsubtrees)
+{
+    rum_walk_task_t *tasks;
+    size_t capacity;
+
+    if (list->ntasks == list->capacity) {
+        capacity = list->capacity? (2 * list->capacity) : RUM_WALK_TASKS_PER_WORKER;
+        if ((tasks = rum_realloc(list->tasks, list->capacity * sizeof(rum_walk_task_t),
+                                 capacity * sizeof(rum_walk_task_t))) == NULL) {
+            return -1;
+        }
+        list->tasks = tasks;
+        list->capacity = capacity;
+    }
+    memset(&(list->tasks[list->ntasks]), 0, sizeof(rum_walk_task_t));
+    list->tasks[list->ntasks].element = element;
+    list->tasks[list->ntasks].nsubtrees = nsubtrees;
+    list->tasks[list->ntasks].worker = -1;
+    ++(list->ntasks);
+    return 0;
+}
+
+/* add a run of sibling subtrees as two tasks, each with half of the run */
+static int
+add_halves(struct task_list_s *list, const rum_element_t *first, size_t nsubtrees)
+{
+    const rum_element_t *middle = first;
+    size_t i;
+
+    for (i = 0; i < nsubtrees / 2; ++i) {
+        middle = middle->next_sibling;
+    }
+    if (i && (add_task(list, first, i) < 0)) {
+        return -1;
+    }
+    return add_task(list, middle, nsubtrees - i);
+}
+
+/* split one task into smaller ones, in order, adding them to a list (or the task itself, if it
+ * cannot be split); return 1 if it was split, 0 if not, or -1 on error
+ */
+static int
+split_task(struct task_list_s *list, const rum_walk_task_t *task)
+{
+    const rum_element_t *child;
+    size_t nchildren = 0;
+
+    /* a run of several subtrees is split in half */
+    if (task->nsubtrees > 1) {
+        return (add_halves(list, task->element, task->nsubtrees) < 0)? -1 : 1;
+    }
+
+    /* a single subtree is split into its root, then its children (in halves) */
+    if ((task->nsubtrees == 1) && task->element->first_child) {
+        for (child = task->element->first_child; child; child = child->next_sibling) {
+            ++nchildren;
+        }
+        if ((add_task(list, task->element, 0) < 0) || (add_halves(list, task->element->first_child, nchildren) < 0)) {
+            return -1;
+        }
+        return 1;
+    }
+
+    return (add_task(list, task->element, task->nsubtrees) < 0)? -1 : 0;
+}
+
+/* split a document into at least ntasks tasks (if it has that many elements), in document order,
+ * storing them in list; return 0 on success or -1 on error
+ */
+static int
+make_tasks(const rum_element_t *root, size_t ntasks, struct task_list_s *list)
+{
+    struct task_list_s next;
+    size_t i;
+    int split = 1, rc = 0;
+
+    memset(list, 0, sizeof(struct task_list_s));
+    if (add_task(list, root, 1) < 0) {
+        return -1;
+    }
+
+    /* each pass splits every task that can be split, roughly doubling the number of tasks */
+    while (split && (list->ntasks < ntasks)) {
+        memset(&next, 0, sizeof(next));
+        for (i = 0, split = 0; (i < list->ntasks) && ((rc = split_task(&next, &(list->tasks[i]))) >= 0); ++i) {
+            split |= rc;
+        }
+        rum_free(list->tasks, list->capacity * sizeof(rum_walk_task_t));
+        *list = next;
+        if (rc < 0) {
+            rum_free(list->tasks, list->capacity * sizeof(rum_walk_task_t));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* visit the elements of one task in document order, returning 0 or -1 if the callback stopped */
+static int
+run_task(const rum_walk_t *walk, rum_walk_task_t *task)
+{
+    const rum_element_t *subtree = task->element, *element;
+    size_t i;
+
+    if (task->nsubtrees == 0) {
+        return walk->visit(subtree, task, walk->data);
+    }
+    for (i = 0; i < task->nsubtrees; ++i, subtree = subtree->next_sibling) {
+        element = subtree;
+        for (;;) {
+            if (walk->visit(element, task, walk->data) < 0) {
+                return -1;
+            }
+            if (element->first_child) {
+                element = element->first_child;
+                continue;
+            }
+            while ((element != subtree) && (element->next_sibling == NULL)) {
+                element = element->parent;
+            }
+            if (element == subtree) {
+                break;
+            }
+            element = element->next_sibling;
+        }
+    }
+    return 0;
+}
+
+/* take the next task of a worker's own range, or steal the last of another's; return its index,
+ * or -1 if none is left
+ */
+static long
+take_task(struct walk_worker_s *worker)
+{
+    struct walk_state_s *state = worker->state;
+    struct walk_worker_s *victim;
+    long task = -1;
+    int i;
+
+    for (i = 0; (i < state->nworkers) && (task < 0); ++i) {
+        victim = &(state->workers[(worker->id + i) % state->nworkers]);
+        pthread_mutex_lock(&(victim->lock));
+        if (victim->next < victim->end) {
+            task = (victim == worker)? (long) (victim->next)++ : (long) --(victim->end);
+        }
+        pthread_mutex_unlock(&(victim->lock));
+    }
+    return task;
+}
+
+/* run tasks until there are none left, or a visit callback stops the walk */
+static void *
+run_worker(void *data)
+{
+    struct walk_worker_s *worker = data;
+    struct walk_state_s *state = worker->state;
+    rum_walk_task_t *task;
+    long i;
+
+    while (!__atomic_load_n(&(state->stopped), __ATOMIC_RELAXED) && ((i = take_task(worker)) >= 0)) {
+        task = &(state->tasks[i]);
+        task->worker = worker->id;
+        if (run_task(state->walk, task) < 0) {
+            __atomic_store_n(&(state->stopped), 1, __ATOMIC_RELAXED);
+        } else {
+            task->complete = 1;
+        }
+    }
+    return NULL;
+}
+
+int
+rum_document_parallel_walk(const rum_document_t *document, const rum_walk_t *walk)
+{
+    struct walk_state_s state;
+    struct walk_worker_s *workers;
+    struct task_list_s list;
+    rum_walk_task_t *tasks;
+    size_t ntasks, i;
+    int nworkers, w, rc = 0;
+
+    rum_set_error(NULL);
+    if ((document == NULL) || (document->root == NULL) || (walk == NULL) || (walk->visit == NULL)) {
+        rum_set_error("Programmer error: Unable to walk nonexistent document");
+        return -1;
+    }
+    if ((nworkers = walk->nworkers) <= 0) {
+        nworkers = (sysconf(_SC_NPROCESSORS_ONLN) > 0)? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    }
+    if (make_tasks(document->root, nworkers * RUM_WALK_TASKS_PER_WORKER, &list) < 0) {
+        rum_set_error("Unable to allocate memory for walk");
+        return -1;
+    }
+    if ((workers = rum_malloc(nworkers * sizeof(struct walk_worker_s))) == NULL) {
+        rum_free(list.tasks, list.capacity * sizeof(rum_walk_task_t));
+        rum_set_error("Unable to allocate memory for walk");
+        return -1;
+    }
+    tasks = list.tasks;
+    ntasks = list.ntasks;
+
+    /* give each worker a contiguous range of tasks, so that neighboring subtrees stay together */
+    memset(&state, 0, sizeof(state));
+    state.walk = walk;
+    state.tasks = tasks;
+    state.workers = workers;
+    state.nworkers = nworkers;
+    for (w = 0; w < nworkers; ++w) {
+        pthread_mutex_init(&(workers[w].lock), NULL);
+        workers[w].next = ntasks * w / nworkers;
+        workers[w].end = ntasks * (w + 1) / nworkers;
+        workers[w].id = w;
+        workers[w].started = 0;
+        workers[w].state = &state;
+    }
+
+    /* the calling thread is worker 0; tasks of any worker that cannot be started get stolen */
+    for (w = 1; w < nworkers; ++w) {
+        workers[w].started = (pthread_create(&(workers[w].thread), NULL, run_worker, &(workers[w])) == 0);
+    }
+    run_worker(&(workers[0]));
+    for (w = 1; w < nworkers; ++w) {
+        if (workers[w].started) {
+            pthread_join(workers[w].thread, NULL);
+        }
+    }
+    for (w = 0; w < nworkers; ++w) {
+        pthread_mutex_destroy(&(workers[w].lock));
+    }
+
+    /* merge the results in document order */
+    for (i = 0; i < ntasks; ++i) {
+        if (walk->merge && (walk->merge(&(tasks[i]), walk->data) < 0)) {
+            rc = -1;
+        }
+    }
+    rum_free(list.tasks, list.capacity * sizeof(rum_walk_task_t));
+    rum_free(workers, nworkers * sizeof(struct walk_worker_s));
+    rum_set_error(NULL);
+    if (state.stopped || rc) {
+        rum_set_error("Walk was stopped by a callback");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+    rum_walk.h
+
+    declarations for parallel traversal of documents in RuM parser library
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef RUM_WALK__H
+#define RUM_WALK__H
+
+#include <stddef.h>
+#include <rum_types.h>
+
+/*
+ * A parallel walk visits every element of a document, in several threads at once. The tree is
+ * split into tasks, each either a single element (without its children) or a run of consecutive
+ * sibling subtrees, such that visiting the tasks in order visits the elements in document order.
+ * Large subtrees are split top-down until there are several tasks per worker, so the tasks can be
+ * balanced even when the tree is lopsided.
+ *
+ * Each worker thread owns a range of the tasks, taking them from the front; a worker that runs
+ * out steals tasks from the back of another's range. Within a task, elements are visited in
+ * document order by one worker, whose number identifies any per-worker context the caller keeps
+ * (such as partial sums), and the visit callback can leave a result with the task (such as output
+ * rendered to a buffer). Once every task is done, the merge callback is called for each task in
+ * document order, in the calling thread, so results can be reassembled exactly as a sequential
+ * walk would have produced them.
+ *
+ * Callbacks must not change the document, since other workers may be reading any part of it.
+ * Calls that only cache what they compute in it (rum_element_get_hash() and rum_document_index())
+ * are safe, because they publish their results atomically.
+ */
+
+/* the most tasks made for each worker */
+#define RUM_WALK_TASKS_PER_WORKER (16)
+
+/* a part of the document visited by one worker */
+struct rum_walk_task_s {
+    /* the task's element, or the first of its run of sibling subtrees */
+    const rum_element_t *element;
+
+    /* the number of sibling subtrees in the run, or 0 for just the element itself */
+    size_t nsubtrees;
+
+    /* the worker that ran the task (from 0 to the number of workers less one), or -1 if it never ran */
+    int worker;
+
+    /* whether every element of the task was visited (boolean) */
+    int complete;
+
+    /* anything the visit callback leaves for the merge callback */
+    void *result;
+};
+
+struct rum_walk_s {
+    /* number of worker threads, including the calling thread (0 for one per processor) */
+    int nworkers;
+
+    /* called for each element of each task, in document order within the task; returns 0 to go on,
+     * or -1 to stop the walk (which then returns -1)
+     */
+    int (*visit)(const rum_element_t *element, rum_walk_task_t *task, void *data);
+
+    /* if not NULL, called once the workers are done for every task, in document order, whether or
+     * not it ran (so results can be freed); returns 0, or -1 if the walk should return -1
+     */
+    int (*merge)(rum_walk_task_t *task, void *data);
+
+    /* passed unchanged to the callbacks */
+    void *data;
+};
+
+/* visit every element of a document in parallel, returning 0 on success or -1 on error */
+int rum_document_parallel_walk(const rum_document_t *document, const rum_walk_t *walk);
+
+#endif /* RUM_WALK__H */
@@ -0,0 +1,558 @@
+/*
+    rumbench.c
+
+    benchmark for the RuM parser library: generates large documents of various shapes,
+    and measures parsing and display of them
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <rump.h>
+#include "cabinet.h"
+
+#define DEFAULT_SIZE (8)    /* MB of generated document */
+#define DEFAULT_RUNS (3)    /* the best time of this many runs is reported */
+
+#define DEEP_LEVELS (64)    /* tags nested below the root in the deep language */
+#define ROW_ATTRS   (16)    /* attributes of a row in the attribute-heavy language */
+#define WIDE_ITEMS  (2000)  /* items on each shelf of the wide shape */
+
+/*
+ * document generator
+ *
+ * Output depends only on the shape and size, so a given document is the same on every machine
+ * and from one release to the next.
+ */
+
+/* bytes written so far */
+static size_t written;
+
+/* state of a 32-bit xorshift generator, which gives the same sequence everywhere */
+static uint32_t random_state = 2463534242U;
+
+/* return a pseudo-random number from 0 to n - 1 */
+static unsigned long
+random_below(unsigned long n)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state % n;
+}
+
+/* return a pseudo-random entry of a list */
+#define RANDOM_PICK(list) ((list)[random_below(sizeof(list) / sizeof((list)[0]))])
+
+static void
+emit(const char *format, ...)
+{
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    if ((len = vprintf(format, args)) > 0) {
+        written += len;
+    }
+    va_end(args);
+}
+
+static const char *makers[] = {
+    "Wild Turkey", "J&amp;B", "Frey Vineyards Organic", "Glenfiddich", "Laphroaig", "Lagavulin",
+    "Maker's Mark", "Bulleit", "Talisker", "Ridge", "Bonny Doon", "Jameson"
+};
+static const char *bottle_types[] = {
+    "Kentucky bourbon", "Scotch whisky", "merlot", "rye", "Irish whiskey", "zinfandel", "port"
+};
+static const char *glass_types[] = { "tumbler", "snifter", "martini glass", "flute", "highball" };
+static const char *words[] = {
+    "oak", "smoke", "peat", "vanilla", "caramel", "cherry", "leather", "honey", "spice", "citrus",
+    "finish", "nose", "palate", "long", "dry", "sweet", "bright", "round", "notes", "of"
+};
+static const char *entities[] = { "&amp;", "&lt;", "&gt;", "&quot;", "&apos;" };
+
+/* a run of n random words, optionally sprinkled with entity references */
+static void
+emit_words(int n, int with_entities)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+        emit("%s%s", (i? " " : ""), RANDOM_PICK(words));
+        if (with_entities) {
+            emit(" %s%s", RANDOM_PICK(entities), RANDOM_PICK(entities));
+        }
+    }
+}
+
+static void
+emit_comment(int nwords)
+{
+    emit("<!-- ");
+    emit_words(nwords, 0);
+    emit(" -->");
+}
+
+/* one bottle or glass, in the shape's style */
+static void
+emit_item(const char *shape)
+{
+    int content = !strcmp(shape, "content"), with_entities = !strcmp(shape, "entities");
+    int comments = !strcmp(shape, "comments");
+
+    if (comments) {
+        emit("      ");
+        emit_comment(1 + random_below(12));
+        emit("\n");
+    }
+    if (random_below(10) < 6) {
+        emit("      <bottle type=\"%s%s\"", RANDOM_PICK(bottle_types), (with_entities? " &amp; co" : ""));
+        if (random_below(3) == 0) {
+            emit(" aged=\"%lu\"", 3 + random_below(30));
+        }
+        if (random_below(3) == 0) {
+            emit(" vintage=\"%lu\"", 1950 + random_below(70));
+        }
+        emit(">%s", RANDOM_PICK(makers));
+        if (content || with_entities) {
+            emit(": ");
+            emit_words(content? 20 + random_below(300) : 5 + random_below(20), with_entities);
+        }
+        if (comments) {
+            emit_comment(1 + random_below(6));
+        }
+        emit("</bottle>\n");
+    } else if (random_below(4) == 0) {
+        emit("      <glass/>\n");
+    } else {
+        emit("      <glass type='%s' />\n", RANDOM_PICK(glass_types));
+    }
+}
+
+/* the sample language: shelves of bottles and glasses, varied to stress one thing or another */
+static void
+generate_cabinet(const char *shape, size_t size)
+{
+    unsigned long shelf, nitems, i;
+    int wide = !strcmp(shape, "wide");
+
+    emit("<?xml version=\"1.0\"?>\n<cabinet>\n");
+    for (shelf = 0; written < size; ++shelf) {
+        emit("   <shelf id=\"shelf%lu\">\n", shelf);
+        nitems = wide? WIDE_ITEMS : random_below(13);
+        for (i = 0; (i < nitems) && (written < size); ++i) {
+            emit_item(shape);
+        }
+        emit("   </shelf>\n");
+    }
+    emit("</cabinet>\n");
+}
+
+/* deeply nested elements, each chain going down most of the way to the deepest level */
+static void
+generate_deep(const char *shape, size_t size)
+{
+    int depth, level;
+
+    emit("<deep>\n");
+    while (written < size) {
+        depth = DEEP_LEVELS / 2 + random_below(DEEP_LEVELS / 2 + 1);
+        for (level = 1; level <= depth; ++level) {
+            emit("<level%d>", level);
+        }
+        emit_words(1 + random_below(4), 0);
+        for (level = depth; level >= 1; --level) {
+            emit("</level%d>", level);
+        }
+        emit("\n");
+    }
+    emit("</deep>\n");
+}
+
+/* rows of many attributes each */
+static void
+generate_attrs(const char *shape, size_t size)
+{
+    int i;
+
+    emit("<table>\n");
+    while (written < size) {
+        emit("   <row");
+        for (i = 1; i <= ROW_ATTRS; ++i) {
+            if (random_below(2)) {
+                emit(" c%d=\"%s\"", i, RANDOM_PICK(words));
+            } else {
+                emit(" c%d='%lu'", i, random_below(100000));
+            }
+        }
+        emit("/>\n");
+    }
+    emit("</table>\n");
+}
+
+/*
+ * languages for the stress shapes that the sample language can't express
+ */
+
+/* tag and attribute names must outlive the language */
+static char level_names[DEEP_LEVELS][16];
+static char attr_names[ROW_ATTRS][8];
+
+/* display any element as its name, attribute values and content */
+static void
+display_generic(const rum_element_t *element)
+{
+    const char *value, *content = rum_element_get_content(element);
+    int i;
+
+    printf("%s", rum_element_get_name(element));
+    for (i = 0; i < element->tag->nattrs; ++i) {
+        if ((value = rum_element_get_value_by_handle(element, i)) != NULL) {
+            printf(" %s", value);
+        }
+    }
+    printf(": %s\n", (content? content : ""));
+}
+
+static rum_tag_t *
+define_deep()
+{
+    rum_tag_t *root, *tag;
+    int level;
+
+    if ((root = tag = rum_tag_new(NULL, "deep", 0, 0, NULL, &display_generic)) == NULL) {
+        return NULL;
+    }
+    for (level = 1; level <= DEEP_LEVELS; ++level) {
+        snprintf(level_names[level - 1], sizeof(level_names[0]), "level%d", level);
+        if ((tag = rum_tag_new(tag, level_names[level - 1], 0, 0, NULL, &display_generic)) == NULL) {
+            return NULL;
+        }
+    }
+    return root;
+}
+
+static rum_tag_t *
+define_attrs()
+{
+    rum_tag_t *table;
+    rum_attr_t attrs[ROW_ATTRS];
+    int i;
+
+    memset(attrs, 0, sizeof(attrs));
+    for (i = 0; i < ROW_ATTRS; ++i) {
+        snprintf(attr_names[i], sizeof(attr_names[0]), "c%d", i + 1);
+        attrs[i].name = attr_names[i];
+    }
+    if (((table = rum_tag_new(NULL, "table", 0, 0, NULL, &display_generic)) == NULL)
+        || (rum_tag_new(table, "row", 1, ROW_ATTRS, attrs, &display_generic) == NULL)) {
+        return NULL;
+    }
+    return table;
+}
+
+/* the shapes of document that can be generated and measured */
+struct shape_s {
+    const char *name;
+    void (*generate)(const char *shape, size_t size);
+    rum_tag_t *(*define)();
+};
+
+static struct shape_s shapes[] = {
+    { "cabinet",  generate_cabinet, define_language },  /* a mix like the samples */
+    { "deep",     generate_deep,    define_deep },      /* deeply nested elements */
+    { "wide",     generate_cabinet, define_language },  /* thousands of siblings per parent */
+    { "attrs",    generate_attrs,   define_attrs },     /* many attributes per element */
+    { "content",  generate_cabinet, define_language },  /* long content */
+    { "entities", generate_cabinet, define_language },  /* content dense with entity references */
+    { "comments", generate_cabinet, define_language },  /* many comments between and within elements */
+    { NULL, NULL, NULL }
+};
+
+static const struct shape_s *
+find_shape(const char *name)
+{
+    const struct shape_s *shape;
+
+    for (shape = shapes; shape->name; ++shape) {
+        if (!strcmp(shape->name, name)) {
+            return shape;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * measurement
+ */
+
+/* allocations made by the library, counted by a custom allocator */
+struct alloc_counts_s {
+    unsigned long allocs, reallocs, frees;
+    size_t bytes, peak_bytes;
+};
+
+static void *
+count_alloc(void *ctx, size_t size)
+{
+    struct alloc_counts_s *counts = ctx;
+
+    ++(counts->allocs);
+    if ((counts->bytes += size) > counts->peak_bytes) {
+        counts->peak_bytes = counts->bytes;
+    }
+    return malloc(size);
+}
+
+static void *
+count_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+    struct alloc_counts_s *counts = ctx;
+
+    ++(counts->reallocs);
+    if ((counts->bytes += new_size - old_size) > counts->peak_bytes) {
+        counts->peak_bytes = counts->bytes;
+    }
+    return realloc(ptr, new_size);
+}
+
+static void
+count_free(void *ctx, void *ptr, size_t size)
+{
+    struct alloc_counts_s *counts = ctx;
+
+    if (ptr) {
+        ++(counts->frees);
+        counts->bytes -= size;
+    }
+    free(ptr);
+}
+
+static double
+now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long
+count_elements(const rum_element_t *element)
+{
+    const rum_element_t *child;
+    unsigned long n = 1;
+
+    for (child = rum_element_get_first_child(element); child; child = rum_element_get_next_sibling(child)) {
+        n += count_elements(child);
+    }
+    return n;
+}
+
+/* parse a file, storing the time taken */
+static rum_element_t *
+timed_parse(const char *path, const rum_tag_t *language, double *seconds)
+{
+    rum_element_t *document;
+    FILE *fp;
+    double start;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        return NULL;
+    }
+    start = now();
+    document = rum_parse_file(fp, language, 0);
+    *seconds = now() - start;
+    fclose(fp);
+    return document;
+}
+
+/* display a document with standard output discarded, returning the time taken (or -1 on error) */
+static double
+timed_display(const rum_element_t *document)
+{
+    int saved, devnull;
+    double start, seconds;
+
+    fflush(stdout);
+    if (((devnull = open("/dev/null", O_WRONLY)) < 0) || ((saved = dup(STDOUT_FILENO)) < 0)) {
+        return -1;
+    }
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+    start = now();
+    rum_element_display(document);
+    fflush(stdout);
+    seconds = now() - start;
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return seconds;
+}
+
+static void
+print_rates(const char *name, double seconds, off_t bytes, unsigned long elements)
+{
+    printf("    \"%s\": { \"seconds\": %.6f, \"mb_per_s\": %.2f, \"elements_per_s\": %.0f",
+           name, seconds, bytes / 1e6 / seconds, elements / seconds);
+}
+
+/* measure one shape's document, printing the results as a JSON object */
+static int
+measure(const struct shape_s *shape, const char *path, int runs)
+{
+    rum_tag_t *language;
+    rum_element_t *document;
+    struct alloc_counts_s counts, first_counts;
+    rum_allocator_t allocator = { count_alloc, count_realloc, count_free, &counts };
+    struct stat st;
+    struct rusage usage;
+    unsigned long elements = 0;
+    double seconds, parse_seconds = 0, display_seconds = 0;
+    int run;
+
+    printf("  { \"shape\": \"%s\", \"file\": \"%s\"", shape->name, path);
+    if (stat(path, &st) < 0) {
+        printf(", \"error\": \"Could not open file\" }");
+        return 1;
+    }
+    if ((language = shape->define()) == NULL) {
+        printf(", \"error\": \"%s\" }", rum_last_error());
+        return 1;
+    }
+
+    /* the language is defined first, so only the parse itself is counted */
+    memset(&first_counts, 0, sizeof(first_counts));
+    rum_set_allocator(&allocator);
+    for (run = 0; run < runs; ++run) {
+        memset(&counts, 0, sizeof(counts));
+        if ((document = timed_parse(path, language, &seconds)) == NULL) {
+            rum_set_allocator(NULL);
+            printf(", \"error\": \"%s\" }", (rum_last_error()? rum_last_error() : "Could not open file"));
+            return 1;
+        }
+        if ((run == 0) || (seconds < parse_seconds)) {
+            parse_seconds = seconds;
+        }
+        if (run == 0) {
+            first_counts = counts;
+            elements = count_elements(document);
+        }
+        if (((seconds = timed_display(document)) >= 0) && ((run == 0) || (seconds < display_seconds))) {
+            display_seconds = seconds;
+        }
+        rum_element_free(document);
+    }
+    rum_set_allocator(NULL);
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf(",\n    \"bytes\": %lld, \"elements\": %lu, \"runs\": %d,\n", (long long) st.st_size, elements, runs);
+    print_rates("parse", parse_seconds, st.st_size, elements);
+    printf(",\n      \"allocs\": %lu, \"reallocs\": %lu, \"frees\": %lu, \"peak_heap_bytes\": %lu },\n",
+           first_counts.allocs, first_counts.reallocs, first_counts.frees, (unsigned long) first_counts.peak_bytes);
+    print_rates("display", display_seconds, st.st_size, elements);
+    printf(" },\n    \"peak_rss_kb\": %ld }", usage.ru_maxrss);
+    return 0;
+}
+
+static void
+usage(const char *cmd)
+{
+    const struct shape_s *shape;
+
+    fprintf(stderr, "Usage: %s --generate=<shape> [--size=<MB>]\n", cmd);
+    fprintf(stderr, "       %s [--runs=<n>] <shape>=<file> ...\n", cmd);
+    fprintf(stderr, "Shapes:");
+    for (shape = shapes; shape->name; ++shape) {
+        fprintf(stderr, " %s", shape->name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    const struct shape_s *shape;
+    char *generate = NULL, *equals;
+    long size = DEFAULT_SIZE;
+    int opt, i, runs = DEFAULT_RUNS, status, rc = 0;
+    pid_t pid;
+    struct option options[] = {
+        { "generate", required_argument, NULL, 'g' },
+        { "size",     required_argument, NULL, 's' },
+        { "runs",     required_argument, NULL, 'r' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+            case 'g':
+                generate = optarg;
+                break;
+            case 's':
+                size = atol(optarg);
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if ((size <= 0) || (runs <= 0) || (generate && (optind != argc)) || (!generate && (optind == argc))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* write a document of the given shape to standard output */
+    if (generate) {
+        if ((shape = find_shape(generate)) == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+        shape->generate(shape->name, (size_t) size * 1000000);
+        return 0;
+    }
+
+    /* measure each document in a process of its own, so each gets its own peak RSS */
+    printf("{ \"benchmark\": \"rum_parse_file\", \"results\": [\n");
+    for (i = optind; i < argc; ++i) {
+        if ((equals = strchr(argv[i], '=')) == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+        *equals = 0;
+        if ((shape = find_shape(argv[i])) == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (i > optind) {
+            printf(",\n");
+        }
+        fflush(stdout);
+        if ((pid = fork()) == 0) {
+            status = measure(shape, equals + 1, runs);
+            fflush(stdout);
+            _exit(status);
+        }
+        if (pid < 0) {
+            printf("  { \"shape\": \"%s\", \"file\": \"%s\", \"error\": \"Could not fork\" }", shape->name, equals + 1);
+        }
+        if ((pid < 0) || (waitpid(pid, &status, 0) < 0) || !WIFEXITED(status) || WEXITSTATUS(status)) {
+            rc = 1;
+        }
+    }
+    printf("\n] }\n");
+    return rc;
+}
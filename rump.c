@@ -9,13 +9,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <sys/stat.h>
 #include <rump.h>
 #include "rum_private.h"
 
-/* error handling for the library consists of a global error message;
+/* with an element-complete callback, finished input is dropped from the buffer once it grows this large */
+#define COMPLETE_COMPACT_SIZE (64 * CHUNKSIZE)
+
+/* input is read this many bytes at a time, so it can be checked for non-ASCII bytes a block at a time */
+#define READ_BLOCK_SIZE (4096)
+
+/* error handling for the library consists of an error message per thread (so that threads
+ * sharing a language or handing documents to each other do not clobber each other's errors);
  * all library functions must set this to NULL on success, and error message otherwise
  */
-static char *rum_errmsg;
+static __thread char *rum_errmsg;
 
 char *
 rum_last_error()
@@ -29,6 +38,120 @@ rum_set_error(char *errmsg)
     rum_errmsg = errmsg;
 }
 
+/* the default allocator uses the standard library */
+static void *
+rum_default_alloc(void *ctx, size_t size)
+{
+    return malloc(size);
+}
+
+static void *
+rum_default_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+    return realloc(ptr, new_size);
+}
+
+static void
+rum_default_free(void *ctx, void *ptr, size_t size)
+{
+    free(ptr);
+}
+
+/* all library allocations go through this allocator */
+static rum_allocator_t rum_allocator = { rum_default_alloc, rum_default_realloc, rum_default_free, NULL };
+
+void
+rum_set_allocator(const rum_allocator_t *allocator)
+{
+    rum_set_error(NULL);
+    if (allocator == NULL) {
+        rum_allocator.alloc = rum_default_alloc;
+        rum_allocator.realloc = rum_default_realloc;
+        rum_allocator.free = rum_default_free;
+        rum_allocator.ctx = NULL;
+    } else if ((allocator->alloc == NULL) || (allocator->realloc == NULL) || (allocator->free == NULL)) {
+        rum_set_error("Programmer error: Allocator must define all functions");
+    } else {
+        rum_allocator = *allocator;
+    }
+}
+
+const rum_allocator_t *
+rum_get_allocator()
+{
+    rum_set_error(NULL);
+    return &rum_allocator;
+}
+
+/* running totals of the library's allocations, for parse statistics: bytes ever allocated,
+ * bytes currently allocated, and the most allocated at once since the peak was last reset
+ *
+ * like the error message, these are kept per thread, so they count what the calling thread
+ * allocated and freed (memory freed by another thread is not subtracted)
+ */
+static __thread size_t rum_bytes_allocated, rum_bytes_in_use, rum_bytes_peak;
+
+static void
+count_allocation(size_t old_size, size_t new_size)
+{
+    if (new_size > old_size) {
+        rum_bytes_allocated += new_size - old_size;
+    }
+    rum_bytes_in_use += new_size - old_size;
+    if (rum_bytes_in_use > rum_bytes_peak) {
+        rum_bytes_peak = rum_bytes_in_use;
+    }
+}
+
+size_t
+rum_allocated_bytes()
+{
+    return rum_bytes_in_use;
+}
+
+uint64_t
+rum_hash_bytes(uint64_t hash, const void *bytes, size_t len)
+{
+    const unsigned char *byte = bytes;
+
+    while (len--) {
+        hash ^= *byte++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void *
+rum_malloc(size_t size)
+{
+    void *ptr = rum_allocator.alloc(rum_allocator.ctx, size);
+
+    if (ptr) {
+        count_allocation(0, size);
+    }
+    return ptr;
+}
+
+void *
+rum_realloc(void *ptr, size_t old_size, size_t new_size)
+{
+    void *new_ptr = rum_allocator.realloc(rum_allocator.ctx, ptr, old_size, new_size);
+
+    if (new_ptr) {
+        count_allocation(old_size, new_size);
+    }
+    return new_ptr;
+}
+
+void
+rum_free(void *ptr, size_t size)
+{
+    if (ptr) {
+        rum_allocator.free(rum_allocator.ctx, ptr, size);
+        rum_bytes_in_use -= size;
+    }
+}
+
 /* error handling: ensure last error message is retained, free allocated memory, return NULL */
 static rum_element_t *
 rum_parse_error(rum_parser_t **headp, rum_buffer_t *buffer, int print_input_on_error)
@@ -46,54 +169,290 @@ rum_parse_error(rum_parser_t **headp, rum_buffer_t *buffer, int print_input_on_e
     return NULL;
 }
 
+/* what was already used when a parse started, so that its statistics can be computed */
+struct stats_start_s {
+    struct timespec time;
+    size_t bytes_allocated;
+    size_t bytes_in_use;
+};
+
+static void
+start_stats(rum_parse_stats_t *stats, struct stats_start_s *start)
+{
+    if (stats) {
+        memset(stats, 0, sizeof(rum_parse_stats_t));
+        clock_gettime(CLOCK_MONOTONIC, &(start->time));
+        start->bytes_allocated = rum_bytes_allocated;
+        start->bytes_in_use = rum_bytes_peak = rum_bytes_in_use;
+    }
+}
+
+static void
+finish_stats(rum_parse_stats_t *stats, const struct stats_start_s *start, const rum_buffer_t *buffer)
+{
+    struct timespec now;
+
+    if (stats) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        stats->seconds = (now.tv_sec - start->time.tv_sec) + (now.tv_nsec - start->time.tv_nsec) / 1e9;
+        stats->bytes_allocated = rum_bytes_allocated - start->bytes_allocated;
+        stats->peak_allocated = rum_bytes_peak - start->bytes_in_use;
+        stats->buffer_growths = buffer? buffer->ngrowths : 0;
+    }
+}
+
+/* error handling for a file parse: also free the partially parsed document (to the element cache,
+ * if any), finish the parse statistics, and show the trace, if wanted
+ */
+static rum_element_t *
+rum_parse_file_error(rum_parser_t **headp, rum_buffer_t *buffer, rum_element_t *root,
+    const rum_parse_options_t *options, const struct stats_start_s *start, int print_input_on_error)
+{
+    char *errmsg = rum_last_error();
+
+    rum_element_release(options? options->cache : NULL, root);
+    if (options) {
+        finish_stats(options->stats, start, buffer);
+        if (options->trace && print_input_on_error) {
+            rum_trace_dump(options->trace, stderr);
+            fprintf(stderr, "\n");
+        }
+    }
+    rum_set_error(errmsg);
+    return rum_parse_error(headp, buffer, print_input_on_error);
+}
+
 rum_element_t *
 rum_parse_file(FILE *fp, const rum_tag_t *language, int print_input_on_error)
 {
+    return rum_parse_file_with_options(fp, language, NULL, print_input_on_error);
+}
+
+/* parse a block of input into the document whose root is *rootp (NULL until the root tag is
+ * found), returning 0 on success or -1 (with an error set) on error
+ */
+static int
+parse_block(rum_parser_t **headp, const rum_tag_t *language, rum_buffer_t *buffer,
+    const rum_parse_options_t *options, const char *block, size_t size, rum_element_t **rootp)
+{
+    size_t i, ascii;
     int c;
+
+    /* runs of ASCII (found many bytes at a time) are parsed directly, and only the rest is
+     * decoded from UTF-8
+     */
+    for (i = 0, ascii = 0; i < size; ++i) {
+        if ((i >= ascii) && !RUM_BUFFER_IN_CHAR(buffer)) {
+            ascii = i + rum_utf8_ascii_span(block + i, size - i);
+        }
+        c = (unsigned char) block[i];
+        if (i < ascii) {
+            rum_parser_parse_char(headp, language, buffer, c);
+            if (rum_last_error() == NULL) {
+                rum_buffer_add_char(buffer, c);
+            }
+        } else {
+            rum_parser_parse_byte(headp, language, buffer, c);
+        }
+
+        /* note the root element as soon as it exists, so it is freed even on error; an element
+         * without a parent is a root element, and there can be only one
+         */
+        if ((*headp)->element && ((*headp)->element != *rootp) && ((*headp)->element->parent == NULL)) {
+            if (*rootp) {
+                rum_element_free((*headp)->element);
+                rum_set_error("Input holds more than one root element");
+                return -1;
+            }
+            *rootp = (*headp)->element;
+        }
+        if (rum_last_error()) {
+            return -1;
+        }
+
+        /* elements handed to an element-complete callback may be released as soon as they are
+         * done, so the input they came from need not be kept either (an error then shows only
+         * recent input)
+         */
+        if (options && options->on_complete && (buffer->pos >= COMPLETE_COMPACT_SIZE)) {
+            rum_buffer_compact(buffer);
+        }
+    }
+    return 0;
+}
+
+/* at the end of input, return 0 if it held one whole document, or -1 (with an error set) if not */
+static int
+check_complete(const rum_parser_t *head, const rum_buffer_t *buffer, const rum_element_t *root)
+{
+    if (RUM_BUFFER_IN_CHAR(buffer)) {
+        rum_set_error("Input ends inside a character");
+        return -1;
+    }
+    if (root == NULL) {
+        rum_set_error("Root tag not found in input");
+        return -1;
+    }
+
+    /* the root element is complete once its parser state has been popped off the stack, leaving
+     * the first parser state (before any tag is encountered) back in content
+     */
+    if ((head->prev != NULL) || (head->state != RUM_CONTENT)) {
+        rum_set_error("All tags not closed");
+        return -1;
+    }
+    return 0;
+}
+
+rum_element_t *
+rum_parse_file_with_options(FILE *fp, const rum_tag_t *language, const rum_parse_options_t *options,
+    int print_input_on_error)
+{
+    char block[READ_BLOCK_SIZE];
+    size_t nread;
     rum_parser_t *head = NULL;
     rum_buffer_t *buffer = NULL;
-    rum_element_t *element, *document = NULL;
+    rum_element_t *root = NULL;
+    rum_parse_stats_t *stats = options? options->stats : NULL;
+    struct stats_start_s start;
 
     rum_set_error(NULL);
+    start_stats(stats, &start);
     if ((head = rum_parser_new()) == NULL) {
-        return rum_parse_error(&head, buffer, print_input_on_error);
+        return rum_parse_file_error(&head, buffer, root, options, &start, print_input_on_error);
     }
+    rum_parser_set_options(head, options);
 
     /* keep the already-processed XML in a buffer, for back references and error reporting */
     if ((buffer = rum_buffer_new()) == NULL) {
-        return rum_parse_error(&head, buffer, print_input_on_error);
+        return rum_parse_file_error(&head, buffer, root, options, &start, print_input_on_error);
     }
 
-    /* parse input a character at a time */
-    while ((c = getc(fp)) != EOF) {
-        element = rum_parser_parse_char(&head, language, buffer, c);
-        if (rum_last_error() || (rum_buffer_add_char(buffer, c) < 0)) {
-            return rum_parse_error(&head, buffer, print_input_on_error);
+    while ((nread = fread(block, 1, sizeof(block), fp)) > 0) {
+        if (parse_block(&head, language, buffer, options, block, nread, &root) < 0) {
+            return rum_parse_file_error(&head, buffer, root, options, &start, print_input_on_error);
         }
+    }
+    if (check_complete(head, buffer, root) < 0) {
+        return rum_parse_file_error(&head, buffer, root, options, &start, print_input_on_error);
+    }
 
-        /* the first parser state (before any tag is encountered) will have an empty element;
-         * the second parser state will have the root element, and will be the last
-         * to be popped off, so save the last non-NULL element, which is the document
-         */
-        if (element) {
-            document = element;
-        }
+    finish_stats(stats, &start, buffer);
+    rum_parser_free(&head);
+    rum_buffer_free(buffer);
+    return root;
+}
+
+rum_element_t *
+rum_parse_memory(rum_parser_t **headp, rum_buffer_t *buffer, const char *data, size_t size,
+    const rum_tag_t *language, const rum_parse_options_t *options)
+{
+    rum_element_t *root = NULL;
+    rum_parse_stats_t *stats = options? options->stats : NULL;
+    struct stats_start_s start;
+    char *errmsg;
+
+    rum_set_error(NULL);
+    if ((headp == NULL) || (*headp == NULL) || (buffer == NULL) || ((data == NULL) && size)) {
+        rum_set_error("Programmer error: Unable to parse with nonexistent parser or input");
+        return NULL;
     }
+    start_stats(stats, &start);
+    rum_parser_reset(headp);
+    rum_parser_set_options(*headp, options);
+    rum_buffer_reset(buffer);
 
-    if (document == NULL) {
-        rum_set_error("Root tag not found in input");
-        return rum_parse_error(&head, buffer, print_input_on_error);
+    if ((parse_block(headp, language, buffer, options, data, size, &root) < 0)
+        || (check_complete(*headp, buffer, root) < 0)) {
+        errmsg = rum_last_error();
+        rum_element_release(options? options->cache : NULL, root);
+        finish_stats(stats, &start, buffer);
+        rum_set_error(errmsg);
+        return NULL;
+    }
+    finish_stats(stats, &start, buffer);
+    return root;
+}
+
+/* error handling for a ranged parse: also free the partially parsed element */
+static rum_element_t *
+rum_parse_indexed_error(rum_parser_t **headp, rum_buffer_t *buffer, rum_element_t *root, int print_input_on_error)
+{
+    char *errmsg = rum_last_error();
+
+    if (root) {
+        rum_element_free(root);
+    }
+    rum_set_error(errmsg);
+    return rum_parse_error(headp, buffer, print_input_on_error);
+}
+
+rum_element_t *
+rum_parse_indexed(FILE *fp, const rum_sidecar_t *sidecar, const rum_sidecar_range_t *range,
+    int print_input_on_error)
+{
+    int c;
+    uint64_t offset;
+    struct stat st;
+    const rum_tag_t *tag;
+    rum_parser_t *head = NULL;
+    rum_buffer_t *buffer = NULL;
+    rum_element_t *element, *root = NULL;
+
+    rum_set_error(NULL);
+    if ((fp == NULL) || (sidecar == NULL) || (range == NULL)) {
+        rum_set_error("Programmer error: Unable to parse indexed range with nonexistent settings");
+        return NULL;
+    }
+    if ((fstat(fileno(fp), &st) < 0)
+        || ((uint64_t) st.st_size != ((const struct rum_sidecar_header_s *) sidecar->data)->source_size)) {
+        rum_set_error("Index does not match file");
+        return NULL;
     }
 
-    /* if the last parsed element has a parent, then it's not the root tag;
-     * if the last parsed element is also the last element, then the root tag wasn't closed
+    /* the range holds one element, which is parsed as if its tag were the root of the language,
+     * so it gets the same validation it would get in the context of the whole file
      */
-    if ((element == document) || (rum_element_get_parent(document) != NULL)) {
-        rum_set_error("All tags not closed");
-        return rum_parse_error(&head, buffer, print_input_on_error);
+    if ((tag = rum_language_get_tag(sidecar->language, range->tag_id)) == NULL) {
+        rum_set_error("Index does not match language");
+        return NULL;
+    }
+    if (fseeko(fp, range->start, SEEK_SET) < 0) {
+        rum_set_error("Unable to seek to indexed element");
+        return NULL;
+    }
+
+    if ((head = rum_parser_new()) == NULL) {
+        return rum_parse_indexed_error(&head, buffer, root, print_input_on_error);
+    }
+    if ((buffer = rum_buffer_new()) == NULL) {
+        return rum_parse_indexed_error(&head, buffer, root, print_input_on_error);
+    }
+    for (offset = range->start; offset < range->end; ++offset) {
+        if ((c = getc(fp)) == EOF) {
+            rum_set_error("Indexed element extends past end of file");
+            return rum_parse_indexed_error(&head, buffer, root, print_input_on_error);
+        }
+        element = rum_parser_parse_byte(&head, tag, buffer, c);
+        if (rum_last_error()) {
+            return rum_parse_indexed_error(&head, buffer, root, print_input_on_error);
+        }
+        if (root == NULL) {
+            root = element;
+        } else if (element && (element != root) && (rum_element_get_parent(element) == NULL)) {
+            rum_element_free(element);
+            rum_set_error("Indexed range holds more than one element");
+            return rum_parse_indexed_error(&head, buffer, root, print_input_on_error);
+        }
+    }
+
+    /* the range must end exactly where its element was popped off the stack */
+    if ((root == NULL) || (head->prev != NULL) || RUM_BUFFER_IN_CHAR(buffer)) {
+        rum_set_error("Indexed range does not hold a complete element");
+        return rum_parse_indexed_error(&head, buffer, root, print_input_on_error);
     }
 
     rum_parser_free(&head);
     rum_buffer_free(buffer);
-    return document;
+    return root;
 }
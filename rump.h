@@ -12,14 +12,73 @@
 #include <stdio.h>
 #include <rum_types.h>
 #include <rum_buffer.h>
+#include <rum_strpool.h>
 #include <rum_parser.h>
 #include <rum_language.h>
 #include <rum_document.h>
+#include <rum_snapshot.h>
+#include <rum_sidecar.h>
+#include <rum_query.h>
+#include <rum_index.h>
+#include <rum_reparse.h>
+#include <rum_diff.h>
+#include <rum_stream.h>
+#include <rum_profile.h>
+#include <rum_trace.h>
+#include <rum_cache.h>
+#include <rum_session.h>
+#include <rum_walk.h>
+#include <rum_utf8.h>
 
-/* return the last error message from a RuM parser library function */
+/* memory allocator used for all of the library's allocations
+ *
+ * sizes are passed back on realloc and free, so pool allocators need not record them;
+ * ctx is passed through unchanged to each function
+ */
+struct rum_allocator_s {
+    void *(*alloc)(void *ctx, size_t size);
+    void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+    void (*free)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+};
+
+/* return the last error message from a RuM parser library function called by this thread */
 char *rum_last_error();
 
+/* use a custom memory allocator for all subsequent library allocations (NULL restores malloc() etc.)
+ *
+ * the allocator is copied; it must not be changed while any library object is allocated,
+ * because objects are always freed with the allocator that is current at the time
+ */
+void rum_set_allocator(const rum_allocator_t *allocator);
+
+/* return the memory allocator currently in use */
+const rum_allocator_t *rum_get_allocator();
+
 /* return a document object, parsed from an open file stream according to a language */
 rum_element_t *rum_parse_file(FILE *fp, const rum_tag_t *language, int print_input_on_error);
 
+/* same as rum_parse_file(), with options such as a projection (options may be NULL); if the options
+ * ask for statistics, they are filled in whether or not the parse succeeds, and if they give a trace,
+ * it is printed with the input on error
+ */
+rum_element_t *rum_parse_file_with_options(FILE *fp, const rum_tag_t *language, const rum_parse_options_t *options,
+        int print_input_on_error);
+
+/* same as rum_parse_file_with_options(), for a document of size bytes held in memory, parsed with
+ * a parser state stack and buffer kept by the caller (see rum_parser_new() and rum_buffer_new());
+ * both are reset first and kept afterward, whether or not the parse succeeds, so that parsing one
+ * document after another allocates nothing for them once they have grown to fit
+ */
+rum_element_t *rum_parse_memory(rum_parser_t **headp, rum_buffer_t *buffer, const char *data, size_t size,
+        const rum_tag_t *language, const rum_parse_options_t *options);
+
+/* return a single element parsed from the given range of an indexed file stream (see rum_sidecar.h)
+ *
+ * the element is validated as it would be when parsing the whole file, and has no parent;
+ * free it with rum_element_free()
+ */
+rum_element_t *rum_parse_indexed(FILE *fp, const rum_sidecar_t *sidecar, const rum_sidecar_range_t *range,
+        int print_input_on_error);
+
 #endif /* RUM_RUMP__H */
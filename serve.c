@@ -0,0 +1,305 @@
+/*
+    serve.c
+
+    daemon mode of the rum application: displaying documents received on a Unix domain socket
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <rump.h>
+#include "serve.h"
+
+/* size of a request header, and of a response header */
+#define REQUEST_HEADER_SIZE (4)
+#define RESPONSE_HEADER_SIZE (5)
+
+/* exit status of a worker that could not set itself up (so should not be replaced) */
+#define WORKER_SETUP_FAILED (2)
+
+/* what a worker keeps from one document to the next */
+struct worker_s {
+    const rum_tag_t *language;
+    rum_parse_options_t options;
+
+    /* parser state stack and input buffer, reset for each document */
+    rum_parser_t *head;
+    rum_buffer_t *buffer;
+
+    /* the request being handled */
+    char *request;
+    size_t request_capacity;
+
+    /* memory stream that standard output points at, and its contents */
+    FILE *out;
+    char *out_text;
+    size_t out_size;
+};
+
+/* set when the daemon is asked to stop */
+static volatile sig_atomic_t stopping;
+
+static void
+stop(int signum)
+{
+    stopping = 1;
+}
+
+/* read exactly size bytes, returning 0 on success or -1 on error or end of file */
+static int
+read_all(int fd, void *data, size_t size)
+{
+    char *pos = data;
+    ssize_t nread;
+
+    while (size) {
+        if ((nread = read(fd, pos, size)) <= 0) {
+            if ((nread < 0) && (errno == EINTR)) {
+                continue;
+            }
+            return -1;
+        }
+        pos += nread;
+        size -= nread;
+    }
+    return 0;
+}
+
+/* send a response, returning 0 on success or -1 on error */
+static int
+respond(int fd, int status, const char *text, size_t size)
+{
+    unsigned char header[RESPONSE_HEADER_SIZE];
+    uint32_t length = htonl(size);
+    struct iovec iov[2];
+    ssize_t nwritten;
+    int i = 0;
+
+    memcpy(header, &length, sizeof(length));
+    header[4] = status;
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void *) text;
+    iov[1].iov_len = size;
+
+    /* usually done in one call, but a large response may need several */
+    while (i < 2) {
+        if ((nwritten = writev(fd, iov + i, 2 - i)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        for (; (i < 2) && ((size_t) nwritten >= iov[i].iov_len); ++i) {
+            nwritten -= iov[i].iov_len;
+        }
+        if (i < 2) {
+            iov[i].iov_base = (char *) iov[i].iov_base + nwritten;
+            iov[i].iov_len -= nwritten;
+        }
+    }
+    return 0;
+}
+
+static int
+respond_error(int fd, const char *errmsg)
+{
+    return respond(fd, SERVE_STATUS_ERROR, errmsg, strlen(errmsg));
+}
+
+/* parse and display the document in the worker's request, and send the response */
+static int
+handle_document(struct worker_s *worker, int fd, size_t size)
+{
+    rum_element_t *root;
+    long out_size;
+
+    root = rum_parse_memory(&(worker->head), worker->buffer, worker->request, size, worker->language,
+                            &(worker->options));
+    if (root == NULL) {
+        return respond_error(fd, rum_last_error());
+    }
+
+    /* display methods write to standard output, which is the worker's memory stream */
+    rewind(worker->out);
+    rum_element_display(root);
+    fflush(worker->out);
+    out_size = ftell(worker->out);
+    rum_element_release(worker->options.cache, root);
+    return respond(fd, SERVE_STATUS_OK, worker->out_text, out_size);
+}
+
+/* answer requests on a connection until the client closes it (or breaks the protocol) */
+static void
+handle_connection(struct worker_s *worker, int fd)
+{
+    unsigned char header[REQUEST_HEADER_SIZE];
+    uint32_t length;
+    size_t size;
+    char *request;
+
+    while (read_all(fd, header, sizeof(header)) == 0) {
+        memcpy(&length, header, sizeof(length));
+        size = ntohl(length);
+        if (size > SERVE_MAX_DOCUMENT) {
+            respond_error(fd, "Document is too large");
+            return;
+        }
+        if (size > worker->request_capacity) {
+            if ((request = realloc(worker->request, size)) == NULL) {
+                respond_error(fd, "Unable to allocate memory for request");
+                return;
+            }
+            worker->request = request;
+            worker->request_capacity = size;
+        }
+        if ((read_all(fd, worker->request, size) < 0) || (handle_document(worker, fd, size) < 0)) {
+            return;
+        }
+    }
+}
+
+/* accept and handle connections until killed */
+static void
+run_worker(int listen_fd, const rum_tag_t *language)
+{
+    struct worker_s worker;
+    int fd;
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    memset(&worker, 0, sizeof(worker));
+    worker.language = language;
+    if (((worker.options.cache = rum_element_cache_new(language)) == NULL)
+        || ((worker.head = rum_parser_new()) == NULL)
+        || ((worker.buffer = rum_buffer_new()) == NULL)
+        || ((worker.out = open_memstream(&(worker.out_text), &(worker.out_size))) == NULL)) {
+        fprintf(stderr, "*** ERROR: Unable to set up worker\n");
+        exit(WORKER_SETUP_FAILED);
+    }
+    stdout = worker.out;
+
+    for (;;) {
+        if ((fd = accept(listen_fd, NULL, NULL)) < 0) {
+            continue;
+        }
+        handle_connection(&worker, fd);
+        close(fd);
+    }
+}
+
+/* start a worker process, returning its process ID or -1 on error */
+static pid_t
+start_worker(int listen_fd, const rum_tag_t *language)
+{
+    pid_t pid;
+
+    fflush(NULL);
+    if ((pid = fork()) == 0) {
+        run_worker(listen_fd, language);
+    }
+    return pid;
+}
+
+/* create the listening socket, replacing a stale socket at the path (but nothing else) */
+static int
+open_socket(const char *socket_path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "*** ERROR: Socket path is too long\n");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    if ((lstat(socket_path, &st) == 0) && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path);
+    }
+    if (((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        || (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        || (listen(fd, SOMAXCONN) < 0)) {
+        fprintf(stderr, "*** ERROR: Unable to listen on %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+int
+serve(const char *socket_path, const rum_tag_t *language, int nworkers)
+{
+    struct sigaction action;
+    pid_t *workers, pid;
+    int listen_fd, status, i, rc = 0;
+
+    if ((workers = calloc(nworkers, sizeof(pid_t))) == NULL) {
+        fprintf(stderr, "*** ERROR: Unable to allocate memory for workers\n");
+        return 1;
+    }
+    if ((listen_fd = open_socket(socket_path)) < 0) {
+        free(workers);
+        return 1;
+    }
+
+    /* a client that goes away should only end its own connection; signals interrupt wait() */
+    signal(SIGPIPE, SIG_IGN);
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    for (i = 0; i < nworkers; ++i) {
+        workers[i] = start_worker(listen_fd, language);
+    }
+
+    /* replace workers that die, unless they could not set themselves up */
+    while (!stopping) {
+        if ((pid = wait(&status)) < 0) {
+            if (errno == ECHILD) {
+                break;
+            }
+            continue;
+        }
+        for (i = 0; (i < nworkers) && (workers[i] != pid); ++i);
+        if (i == nworkers) {
+            continue;
+        }
+        if (WIFEXITED(status) && (WEXITSTATUS(status) == WORKER_SETUP_FAILED)) {
+            workers[i] = -1;
+        } else if (!stopping) {
+            workers[i] = start_worker(listen_fd, language);
+        }
+    }
+
+    if (!stopping) {
+        fprintf(stderr, "*** ERROR: No workers could be started\n");
+        rc = 1;
+    }
+    for (i = 0; i < nworkers; ++i) {
+        if (workers[i] > 0) {
+            kill(workers[i], SIGTERM);
+        }
+    }
+    while (wait(NULL) > 0);
+    close(listen_fd);
+    unlink(socket_path);
+    free(workers);
+    return rc;
+}
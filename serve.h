@@ -0,0 +1,46 @@
+/*
+    serve.h
+
+    declarations for the rum application's daemon mode
+
+    Copyright (c)2014 Ken Gaillot <kg@boogieonline.com>
+*/
+
+#ifndef SERVE__H
+#define SERVE__H
+
+#include <rum_types.h>
+
+/*
+ * In daemon mode, the application listens on a Unix domain socket, and a pool of worker
+ * processes (forked once the language is defined, so each starts with it ready) takes turns
+ * accepting connections. Each connection carries any number of requests, answered in order:
+ *
+ *   request:  4-byte length (network byte order), then that many bytes of document
+ *   response: 4-byte length (network byte order), then a status byte (0 if the document
+ *             was parsed, 1 if not), then length bytes of text: the displayed document,
+ *             or the error message
+ *
+ * Workers keep their request and output buffers, parser state stack and input buffer (see
+ * rum_parse_memory()), and an element cache (see rum_document.h) from one document to the
+ * next, so once a worker has handled a document of some size and shape, one no bigger is
+ * parsed and displayed allocating nothing but the attribute values and content that are too
+ * long to be stored inline in an element and are not interned (see rum_strpool.h). The pool uses processes rather than
+ * threads because the language's display methods write to standard output, which is shared
+ * by a process's threads, while each worker process can point its own at a memory stream.
+ */
+
+/* largest document accepted, in bytes */
+#define SERVE_MAX_DOCUMENT (64 * 1024 * 1024)
+
+/* response status values */
+#define SERVE_STATUS_OK (0)
+#define SERVE_STATUS_ERROR (1)
+
+/* serve documents of a language on a Unix domain socket with nworkers worker processes,
+ * until interrupted (SIGINT or SIGTERM), returning 0 then, or 1 if the socket or workers could not
+ * be set up
+ */
+int serve(const char *socket_path, const rum_tag_t *language, int nworkers);
+
+#endif /* SERVE__H */